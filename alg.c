@@ -10,46 +10,241 @@
  */
 #define _ALG_C_
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include "sll.h"
+#include <float.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "alg.h"
+#include "sysutil.h"
+
+/*
+ * Local definitions
+ */
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#define ALG_MAX_THREADS 64
+
+/* GEMM blocking: an MR x NR block of C is kept in registers while a KC long
+ * slice of A (MC x KC, in L2) and of B (KC x NC, in L3) is swept; MC is a
+ * multiple of MR and NC of NR */
+#define ALG_MR 6
+#define ALG_NR 8
+#define ALG_MC 72
+#define ALG_KC 256
+#define ALG_NC 1024
+
+/* Products below this many multiply-adds are not worth threads */
+#define ALG_MIN_THREADED (64 * 64 * 64)
+
+/* The AVX2/FMA micro-kernel is picked at run time (GCC on x86 only) */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALG_DISPATCH
+#include <immintrin.h>
+#define ALG_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+/*
+ * Local functions
+ */
+
+/*
+ * Allocates size bytes aligned to ALG_ALIGNMENT.
+ */
+static void* _algAlignedAlloc(size_t size)
+{
+    void *p;
+
+#ifdef _WIN32
+    p = _aligned_malloc(size, ALG_ALIGNMENT);
+#else
+    if (posix_memalign(&p, ALG_ALIGNMENT, size) != 0)
+        p = NULL;
+#endif
+    return p;
+}
+
+static void _algAlignedFree(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/*
+ * Doubles from one row to the next of a matrix with n columns: n rounded up
+ * to a whole number of ALG_ALIGNMENT bytes.
+ */
+static int _algStride(int n)
+{
+    int perLine = ALG_ALIGNMENT / sizeof (double);
+
+    return (n + perLine - 1) / perLine * perLine;
+}
+
+/*
+ * Whether the AVX2/FMA kernels can run on this processor.
+ */
+static int _algHasAvx2()
+{
+#ifdef ALG_DISPATCH
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+#ifdef ALG_DISPATCH
+/*
+ * AVX2/FMA level 1 and 2 kernels. They handle the multiples of 4 (16 for
+ * the reductions, in 4 independent sums) and return how many elements they
+ * did; the callers finish the rest. Loads are unaligned, so any vector will
+ * do, though aligned ones (algVecCreate, AlgMat rows) never split a line.
+ */
+static ALG_AVX2 int _algDotAvx2(int n, const double *x, const double *y, double *dot)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    __m128d s;
+    int i;
+
+    for (i=0; i+16<=n; i+=16) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), s3);
+    }
+    for (; i+4<=n; i+=4) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), s0);
+    }
+    s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    s = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    *dot = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    return i;
+}
+
+static ALG_AVX2 int _algAxpyAvx2(int n, double a, const double *x, double *y)
+{
+    __m256d va = _mm256_set1_pd(a);
+    int i;
+
+    for (i=0; i+4<=n; i+=4) {
+        _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i),
+                _mm256_loadu_pd(y + i)));
+    }
+    return i;
+}
+
+static ALG_AVX2 int _algAddAvx2(int n, const double *v, const double *w, double *x)
+{
+    int i;
+
+    for (i=0; i+4<=n; i+=4) {
+        _mm256_storeu_pd(x + i, _mm256_add_pd(_mm256_loadu_pd(v + i), _mm256_loadu_pd(w + i)));
+    }
+    return i;
+}
+
+static ALG_AVX2 int _algScaleAvx2(int n, double *v, double c)
+{
+    __m256d vc = _mm256_set1_pd(c);
+    int i;
+
+    for (i=0; i+4<=n; i+=4) {
+        _mm256_storeu_pd(v + i, _mm256_mul_pd(vc, _mm256_loadu_pd(v + i)));
+    }
+    return i;
+}
+
+/*
+ * Dot products of 4 rows (lda apart) with x, so each load of x is used 4
+ * times.
+ */
+static ALG_AVX2 int _algDot4Avx2(int n, const double *a, size_t lda, const double *x,
+        double dot[4])
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    __m256d vx, t0, t1;
+    int i;
+
+    for (i=0; i+4<=n; i+=4) {
+        vx = _mm256_loadu_pd(x + i);
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), vx, s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + lda + i), vx, s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + 2 * lda + i), vx, s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + 3 * lda + i), vx, s3);
+    }
+
+    /* Horizontal sums: (s0, s1, s2, s3) -> one vector of 4 dots */
+    t0 = _mm256_hadd_pd(s0, s1);
+    t1 = _mm256_hadd_pd(s2, s3);
+    _mm256_storeu_pd(dot, _mm256_add_pd(_mm256_permute2f128_pd(t0, t1, 0x20),
+            _mm256_permute2f128_pd(t0, t1, 0x31)));
+    return i;
+}
+#endif
 
 /*
  * Functions
  */
 
 /**
- * Creates a vector with n elements.
+ * Creates a vector with n elements, all zeros. The vector starts on an
+ * ALG_ALIGNMENT boundary.
  * @pre Number of elements is positive.
  * @param n Number of elements in the vector.
- * @return Reference to the vector.
+ * @return Reference to the vector (NULL if out of memory).
  */
 double* algVecCreate(int n)
 {
     double *v;
 
     /* Allocate the memory for the vector */
-    v = (double*)calloc(n, sizeof(double));
+    v = (double*)_algAlignedAlloc(sizeof(double)*(n > 0 ? n : 1));
+    if (v != NULL) {
+        memset(v, 0, sizeof(double)*(n > 0 ? n : 1));
+    }
 
     return v;
 }
 
 /**
- * Creates a m by n matrix.
+ * Creates a m by n matrix, all zeros. The rows are in one aligned block,
+ * laid out as in an AlgMat (see algMatRows); the block itself is kept in
+ * the slot before A[0], so the row pointers may be swapped freely.
  * @pre Number of rows is positive (m>0).
  * @pre Number of columns is positive (n>0).
  * @param m Number of rows in the matrix.
  * @param n Number of columns in the matrix.
- * @return Reference to the matrix.
+ * @return Reference to the matrix (NULL if out of memory).
  */
 double** algMatCreate(int m, int n)
 {
-    double **A;
-    int i;
+    double **A, *data;
+    size_t size;
+    int i, stride;
 
     /* Allocate the memory for the matrix */
-    A = (double**)calloc(m, sizeof(double*));
+    stride = _algStride(n);
+    size = sizeof(double)*stride*(m > 0 ? m : 1);
+    A = (double**)malloc((m + 1)*sizeof(double*));
+    data = (double*)_algAlignedAlloc(size);
+    if (A == NULL || data == NULL) {
+        free(A);
+        _algAlignedFree(data);
+        return NULL;
+    }
+    memset(data, 0, size);
+    A[0] = data;
+    A++;
     for (i=0; i<m; i++) {
-        A[i] = (double*)calloc(n, sizeof(double));
+        A[i] = data + (size_t)i*stride;
     }
 
     return A;
@@ -64,7 +259,7 @@ double** algMatCreate(int m, int n)
 void algVecDestroy(double *v)
 {
     /* Deallocate the memory of the vector */
-    free(v);
+    _algAlignedFree(v);
 }
 
 /**
@@ -76,13 +271,10 @@ void algVecDestroy(double *v)
  */
 void algMatDestroy(int m, double **A)
 {
-    int i;
-
-    /* Deallocate the memory of the matrix */
-    for (i=0; i<m; i++) {
-        free(A[i]);
-    }
-    free(A);
+    /* Deallocate the memory of the matrix (block, then row pointers) */
+    (void)m;
+    _algAlignedFree(A[-1]);
+    free(A - 1);
 }
 
 /**
@@ -94,15 +286,8 @@ void algMatDestroy(int m, double **A)
  */
 double algVecLength(int n, double *v)
 {
-    double len = 0.0;
-    int i;
-
     /* Calculate the length */
-    for (i=0; i<n; i++) {
-        len += v[i]*v[i];
-    }
-    len = sqrt(len);
-    return len;
+    return algVecNrm2(n, v);
 }
 
 /**
@@ -161,10 +346,15 @@ void algVecUnit(int n, double *v)
  */
 void algVecAdd(int n, double *v, double *w, double *x)
 {
-    int i;
+    int i = 0;
 
     /* Add... */
-    for (i=0; i<n; i++) {
+#ifdef ALG_DISPATCH
+    if (_algHasAvx2()) {
+        i = _algAddAvx2(n, v, w, x);
+    }
+#endif
+    for (; i<n; i++) {
         x[i] = v[i] + w[i];
     }
 }
@@ -180,18 +370,15 @@ void algVecAdd(int n, double *v, double *w, double *x)
  * elements in the vector.
  * @param A Reference to the matrix.
  * @param v Reference to the vector.
- * @param v Reference to the resulting vector.
+ * @param v Reference to the resulting vector (not v).
  */
 void algVecMultiply(int m, int n, double **A, double *v, double *w)
 {
-    int i, j;
+    int i;
 
-    /* Multiply... */
+    /* Multiply... (a dot product per row) */
     for (i=0; i<m; i++) {
-        w[i] = 0;
-        for (j=0; j<n; j++) {
-            w[i] += A[i][j]*v[j];
-        }
+        w[i] = algVecDot(n, A[i], v);
     }
 }
 
@@ -204,10 +391,15 @@ void algVecMultiply(int m, int n, double **A, double *v, double *w)
  */
 void algVecMultiplyScalar(int n, double *v, double c)
 {
-    int i;
+    int i = 0;
 
     /* Multiply... */
-    for (i=0; i<n; i++) {
+#ifdef ALG_DISPATCH
+    if (_algHasAvx2()) {
+        i = _algScaleAvx2(n, v, c);
+    }
+#endif
+    for (; i<n; i++) {
         v[i] *= c;
     }
 }
@@ -303,16 +495,23 @@ void algMatAdd(int m, int n, double **A, double **B, double **C)
  * @param n Number of columns of the second matrix.
  * @param A Reference to the first matrix.
  * @param B Reference to the second matrix.
- * @param C Reference to the third (resulting) matrix.
+ * @param C Reference to the third (resulting) matrix (neither A nor B).
  */
 void algMatMultiply(int m, int l, int n, double **A, double **B, double **C)
 {
-    int i, j;
+    double a;
+    int i, j, k;
 
-    /* Transform it into an identity matrix */
+    /* Multiply... (along the rows of B and C) */
     for (i=0; i<m; i++) {
         for (j=0; j<n; j++) {
-            A[i][j] = i == j ? 1 : 0;
+            C[i][j] = 0;
+        }
+        for (k=0; k<l; k++) {
+            a = A[i][k];
+            for (j=0; j<n; j++) {
+                C[i][j] += a*B[k][j];
+            }
         }
     }
 }
@@ -356,6 +555,489 @@ void algMatZero(int m, int n, double **A)
     }
 }
 
+/**
+ * Calculates the dot product of two vectors.
+ * @pre Valid vectors (non-null).
+ * @param n Number of elements in the vectors.
+ * @param x Reference to the first vector.
+ * @param y Reference to the second vector.
+ * @return Dot product.
+ */
+double algVecDot(int n, const double *x, const double *y)
+{
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    int i = 0;
+
+    /* Sum... (in 4 independent sums) */
+#ifdef ALG_DISPATCH
+    if (_algHasAvx2()) {
+        i = _algDotAvx2(n, x, y, &s0);
+    }
+#endif
+    for (; i+4<=n; i+=4) {
+        s0 += x[i]*y[i];
+        s1 += x[i + 1]*y[i + 1];
+        s2 += x[i + 2]*y[i + 2];
+        s3 += x[i + 3]*y[i + 3];
+    }
+    for (; i<n; i++) {
+        s0 += x[i]*y[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * Adds a multiple of one vector to another: y = a * x + y.
+ * @pre Valid vectors (non-null).
+ * @param n Number of elements in the vectors.
+ * @param a Scalar.
+ * @param x Reference to the vector to add.
+ * @param y Reference to the resulting vector.
+ */
+void algVecAxpy(int n, double a, const double *x, double *y)
+{
+    int i = 0;
+
+    /* Add... */
+#ifdef ALG_DISPATCH
+    if (_algHasAvx2()) {
+        i = _algAxpyAvx2(n, a, x, y);
+    }
+#endif
+    for (; i<n; i++) {
+        y[i] += a*x[i];
+    }
+}
+
+/**
+ * Calculates the Euclidean norm (length) of a vector. The squares are
+ * summed with algVecDot; only if that overflows or underflows is the sum
+ * taken again, scaled by the largest element.
+ * @pre Valid vector (non-null).
+ * @param n Number of elements in the vector.
+ * @param x Reference to the vector.
+ * @return Norm of the vector.
+ */
+double algVecNrm2(int n, const double *x)
+{
+    double ss, scale = 0.0, e;
+    int i;
+
+    ss = algVecDot(n, x, x);
+    if (ss >= DBL_MIN && ss <= DBL_MAX) {
+        return sqrt(ss);
+    }
+
+    /* Tiny or huge elements (or zero, inf, NaN): scale them to 1 */
+    for (i=0; i<n; i++) {
+        scale = fabs(x[i]) > scale ? fabs(x[i]) : scale;
+    }
+    if (scale == 0.0 || scale > DBL_MAX) {
+        return ss != ss ? ss : scale;
+    }
+    ss = 0.0;
+    for (i=0; i<n; i++) {
+        e = x[i]/scale;
+        ss += e*e;
+    }
+    return scale*sqrt(ss);
+}
+
+/*
+ * Contiguous matrices and GEMM
+ */
+
+/* Number of threads of algMatGemm (0: one per processor) */
+static int algThreads = 0;
+
+/*
+ * A GEMM in progress: C = alpha * A * B + beta * C, cut into tiles of
+ * ALG_MC x ALG_NC that the threads take in turn.
+ */
+typedef struct
+{
+    const AlgMat *A, *B;
+    AlgMat *C;
+    double alpha, beta;
+    int tilesX, tileCount;
+    int nextTile;
+    int useAvx2;
+} AlgGemm;
+
+/*
+ * Packs an mc x kc block of A (row major, lda apart) into slivers of ALG_MR
+ * rows, column by column; rows past mc are zero.
+ */
+static void _algPackA(int mc, int kc, const double *a, int lda, double *buffer)
+{
+    int i, k, r;
+
+    for (i=0; i<mc; i+=ALG_MR) {
+        for (k=0; k<kc; k++) {
+            for (r=0; r<ALG_MR; r++) {
+                *buffer++ = i + r < mc ? a[(size_t) (i + r) * lda + k] : 0.0;
+            }
+        }
+    }
+}
+
+/*
+ * Packs a kc x nc block of B (row major, ldb apart) into slivers of ALG_NR
+ * columns, row by row; columns past nc are zero.
+ */
+static void _algPackB(int kc, int nc, const double *b, int ldb, double *buffer)
+{
+    int j, k, c;
+
+    for (j=0; j<nc; j+=ALG_NR) {
+        for (k=0; k<kc; k++) {
+            if (j + ALG_NR <= nc) {
+                memcpy(buffer, b + (size_t) k * ldb + j, sizeof (double) * ALG_NR);
+                buffer += ALG_NR;
+            } else {
+                for (c=0; c<ALG_NR; c++) {
+                    *buffer++ = j + c < nc ? b[(size_t) k * ldb + j + c] : 0.0;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Micro-kernel: the ALG_MR x ALG_NR product of a packed A sliver and a
+ * packed B sliver over kc, into ab (row major).
+ */
+static void _algKernel(int kc, const double *a, const double *b, double *ab)
+{
+    double acc[ALG_MR][ALG_NR];
+    int k, r, c;
+
+    memset(acc, 0, sizeof (acc));
+    for (k=0; k<kc; k++) {
+        for (r=0; r<ALG_MR; r++) {
+            for (c=0; c<ALG_NR; c++) {
+                acc[r][c] += a[r]*b[c];
+            }
+        }
+        a += ALG_MR;
+        b += ALG_NR;
+    }
+    memcpy(ab, acc, sizeof (acc));
+}
+
+#ifdef ALG_DISPATCH
+/*
+ * AVX2/FMA micro-kernel: the 6 x 8 block lives in 12 registers, each step
+ * loads one row of B (2 registers) and broadcasts the 6 values of A.
+ */
+static ALG_AVX2 void _algKernelAvx2(int kc, const double *a, const double *b, double *ab)
+{
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+    __m256d b0, b1, ar;
+    int k;
+
+    for (k=0; k<kc; k++) {
+        b0 = _mm256_load_pd(b);
+        b1 = _mm256_load_pd(b + 4);
+        ar = _mm256_broadcast_sd(a);
+        c00 = _mm256_fmadd_pd(ar, b0, c00);
+        c01 = _mm256_fmadd_pd(ar, b1, c01);
+        ar = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_fmadd_pd(ar, b0, c10);
+        c11 = _mm256_fmadd_pd(ar, b1, c11);
+        ar = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_fmadd_pd(ar, b0, c20);
+        c21 = _mm256_fmadd_pd(ar, b1, c21);
+        ar = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_fmadd_pd(ar, b0, c30);
+        c31 = _mm256_fmadd_pd(ar, b1, c31);
+        ar = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_fmadd_pd(ar, b0, c40);
+        c41 = _mm256_fmadd_pd(ar, b1, c41);
+        ar = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_fmadd_pd(ar, b0, c50);
+        c51 = _mm256_fmadd_pd(ar, b1, c51);
+        a += ALG_MR;
+        b += ALG_NR;
+    }
+    _mm256_storeu_pd(ab, c00);
+    _mm256_storeu_pd(ab + 4, c01);
+    _mm256_storeu_pd(ab + 8, c10);
+    _mm256_storeu_pd(ab + 12, c11);
+    _mm256_storeu_pd(ab + 16, c20);
+    _mm256_storeu_pd(ab + 20, c21);
+    _mm256_storeu_pd(ab + 24, c30);
+    _mm256_storeu_pd(ab + 28, c31);
+    _mm256_storeu_pd(ab + 32, c40);
+    _mm256_storeu_pd(ab + 36, c41);
+    _mm256_storeu_pd(ab + 40, c50);
+    _mm256_storeu_pd(ab + 44, c51);
+}
+#endif
+
+/*
+ * Computes one tile of C (rows i0.., columns j0..) with the thread's own
+ * packing buffers.
+ */
+static void _algGemmTile(AlgGemm *gemm, int i0, int j0, double *packA, double *packB)
+{
+    const AlgMat *A = gemm->A, *B = gemm->B;
+    AlgMat *C = gemm->C;
+    int mc = min(ALG_MC, C->rows - i0), nc = min(ALG_NC, C->cols - j0);
+    int i, j, k0, kc, ir, jr, r, c;
+    double ab[ALG_MR * ALG_NR], *row;
+
+    /* C = beta * C (0 clears, so NaNs in C don't survive) */
+    for (i=0; i<mc; i++) {
+        row = &algMatAt(C, i0 + i, j0);
+        for (j=0; j<nc; j++) {
+            row[j] = gemm->beta == 0.0 ? 0.0 : gemm->beta*row[j];
+        }
+    }
+
+    /* C += alpha * A * B, one KC slice at a time */
+    for (k0=0; k0<A->cols; k0+=ALG_KC) {
+        kc = min(ALG_KC, A->cols - k0);
+        _algPackB(kc, nc, &algMatAt(B, k0, j0), B->stride, packB);
+        _algPackA(mc, kc, &algMatAt(A, i0, k0), A->stride, packA);
+        for (jr=0; jr<nc; jr+=ALG_NR) {
+            for (ir=0; ir<mc; ir+=ALG_MR) {
+#ifdef ALG_DISPATCH
+                if (gemm->useAvx2)
+                    _algKernelAvx2(kc, packA + (size_t) ir * kc, packB + (size_t) jr * kc, ab);
+                else
+#endif
+                    _algKernel(kc, packA + (size_t) ir * kc, packB + (size_t) jr * kc, ab);
+                for (r=0; r<min(ALG_MR, mc - ir); r++) {
+                    row = &algMatAt(C, i0 + ir + r, j0 + jr);
+                    for (c=0; c<min(ALG_NR, nc - jr); c++) {
+                        row[c] += gemm->alpha*ab[r * ALG_NR + c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * GEMM thread: takes tiles until there are none left. A thread that can't
+ * get its packing buffers takes none and leaves them to the others.
+ * @param arg The AlgGemm.
+ * @return NULL.
+ */
+static void* _algGemmMain(void *arg)
+{
+    AlgGemm *gemm = (AlgGemm*) arg;
+    double *packA = (double*) _algAlignedAlloc(sizeof (double) * ALG_MC * ALG_KC);
+    double *packB = (double*) _algAlignedAlloc(sizeof (double) * ALG_KC * ALG_NC);
+    int tile;
+
+    if (packA == NULL || packB == NULL) {
+        _algAlignedFree(packA);
+        _algAlignedFree(packB);
+        return NULL;
+    }
+    while ((tile = __sync_fetch_and_add(&gemm->nextTile, 1)) < gemm->tileCount) {
+        _algGemmTile(gemm, (tile / gemm->tilesX) * ALG_MC, (tile % gemm->tilesX) * ALG_NC,
+                packA, packB);
+    }
+    _algAlignedFree(packA);
+    _algAlignedFree(packB);
+    return NULL;
+}
+
+/**
+ * Creates a m by n matrix in one aligned block (see AlgMat), all zeros.
+ * @pre Valid matrix structure (non-null).
+ * @param A Reference to the structure that receives the matrix.
+ * @param m Number of rows in the matrix.
+ * @param n Number of columns in the matrix.
+ * @return 0 on success, -1 if out of memory.
+ */
+int algMatAlloc(AlgMat *A, int m, int n)
+{
+    size_t size;
+
+    A->rows = m;
+    A->cols = n;
+    A->stride = _algStride(n);
+    size = sizeof (double) * A->stride * (m > 0 ? m : 1);
+    A->data = (double*) _algAlignedAlloc(size);
+    if (A->data == NULL)
+        return -1;
+    memset(A->data, 0, size);
+    return 0;
+}
+
+/**
+ * Destroys a matrix created by algMatAlloc.
+ * @param A Reference to the matrix.
+ */
+void algMatFree(AlgMat *A)
+{
+    _algAlignedFree(A->data);
+    A->data = NULL;
+}
+
+/**
+ * Creates an AlgMat holding a copy of a matrix of the double** kind (see
+ * algMatCreate).
+ * @pre Valid matrix structure and matrix (non-null).
+ * @param A Reference to the structure that receives the matrix.
+ * @param m Number of rows in the matrix.
+ * @param n Number of columns in the matrix.
+ * @param rows Reference to the matrix to copy.
+ * @return 0 on success, -1 if out of memory.
+ */
+int algMatFromRows(AlgMat *A, int m, int n, double **rows)
+{
+    int i;
+
+    if (algMatAlloc(A, m, n) != 0)
+        return -1;
+    for (i=0; i<m; i++) {
+        memcpy(&algMatAt(A, i, 0), rows[i], sizeof (double) * n);
+    }
+    return 0;
+}
+
+/**
+ * Copies an AlgMat into a matrix of the double** kind of the same size.
+ * @pre Valid matrices (non-null).
+ * @param A Reference to the matrix to copy.
+ * @param rows Reference to the resulting matrix.
+ */
+void algMatToRows(const AlgMat *A, double **rows)
+{
+    int i;
+
+    for (i=0; i<A->rows; i++) {
+        memcpy(rows[i], &algMatAt(A, i, 0), sizeof (double) * A->cols);
+    }
+}
+
+/**
+ * Makes row pointers into an AlgMat, so that the double** functions of this
+ * module work on it in place. The pointers are released with free(), never
+ * with algMatDestroy, and only live as long as the AlgMat.
+ * @pre Valid matrix (non-null).
+ * @param A Reference to the matrix.
+ * @return Array of A->rows row pointers (NULL if out of memory).
+ */
+double** algMatRows(const AlgMat *A)
+{
+    double **rows;
+    int i;
+
+    rows = (double**) malloc(sizeof (double*) * (A->rows > 0 ? A->rows : 1));
+    if (rows == NULL)
+        return NULL;
+    for (i=0; i<A->rows; i++) {
+        rows[i] = &algMatAt(A, i, 0);
+    }
+    return rows;
+}
+
+/**
+ * General matrix-vector product: y = alpha * A * x + beta * y. Rows are
+ * taken 4 at a time so that x is read once for all of them.
+ * @pre A is m x n, x has n elements and y has m; y is not x.
+ * @param alpha Scale of the product.
+ * @param A Reference to the matrix.
+ * @param x Reference to the vector.
+ * @param beta Scale of the original y (0 ignores its contents).
+ * @param y Reference to the resulting vector.
+ */
+void algMatGemv(double alpha, const AlgMat *A, const double *x, double beta, double *y)
+{
+    double dot[4];
+    int i = 0, r, j;
+
+#ifdef ALG_DISPATCH
+    if (_algHasAvx2()) {
+        for (; i+4<=A->rows; i+=4) {
+            j = _algDot4Avx2(A->cols, &algMatAt(A, i, 0), A->stride, x, dot);
+            for (; j<A->cols; j++) {
+                for (r=0; r<4; r++) {
+                    dot[r] += algMatAt(A, i + r, j)*x[j];
+                }
+            }
+            for (r=0; r<4; r++) {
+                y[i + r] = alpha*dot[r] + (beta == 0.0 ? 0.0 : beta*y[i + r]);
+            }
+        }
+    }
+#endif
+    for (; i<A->rows; i++) {
+        y[i] = alpha*algVecDot(A->cols, &algMatAt(A, i, 0), x)
+                + (beta == 0.0 ? 0.0 : beta*y[i]);
+    }
+}
+
+/**
+ * General matrix product: C = alpha * A * B + beta * C. The product is cut
+ * into blocks that stay in the caches, packed, and computed by a register-
+ * blocked micro-kernel (AVX2/FMA where the processor has it); tiles of C
+ * are shared out among the threads (see algSetThreads).
+ * @pre A is m x l, B is l x n and C is m x n; C is neither A nor B.
+ * @param alpha Scale of the product.
+ * @param A Reference to the first matrix.
+ * @param B Reference to the second matrix.
+ * @param beta Scale of the original C (0 ignores its contents).
+ * @param C Reference to the resulting matrix.
+ * @return 0 on success, -1 if out of memory (C is then incomplete).
+ */
+int algMatGemm(double alpha, const AlgMat *A, const AlgMat *B, double beta, AlgMat *C)
+{
+    pthread_t threads[ALG_MAX_THREADS];
+    AlgGemm gemm;
+    int i, n;
+
+    if (C->rows <= 0 || C->cols <= 0)
+        return 0;
+    gemm.A = A;
+    gemm.B = B;
+    gemm.C = C;
+    gemm.alpha = alpha;
+    gemm.beta = beta;
+    gemm.tilesX = (C->cols + ALG_NC - 1) / ALG_NC;
+    gemm.tileCount = gemm.tilesX * ((C->rows + ALG_MC - 1) / ALG_MC);
+    gemm.nextTile = 0;
+    gemm.useAvx2 = _algHasAvx2();
+
+    /* Threads (the caller is one of them) */
+    n = algThreads > 0 ? algThreads : sysProcessorCount();
+    if ((double) C->rows * C->cols * A->cols < ALG_MIN_THREADED)
+        n = 1;
+    n = min(min(n, ALG_MAX_THREADS), gemm.tileCount);
+    for (i=1; i<n; i++) {
+        if (pthread_create(&threads[i], NULL, _algGemmMain, &gemm) != 0)
+            break;
+    }
+    n = i;
+    _algGemmMain(&gemm);
+    for (i=1; i<n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Tiles are left only if no thread got its buffers */
+    return gemm.nextTile < gemm.tileCount ? -1 : 0;
+}
+
+/**
+ * Sets the number of threads algMatGemm uses.
+ * @param n Number of threads, 0 for one per processor (the default).
+ */
+void algSetThreads(int n)
+{
+    algThreads = n > 0 ? n : 0;
+}
+
 /* End of file -------------------------------------------------------------- */
 
 
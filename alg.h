@@ -11,6 +11,35 @@
 #ifndef _ALG_H_
 #define _ALG_H_
 
+#include <stddef.h>
+
+/*
+ * Definitions
+ */
+#define ALG_ALIGNMENT       64  /* bytes; every AlgMat row starts on one */
+
+/* Element (i, j) of an AlgMat */
+#define algMatAt(A, i, j)   ((A)->data[(size_t) (i) * (A)->stride + (j)])
+
+/**
+ * Matrix in one block of memory, row by row. Rows are stride doubles apart
+ * (cols rounded up to a whole number of ALG_ALIGNMENT bytes), so every row
+ * is aligned and the padding is never read.
+ */
+typedef struct
+{
+    /**
+     * Number of rows and columns, and doubles from one row to the next.
+     */
+    int rows, cols, stride;
+
+    /**
+     * The elements (NULL if the allocation failed).
+     */
+    double *data;
+
+} AlgMat;
+
 /**
  * Prototypes
  */
@@ -27,14 +56,26 @@ void algVecAdd(int n, double *v, double *w, double *x);
 void algVecMultiply(int m, int n, double **A, double *v, double *w);
 void algVecMultiplyScalar(int n, double *v, double c);
 void algVecZero(int n, double *v);
+double algVecDot(int n, const double *x, const double *y);
+void algVecAxpy(int n, double a, const double *x, double *y);
+double algVecNrm2(int n, const double *x);
 
-double** algMatCopy(int n, double **A);
+double** algMatCopy(int m, int n, double **A);
 void algMatIdentity(int n, double **A);
 void algMatAdd(int m, int n, double **A, double **B, double **C);
 void algMatMultiply(int m, int l, int n, double **A, double **B, double **C);
 void algMatMultiplyScalar(int m, int n, double **A, double c);
 void algMatZero(int m, int n, double **A);
 
+int algMatAlloc(AlgMat *A, int m, int n);
+void algMatFree(AlgMat *A);
+int algMatFromRows(AlgMat *A, int m, int n, double **rows);
+void algMatToRows(const AlgMat *A, double **rows);
+double** algMatRows(const AlgMat *A);
+void algMatGemv(double alpha, const AlgMat *A, const double *x, double beta, double *y);
+int algMatGemm(double alpha, const AlgMat *A, const AlgMat *B, double beta, AlgMat *C);
+void algSetThreads(int n);
+
 /* End of file -------------------------------------------------------------- */
 
 #endif
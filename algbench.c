@@ -0,0 +1,173 @@
+/**
+ * Matrix product benchmark.
+ *
+ * Times algMatGemm (see alg.c) against the naive triple loop on square
+ * matrices of random values and prints GFLOP/s (2 n^3 flops a product) and
+ * the largest difference between the two results:
+ *
+ *   algbench [-t threads] [size...]
+ *
+ * The naive loop is only timed up to NAIVE_MAX_SIZE; the default sizes are
+ * 128, 256, 512, 1024 and 2048.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "alg.h"
+#include "sysutil.h"
+
+/*
+ * Definitions
+ */
+#define NAIVE_MAX_SIZE 1024
+#define MIN_SECONDS 0.5 /* Each variant is repeated for at least this long */
+
+/*
+ * Protoypes
+ */
+void fillRandom(AlgMat *A);
+void naiveMultiply(const AlgMat *A, const AlgMat *B, AlgMat *C);
+double difference(const AlgMat *A, const AlgMat *B);
+int benchmark(int n, int threads);
+
+/*
+ * Function definitions
+ */
+
+/*
+ * Fills a matrix with values in [-1, 1].
+ */
+void fillRandom(AlgMat *A) {
+    int i, j;
+
+    for (i = 0; i < A->rows; i++)
+        for (j = 0; j < A->cols; j++)
+            algMatAt(A, i, j) = 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+/*
+ * C = A * B, the textbook way (a dot product per element).
+ */
+void naiveMultiply(const AlgMat *A, const AlgMat *B, AlgMat *C) {
+    double sum;
+    int i, j, k;
+
+    for (i = 0; i < C->rows; i++) {
+        for (j = 0; j < C->cols; j++) {
+            sum = 0.0;
+            for (k = 0; k < A->cols; k++)
+                sum += algMatAt(A, i, k) * algMatAt(B, k, j);
+            algMatAt(C, i, j) = sum;
+        }
+    }
+}
+
+/*
+ * Largest absolute difference between two matrices of the same size.
+ */
+double difference(const AlgMat *A, const AlgMat *B) {
+    double d, max = 0.0;
+    int i, j;
+
+    for (i = 0; i < A->rows; i++) {
+        for (j = 0; j < A->cols; j++) {
+            d = fabs(algMatAt(A, i, j) - algMatAt(B, i, j));
+            max = d > max ? d : max;
+        }
+    }
+    return max;
+}
+
+/*
+ * Benchmarks one size and prints a line of the report.
+ * @param n Size of the matrices.
+ * @param threads Threads of algMatGemm (0: one per processor).
+ * @return Status code.
+ */
+int benchmark(int n, int threads) {
+    AlgMat A, B, C, D;
+    double start, seconds, naive = 0.0, gemm;
+    int runs, status = EXIT_SUCCESS;
+
+    if (algMatAlloc(&A, n, n) != 0 || algMatAlloc(&B, n, n) != 0
+            || algMatAlloc(&C, n, n) != 0 || algMatAlloc(&D, n, n) != 0) {
+        fprintf(stderr, "error: not enough memory for %d x %d matrices!\n", n, n);
+        return EXIT_FAILURE;
+    }
+    fillRandom(&A);
+    fillRandom(&B);
+    algSetThreads(threads);
+
+    /* GEMM */
+    runs = 0;
+    start = sysNow();
+    do {
+        if (algMatGemm(1.0, &A, &B, 0.0, &C) != 0) {
+            fprintf(stderr, "error: not enough memory for the product!\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        runs++;
+        seconds = sysNow() - start;
+    } while (seconds < MIN_SECONDS);
+    gemm = runs > 0 ? 2.0 * n * n * n * runs / seconds * 1e-9 : 0.0;
+
+    /* Naive */
+    if (status != EXIT_SUCCESS) {
+        /* Nothing to compare with */
+    } else if (n <= NAIVE_MAX_SIZE) {
+        runs = 0;
+        start = sysNow();
+        do {
+            naiveMultiply(&A, &B, &D);
+            runs++;
+            seconds = sysNow() - start;
+        } while (seconds < MIN_SECONDS);
+        naive = 2.0 * n * n * n * runs / seconds * 1e-9;
+        printf("%6d %12.2f %12.2f %9.1fx %12.2e\n", n, naive, gemm, gemm / naive,
+                difference(&C, &D));
+    } else {
+        printf("%6d %12s %12.2f %10s %12s\n", n, "-", gemm, "-", "-");
+    }
+
+    algMatFree(&A);
+    algMatFree(&B);
+    algMatFree(&C);
+    algMatFree(&D);
+    return status;
+}
+
+/*
+ * Main function.
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ * @return Status code.
+ */
+int main(int argc, char **argv) {
+    int sizes[] = {128, 256, 512, 1024, 2048};
+    int i, threads = 0, status = EXIT_SUCCESS;
+
+    if (argc > 2 && !strcmp(argv[1], "-t")) {
+        threads = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    for (i = 1; i < argc; i++) {
+        if (atoi(argv[i]) <= 0) {
+            fprintf(stderr, "usage: %s [-t threads] [size...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%6s %12s %12s %10s %12s\n", "size", "naive GF/s", "gemm GF/s", "speedup", "max diff");
+    if (argc > 1) {
+        for (i = 1; i < argc && status == EXIT_SUCCESS; i++)
+            status = benchmark(atoi(argv[i]), threads);
+    } else {
+        for (i = 0; i < (int) (sizeof (sizes) / sizeof (sizes[0])) && status == EXIT_SUCCESS; i++)
+            status = benchmark(sizes[i], threads);
+    }
+    return status;
+}
+/* End of file -------------------------------------------------------------- */
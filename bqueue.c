@@ -0,0 +1,155 @@
+/**
+ * bqueue.c - This module contains the definition/implementation of functions
+ * to represent a bounded, blocking FIFO queue shared between threads.
+ * <p>
+ * Like the SLL module, the queue stores its elements as generic pointers
+ * (void*). Producers block while the queue is full and consumers block while
+ * it is empty, so a chain of queues gives a pipeline with built-in
+ * back-pressure. Closing the queue wakes everybody up: pushes fail from then
+ * on and pops drain the remaining elements before returning NULL.
+ * <p>
+ * Functions that start with 'bq' are considered as queue-related functions.
+ */
+#define _BQUEUE_C_
+
+#include <stdlib.h>
+#include "bqueue.h"
+
+/*
+ * Functions
+ */
+
+/**
+ * Creates a bounded queue.
+ * @pre Capacity is positive.
+ * @param capacity Max. number of elements waiting in the queue.
+ * @return Reference to the queue, NULL if out of memory.
+ */
+BQueue* bqCreate(int capacity)
+{
+    BQueue *queue;
+
+    /* Allocate the memory for the queue */
+    queue = (BQueue*)malloc(sizeof(BQueue));
+    if (queue == NULL)
+        return NULL;
+    queue->items = (void**)malloc(sizeof(void*) * capacity);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    /* Initialize the queue */
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->elementCount = 0;
+    queue->closed = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+
+    return queue;
+}
+
+/**
+ * Destroys a queue. The elements still in the queue are not released.
+ * @pre No thread is blocked on the queue.
+ * @param queue Reference to the reference of the queue (set to NULL).
+ */
+void bqDestroy(BQueue **queue)
+{
+    if (*queue == NULL)
+        return;
+
+    pthread_cond_destroy(&(*queue)->notFull);
+    pthread_cond_destroy(&(*queue)->notEmpty);
+    pthread_mutex_destroy(&(*queue)->lock);
+    free((*queue)->items);
+    free(*queue);
+    *queue = NULL;
+}
+
+/**
+ * Adds an element at the end of the queue, waiting while the queue is full.
+ * @pre Valid queue (non-null).
+ * @param queue Reference to the queue.
+ * @param data Client's data.
+ * @return 0 on success, -1 if the queue has been closed.
+ */
+int bqPush(BQueue *queue, void *data)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->elementCount == queue->capacity && !queue->closed)
+        pthread_cond_wait(&queue->notFull, &queue->lock);
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    /* Append... */
+    queue->items[(queue->head + queue->elementCount) % queue->capacity] = data;
+    queue->elementCount++;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+/**
+ * Removes the first element in the queue, waiting while the queue is empty.
+ * @pre Valid queue (non-null).
+ * @param queue Reference to the queue.
+ * @return Client's data, NULL once the queue is closed and drained.
+ */
+void* bqPop(BQueue *queue)
+{
+    void *data;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->elementCount == 0 && !queue->closed)
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    if (queue->elementCount == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return NULL;
+    }
+
+    /* Take the first one */
+    data = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->elementCount--;
+    pthread_cond_signal(&queue->notFull);
+    pthread_mutex_unlock(&queue->lock);
+    return data;
+}
+
+/**
+ * Closes the queue: further pushes fail and pops return NULL once the
+ * remaining elements have been consumed. Wakes up all waiting threads.
+ * @pre Valid queue (non-null).
+ * @param queue Reference to the queue.
+ */
+void bqClose(BQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_cond_broadcast(&queue->notFull);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Gets the number of elements waiting in the queue.
+ * @pre Valid queue (non-null).
+ * @param queue Reference to the queue.
+ * @return Number of elements in the queue.
+ */
+int bqSize(BQueue *queue)
+{
+    int n;
+
+    pthread_mutex_lock(&queue->lock);
+    n = queue->elementCount;
+    pthread_mutex_unlock(&queue->lock);
+    return n;
+}
+
+/* End of file -------------------------------------------------------------- */
@@ -0,0 +1,72 @@
+/**
+ * bqueue.h - This module contains the definition/implementation of functions
+ * to represent a bounded, blocking FIFO queue shared between threads.
+ * <p>
+ * Like the SLL module, the queue stores its elements as generic pointers
+ * (void*). Producers block while the queue is full and consumers block while
+ * it is empty, so a chain of queues gives a pipeline with built-in
+ * back-pressure. Closing the queue wakes everybody up: pushes fail from then
+ * on and pops drain the remaining elements before returning NULL.
+ * <p>
+ * Functions that start with 'bq' are considered as queue-related functions.
+ */
+#ifndef _BQUEUE_H_
+#define _BQUEUE_H_
+
+#include <pthread.h>
+
+/*
+ * Definitions
+ */
+
+/**
+ * Bounded queue (ring buffer of element references).
+ */
+typedef struct
+{
+    /**
+     * Ring buffer of client's data.
+     */
+    void **items;
+
+    /**
+     * Max. number of elements in the queue.
+     */
+    int capacity;
+
+    /**
+     * Index of the first element in line.
+     */
+    int head;
+
+    /**
+     * No. of elements in the queue.
+     */
+    int elementCount;
+
+    /**
+     * Set once bqClose has been called.
+     */
+    int closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+
+} BQueue;
+
+/**
+ * Prototypes
+ */
+BQueue* bqCreate(int capacity);
+void bqDestroy(BQueue **queue);
+
+int bqPush(BQueue *queue, void *data);
+void* bqPop(BQueue *queue);
+void bqClose(BQueue *queue);
+
+int bqSize(BQueue *queue);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * brick.c - This module contains the definition/implementation of functions
+ * to store volumes in a bricked on-disk layout and to cut slices out of it.
+ * <p>
+ * An axial-ordered volume is fast to read plane by plane along z only: a
+ * sagittal slice touches one cache line per pixel across the whole file.
+ * A bricked file splits the volume into cubes of brickSize^3 voxels, each
+ * one stored contiguously and page-aligned, so a plane of any orientation
+ * is gathered from the few bricks it crosses at near-sequential I/O cost.
+ * <p>
+ * File layout: a BrkHeader, the brick index (one 64-bit file offset per
+ * brick, z-major, 0 for bricks that are entirely zero and not stored) and
+ * the bricks themselves, voxels in host byte order with x varying fastest.
+ * <p>
+ * Functions that start with 'brk' are considered as brick-related functions.
+ */
+#define _BRICK_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "brick.h"
+
+/*
+ * Local definitions
+ */
+#define _brkAlign(n, a) (((n) + (a) - 1) / (a) * (a))
+
+/*
+ * Reads the voxel at p (host byte order) as a signed value.
+ */
+static int _brkVoxel(const unsigned char *p, int datatype)
+{
+    unsigned short u;
+
+    if (datatype == NII_UINT8)
+        return p[0];
+    memcpy(&u, p, 2);
+    return datatype == NII_INT16 ? (short) u : u;
+}
+
+/*
+ * Copies one brick out of a NIfTI volume, swapping to host byte order and
+ * zero-padding past the volume edges.
+ * @return 1 if the brick is entirely zero, otherwise 0.
+ */
+static int _brkGather(NiiVolume *vol, int brickSize, int x0, int y0, int z0,
+        unsigned char *brick, int *vmin, int *vmax)
+{
+    const unsigned char *src;
+    unsigned char *dst;
+    int vs = vol->voxelSize;
+    int nx = vol->nx - x0 < brickSize ? vol->nx - x0 : brickSize;
+    int ny = vol->ny - y0 < brickSize ? vol->ny - y0 : brickSize;
+    int nz = vol->nz - z0 < brickSize ? vol->nz - z0 : brickSize;
+    int x, y, z, v, empty = 1;
+
+    memset(brick, 0, (size_t) brickSize * brickSize * brickSize * vs);
+    for (z = 0; z < nz; z++) {
+        for (y = 0; y < ny; y++) {
+            src = vol->voxels + (((size_t) (z0 + z) * vol->ny + y0 + y) * vol->nx + x0) * vs;
+            dst = brick + ((size_t) (z * brickSize + y) * brickSize) * vs;
+            for (x = 0; x < nx; x++, src += vs, dst += vs) {
+                if (vs == 2 && vol->swapped) {
+                    dst[0] = src[1];
+                    dst[1] = src[0];
+                } else {
+                    memcpy(dst, src, vs);
+                }
+                v = _brkVoxel(dst, vol->datatype);
+                if (v < *vmin)
+                    *vmin = v;
+                if (v > *vmax)
+                    *vmax = v;
+                if (v != 0)
+                    empty = 0;
+            }
+        }
+    }
+    return empty;
+}
+
+/*
+ * Functions
+ */
+
+/**
+ * Converts a NIfTI volume (first time point) into a bricked file.
+ * @pre Volume opened with niiOpen.
+ * @param vol Reference to the source volume.
+ * @param filename Name of the bricked file to create.
+ * @param brickSize Edge length of a brick in voxels (e.g. 32).
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int brkWrite(NiiVolume *vol, const char *filename, int brickSize)
+{
+    BrkHeader h;
+    FILE *fp;
+    long long *index, offset;
+    unsigned char *brick, *pad;
+    size_t brickBytes, count;
+    int i, x, y, z, vmin = 65535, vmax = -32768, ok = 1;
+
+    /* Header */
+    memset(&h, 0, sizeof (BrkHeader));
+    strcpy(h.magic, BRK_MAGIC);
+    h.version = BRK_VERSION;
+    h.byteOrder = BRK_BYTE_ORDER;
+    h.nx = vol->nx;
+    h.ny = vol->ny;
+    h.nz = vol->nz;
+    h.brickSize = brickSize;
+    h.bx = (vol->nx + brickSize - 1) / brickSize;
+    h.by = (vol->ny + brickSize - 1) / brickSize;
+    h.bz = (vol->nz + brickSize - 1) / brickSize;
+    h.datatype = vol->datatype;
+    h.voxelSize = vol->voxelSize;
+    memcpy(h.pixdim, vol->pixdim, sizeof (h.pixdim));
+
+    count = (size_t) h.bx * h.by * h.bz;
+    brickBytes = (size_t) brickSize * brickSize * brickSize * vol->voxelSize;
+    index = (long long*) calloc(count, sizeof (long long));
+    brick = (unsigned char*) malloc(brickBytes);
+    if ((fp = fopen(filename, "wb")) == NULL) {
+        fprintf(stderr, "error: couldn't open \"%s\" for writing!\n", filename);
+        free(index);
+        free(brick);
+        return -1;
+    }
+
+    /* Room for the header and the index, padded to the first brick */
+    offset = _brkAlign(sizeof (BrkHeader) + count * sizeof (long long), BRK_ALIGNMENT);
+    pad = (unsigned char*) calloc((size_t) offset, 1);
+    ok = fwrite(pad, 1, (size_t) offset, fp) == (size_t) offset;
+    free(pad);
+
+    /* Bricks, slab by slab so the source is read front to back */
+    i = 0;
+    for (z = 0; z < h.bz; z++) {
+        for (y = 0; y < h.by; y++) {
+            for (x = 0; x < h.bx; x++, i++) {
+                if (_brkGather(vol, brickSize, x * brickSize, y * brickSize, z * brickSize,
+                        brick, &vmin, &vmax))
+                    continue;
+                index[i] = offset;
+                offset += brickBytes;
+                ok = ok && fwrite(brick, 1, brickBytes, fp) == brickBytes;
+            }
+        }
+    }
+
+    /* Window used to bring 16-bit voxels down to 8 bits */
+    if (vol->datatype == NII_UINT8) {
+        h.windowLo = 0.0f;
+        h.windowHi = 255.0f;
+    } else if (vol->calMax > vol->calMin) {
+        h.windowLo = (vol->calMin - vol->sclInter) / vol->sclSlope;
+        h.windowHi = (vol->calMax - vol->sclInter) / vol->sclSlope;
+    } else {
+        h.windowLo = (float) vmin;
+        h.windowHi = (float) vmax;
+    }
+
+    /* Header and index go in last */
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0
+            && fwrite(&h, sizeof (BrkHeader), 1, fp) == 1
+            && fwrite(index, sizeof (long long), count, fp) == count;
+    if (fclose(fp) != 0 || !ok) {
+        fprintf(stderr, "error: couldn't write \"%s\"!\n", filename);
+        ok = 0;
+    }
+    free(index);
+    free(brick);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Opens a bricked volume.
+ * @pre Valid volume structure (non-null).
+ * @param vol Reference to the structure that receives the volume.
+ * @param filename Name of the bricked file.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int brkOpen(BrkVolume *vol, const char *filename)
+{
+    BrkHeader *h = &vol->header;
+    size_t count, brickBytes, dataStart, stored, i;
+
+    if (mmfOpen(&vol->file, filename) != 0)
+        return -1;
+    if (vol->file.size < sizeof (BrkHeader)) {
+        fprintf(stderr, "error: \"%s\" is not a bricked volume!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+    memcpy(h, vol->file.data, sizeof (BrkHeader));
+    if (memcmp(h->magic, BRK_MAGIC, sizeof (BRK_MAGIC)) != 0 || h->version != BRK_VERSION
+            || h->byteOrder != BRK_BYTE_ORDER || h->brickSize <= 0
+            || (h->voxelSize != 1 && h->voxelSize != 2)) {
+        fprintf(stderr, "error: \"%s\" is not a bricked volume for this machine!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+
+    /* The brick grid has to cover the volume exactly (slices index it) */
+    if (h->nx <= 0 || h->ny <= 0 || h->nz <= 0
+            || h->bx != (h->nx - 1) / h->brickSize + 1 || h->by != (h->ny - 1) / h->brickSize + 1
+            || h->bz != (h->nz - 1) / h->brickSize + 1
+            || (double) h->brickSize * h->brickSize * h->brickSize * h->voxelSize
+                > (double) vol->file.size
+            || sizeof (BrkHeader) + (double) h->bx * h->by * h->bz * sizeof (long long)
+                > (double) vol->file.size) {
+        fprintf(stderr, "error: inconsistent sizes in \"%s\"!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+
+    /* Every stored brick has to lie within the file, after the index */
+    count = (size_t) h->bx * h->by * h->bz;
+    brickBytes = (size_t) h->brickSize * h->brickSize * h->brickSize * h->voxelSize;
+    vol->index = (const long long*) (vol->file.data + sizeof (BrkHeader));
+    dataStart = sizeof (BrkHeader) + count * sizeof (long long);
+    stored = 0;
+    for (i = 0; i < count; i++) {
+        if (vol->index[i] == 0)
+            continue;
+        stored++;
+        if (vol->index[i] < (long long) dataStart
+                || (size_t) vol->index[i] + brickBytes > vol->file.size) {
+            fprintf(stderr, "error: corrupt brick index in \"%s\"!\n", filename);
+            mmfClose(&vol->file);
+            return -1;
+        }
+    }
+    if ((double) stored * brickBytes > (double) (vol->file.size - dataStart)) {
+        fprintf(stderr, "error: truncated bricks in \"%s\"!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Closes a bricked volume.
+ * @pre Volume opened with brkOpen.
+ * @param vol Reference to the volume.
+ */
+void brkClose(BrkVolume *vol)
+{
+    mmfClose(&vol->file);
+    vol->index = NULL;
+}
+
+/**
+ * Gets the size of the slices of a given orientation.
+ * @pre Volume opened with brkOpen.
+ * @param vol Reference to the volume.
+ * @param axis BRK_AXIAL, BRK_CORONAL or BRK_SAGITTAL.
+ * @param width Receives the image width.
+ * @param height Receives the image height.
+ * @return Number of slices in that orientation, -1 for a bad axis.
+ */
+int brkSliceSize(BrkVolume *vol, int axis, int *width, int *height)
+{
+    BrkHeader *h = &vol->header;
+
+    switch (axis) {
+        case BRK_AXIAL:
+            *width = h->nx;
+            *height = h->ny;
+            return h->nz;
+        case BRK_CORONAL:
+            *width = h->nx;
+            *height = h->nz;
+            return h->ny;
+        case BRK_SAGITTAL:
+            *width = h->ny;
+            *height = h->nz;
+            return h->nx;
+    }
+    return -1;
+}
+
+/**
+ * Gathers a slice of any orientation into an 8-bit image. Only the bricks
+ * crossed by the plane are touched, each one as a few contiguous runs.
+ * 16-bit voxels are windowed to 0..255 with the window stored in the file.
+ * @pre Volume opened with brkOpen.
+ * @param vol Reference to the volume.
+ * @param axis BRK_AXIAL, BRK_CORONAL or BRK_SAGITTAL.
+ * @param index Slice index along the fixed axis.
+ * @param img Receives the slice (pixel_data is buffer).
+ * @param buffer Output buffer of at least width*height bytes.
+ * @return 0 on success, -1 if axis or index are out of range.
+ */
+int brkGetSlice(BrkVolume *vol, int axis, int index, struct image *img, unsigned char *buffer)
+{
+    static const int AXES[3][3] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}};
+    BrkHeader *h = &vol->header;
+    const unsigned char *src, *p;
+    unsigned char *dst, zero;
+    int dims[3], nb[3], lstride[3], bstride[3];
+    int ua, va, wa, B = h->brickSize, vs = h->voxelSize;
+    int bu, bv, lu, lv, nu, nv, v, count;
+    float scale;
+    long long offset;
+
+    count = brkSliceSize(vol, axis, &img->width, &img->height);
+    if (count < 0 || index < 0 || index >= count)
+        return -1;
+    img->pixel_data = buffer;
+
+    /* Columns run along ua, rows along va, wa is fixed */
+    ua = AXES[axis][0];
+    va = AXES[axis][1];
+    wa = AXES[axis][2];
+    dims[0] = h->nx;
+    dims[1] = h->ny;
+    dims[2] = h->nz;
+    nb[0] = h->bx;
+    nb[1] = h->by;
+    nb[2] = h->bz;
+    lstride[0] = vs;
+    lstride[1] = B * vs;
+    lstride[2] = B * B * vs;
+    bstride[0] = 1;
+    bstride[1] = h->bx;
+    bstride[2] = h->bx * h->by;
+
+    /* Window */
+    scale = h->windowHi > h->windowLo ? 255.0f / (h->windowHi - h->windowLo) : 0.0f;
+    zero = 0.0f <= h->windowLo ? 0 : 0.0f >= h->windowHi ? 255
+            : (unsigned char) (-h->windowLo * scale + 0.5f);
+
+    for (bv = 0; bv < nb[va]; bv++) {
+        nv = dims[va] - bv * B < B ? dims[va] - bv * B : B;
+        for (bu = 0; bu < nb[ua]; bu++) {
+            nu = dims[ua] - bu * B < B ? dims[ua] - bu * B : B;
+            offset = vol->index[(index / B) * bstride[wa] + bv * bstride[va] + bu * bstride[ua]];
+            src = offset ? vol->file.data + offset + (index % B) * lstride[wa] : NULL;
+            for (lv = 0; lv < nv; lv++) {
+                dst = buffer + (size_t) (bv * B + lv) * img->width + bu * B;
+                if (src == NULL) {
+                    memset(dst, zero, nu);
+                    continue;
+                }
+                p = src + lv * lstride[va];
+                if (vs == 1 && ua == 0) {
+                    memcpy(dst, p, nu);
+                } else if (vs == 1) {
+                    for (lu = 0; lu < nu; lu++, p += lstride[ua])
+                        dst[lu] = *p;
+                } else {
+                    for (lu = 0; lu < nu; lu++, p += lstride[ua]) {
+                        v = _brkVoxel(p, h->datatype);
+                        dst[lu] = v <= h->windowLo ? 0 : v >= h->windowHi ? 255
+                                : (unsigned char) ((v - h->windowLo) * scale + 0.5f);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* End of file -------------------------------------------------------------- */
@@ -0,0 +1,91 @@
+/**
+ * brick.h - This module contains the definition/implementation of functions
+ * to store volumes in a bricked on-disk layout and to cut slices out of it.
+ * <p>
+ * An axial-ordered volume is fast to read plane by plane along z only: a
+ * sagittal slice touches one cache line per pixel across the whole file.
+ * A bricked file splits the volume into cubes of brickSize^3 voxels, each
+ * one stored contiguously and page-aligned, so a plane of any orientation
+ * is gathered from the few bricks it crosses at near-sequential I/O cost.
+ * <p>
+ * File layout: a BrkHeader, the brick index (one 64-bit file offset per
+ * brick, z-major, 0 for bricks that are entirely zero and not stored) and
+ * the bricks themselves, voxels in host byte order with x varying fastest.
+ * <p>
+ * Functions that start with 'brk' are considered as brick-related functions.
+ */
+#ifndef _BRICK_H_
+#define _BRICK_H_
+
+#include "mmfile.h"
+#include "imageio.h"
+#include "nifti.h"
+
+/*
+ * Definitions
+ */
+#define BRK_MAGIC           "SRBRICK"
+#define BRK_VERSION         1
+#define BRK_BYTE_ORDER      0x01020304
+#define BRK_DEFAULT_SIZE    32
+#define BRK_ALIGNMENT       4096
+
+/* Slice orientations */
+#define BRK_AXIAL           0   /* z fixed, nx by ny image */
+#define BRK_CORONAL         1   /* y fixed, nx by nz image */
+#define BRK_SAGITTAL        2   /* x fixed, ny by nz image */
+
+/**
+ * On-disk header (fixed-size fields, writer's byte order).
+ */
+typedef struct
+{
+    char magic[8];
+    int version;
+    int byteOrder;
+    int nx, ny, nz;
+    int brickSize;
+    int bx, by, bz;
+    int datatype;
+    int voxelSize;
+    float pixdim[3];
+    float windowLo, windowHi;
+    int reserved[2];            /* keeps the index that follows 8-byte aligned */
+} BrkHeader;
+
+/**
+ * Mapped bricked volume.
+ */
+typedef struct
+{
+    /**
+     * The mapped file.
+     */
+    MmFile file;
+
+    /**
+     * Copy of the header.
+     */
+    BrkHeader header;
+
+    /**
+     * Brick index (points into the mapping).
+     */
+    const long long *index;
+
+} BrkVolume;
+
+/**
+ * Prototypes
+ */
+int brkWrite(NiiVolume *vol, const char *filename, int brickSize);
+
+int brkOpen(BrkVolume *vol, const char *filename);
+void brkClose(BrkVolume *vol);
+
+int brkSliceSize(BrkVolume *vol, int axis, int *width, int *height);
+int brkGetSlice(BrkVolume *vol, int axis, int index, struct image *img, unsigned char *buffer);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <ctype.h>
+#include <math.h>
 #ifdef _WIN32
 #include <windows.h>
 #include <GL/gl.h>
@@ -422,6 +423,57 @@ void cmrTurnAround(Camera *camera, int axis, float angle) {
     }
 }
 
+/*
+ * Calculates the planes of the view frustum of the camera, for the same
+ * parameters as gluPerspective. The normals point into the frustum, so
+ * m3dGetDistanceToPlane3f is positive for points on the inner side.
+ * @param camera The camera.
+ * @param fovy Vertical field of view (degrees).
+ * @param aspect Aspect ratio (width / height).
+ * @param zNear Distance to the near plane.
+ * @param zFar Distance to the far plane.
+ * @param planes Receives the planes, indexed by FRUSTUM_LEFT..FRUSTUM_FAR.
+ */
+void cmrGetFrustum(Camera *camera, float fovy, float aspect, float zNear, float zFar,
+        M3DVector4f planes[6]) {
+    M3DVector4f d;
+    M3DVector3f f, u, r, c, ntl, ntr, nbl, nbr, ftl, ftr, fbl, fbr;
+    float hn = zNear * (float) tan(m3dDegToRad(fovy) / 2.0), wn = hn * aspect;
+    float hf = zFar * (float) tan(m3dDegToRad(fovy) / 2.0), wf = hf * aspect;
+    int i;
+
+    /* Eye basis, as gluLookAt builds it */
+    m3dSubtractVectors3f(f, camera->target, camera->position);
+    m3dNormalizeVector3f(f);
+    m3dGetMatrixColumn44f(d, camera->basis, 1);
+    m3dLoadVector3f(u, m3dGetVectorX(d), m3dGetVectorY(d), m3dGetVectorZ(d));
+    m3dCrossProduct3f(r, f, u);
+    m3dNormalizeVector3f(r);
+    m3dCrossProduct3f(u, r, f);
+
+    /* Corners of the near and far rectangles */
+    for (i = 0; i < 3; i++) {
+        c[i] = camera->position[i] + f[i] * zNear;
+        ntl[i] = c[i] + u[i] * hn - r[i] * wn;
+        ntr[i] = c[i] + u[i] * hn + r[i] * wn;
+        nbl[i] = c[i] - u[i] * hn - r[i] * wn;
+        nbr[i] = c[i] - u[i] * hn + r[i] * wn;
+        c[i] = camera->position[i] + f[i] * zFar;
+        ftl[i] = c[i] + u[i] * hf - r[i] * wf;
+        ftr[i] = c[i] + u[i] * hf + r[i] * wf;
+        fbl[i] = c[i] - u[i] * hf - r[i] * wf;
+        fbr[i] = c[i] - u[i] * hf + r[i] * wf;
+    }
+
+    /* Planes (point order gives the inward normals) */
+    m3dGetPlaneEquation4f(planes[FRUSTUM_LEFT], nbl, ntl, fbl);
+    m3dGetPlaneEquation4f(planes[FRUSTUM_RIGHT], ntr, nbr, fbr);
+    m3dGetPlaneEquation4f(planes[FRUSTUM_BOTTOM], nbr, nbl, fbl);
+    m3dGetPlaneEquation4f(planes[FRUSTUM_TOP], ntl, ntr, ftr);
+    m3dGetPlaneEquation4f(planes[FRUSTUM_NEAR], ntl, nbl, ntr);
+    m3dGetPlaneEquation4f(planes[FRUSTUM_FAR], ftl, ftr, fbl);
+}
+
 /* End of file -------------------------------------------------------------- */
 
 
@@ -36,6 +36,14 @@
 #define TURN_AROUNDY_KEY	'Y'
 #define TURN_AROUNDZ_KEY	'Z'
 
+/* Frustum planes (see cmrGetFrustum) */
+#define FRUSTUM_LEFT		0
+#define FRUSTUM_RIGHT		1
+#define FRUSTUM_BOTTOM		2
+#define FRUSTUM_TOP			3
+#define FRUSTUM_NEAR		4
+#define FRUSTUM_FAR			5
+
 /*
  * Camera
  */
@@ -57,6 +65,8 @@ void cmrLookAt(Camera *camera);
 void cmrMove(Camera *camera, int axis, float distance);
 void cmrTurn(Camera *camera, int axis, float angle);
 void cmrTurnAround(Camera *camera, int axis, float angle);
+void cmrGetFrustum(Camera *camera, float fovy, float aspect, float zNear, float zFar,
+        M3DVector4f planes[6]);
 
 /* End of file -------------------------------------------------------------- */
 #endif
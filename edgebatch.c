@@ -0,0 +1,594 @@
+/**
+ * Headless batch edge detector.
+ *
+ * Runs decode/grayscale -> gaussian_noise_reduce -> canny_edge_detect ->
+ * write over a list of slices without opening a window. Every stage runs on
+ * its own thread(s) and the stages are chained through bounded queues (the
+ * writing is done by imageio's pgm_writer), so decoding and writing overlap
+ * with detection and memory use is capped by the queue depth.
+ *
+ * Mapped inputs are only read from disk when their pages are first touched,
+ * which would otherwise happen inside gaussian_noise_reduce on a worker. The
+ * decoder therefore acts as a prefetcher: it asks the OS to read the next
+ * -p slices/files ahead and faults zero-copy slices in itself, so the detect
+ * queue (the ring of -q decoded slices) only ever holds data that is
+ * already in memory. The report shows how much of that I/O was hidden.
+ *
+ * Usage: edgebatch [-j workers] [-q depth] [-p ahead] [-o outdir] [-a axis] input...
+ * Each input is a PGM/PPM file, a NIfTI-1 volume (*.nii), a bricked volume
+ * (*.brk, see volbrick) or a directory whose *.pgm, *.ppm, *.pnm, *.nii and
+ * *.brk files are processed in name order. Results are written as
+ * <outdir>/<name>_edges.pgm, or <outdir>/<name>_z<slice>_edges.pgm for the
+ * axial slices of a volume (<name>_t<time>_z<slice>_edges.pgm for 4D
+ * volumes). Bricked volumes are cut along the orientation given with -a
+ * (axial, coronal or sagittal; axial by default) and their slices are named
+ * <name>_<a|c|s><slice>_edges.pgm. At exit the throughput (slices/sec) and
+ * the per-stage latency percentiles are printed.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "imageio.h"
+#include "fast_edge.h"
+#include "bqueue.h"
+#include "nifti.h"
+#include "brick.h"
+#include "sysutil.h"
+
+/*
+ * Definitions
+ */
+#define DEFAULT_QUEUE_DEPTH 8
+
+/* Pipeline stages, in order */
+enum {
+    STAGE_DECODE = 0,
+    STAGE_GAUSS,
+    STAGE_CANNY,
+    STAGE_WRITE,
+    STAGE_COUNT
+};
+
+const char *STAGE_NAMES[STAGE_COUNT] = {"decode", "gauss", "canny", "write"};
+
+/*
+ * A NIfTI volume shared by the slices in flight (the mapping has to outlive
+ * the zero-copy views).
+ */
+typedef struct {
+    NiiVolume nii;
+    int refs;
+} Volume;
+
+/*
+ * A slice travelling through the pipeline.
+ */
+typedef struct {
+    char *output;
+    struct image img;           /* decoded 8-bit slice */
+    struct pnm_image pnm;       /* owner of img for PNM inputs */
+    Volume *volume;             /* owner of img for NIfTI inputs */
+    unsigned char *buffer;      /* conversion/gather buffer for volumes */
+    struct image out;
+    double seconds[STAGE_COUNT];
+    double submitted;           /* when out was handed to the writer */
+} Slice;
+
+/*
+ * Global variables
+ */
+
+/* Inputs */
+char **inputs;
+int inputCount;
+const char *outputDir = ".";
+int brickAxis = BRK_AXIAL;
+
+/* Read-ahead distance in slices/files (0 disables prefetching) */
+int prefetchDistance = -1;
+
+/* Queue between the decoder and the workers, write-behind thread after them */
+BQueue *detectQueue;
+struct pgm_writer *writer;
+
+/* Per-stage latencies of the written slices (owned by the writer thread) */
+double *latencies[STAGE_COUNT];
+int latencyCapacity;
+int sliceCount;
+int errorCount;
+
+/* I/O instrumentation: decoder busy time, worker time spent waiting for input */
+double decodeSeconds;
+double starvedSeconds;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Protoypes
+ */
+void addInput(const char *path);
+int compareNames(const void *a, const void *b);
+void addInputs(const char *path);
+void setOutputName(Slice *slice, const char *input, const char *suffix);
+void countError();
+void releaseVolume(Volume *volume);
+void releaseSlice(Slice *slice);
+int pushSlice(Slice *slice);
+void prefetchNiftiSlice(Volume *volume, int k, int load);
+void decodePnm(const char *input);
+void decodeNifti(const char *input);
+void decodeBricks(const char *input);
+void* decodeStage(void *arg);
+void* detectStage(void *arg);
+void sliceWritten(void *tag, int status);
+void printReport(double elapsed, int workerCount);
+
+/*
+ * Function definitions
+ */
+
+/*
+ * Appends a file to the input list.
+ * @param path File name.
+ */
+void addInput(const char *path) {
+    inputs = (char**) realloc(inputs, sizeof (char*) * (inputCount + 1));
+    inputs[inputCount] = (char*) malloc(strlen(path) + 1);
+    strcpy(inputs[inputCount++], path);
+}
+
+/*
+ * Compares two input names (qsort callback).
+ */
+int compareNames(const void *a, const void *b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/*
+ * Adds a file, or the PNM files of a directory in name order, to the
+ * input list.
+ * @param path File or directory name.
+ */
+void addInputs(const char *path) {
+    struct stat st;
+    struct dirent *entry;
+    DIR *dir;
+    const char *ext;
+    char *name;
+    int first = inputCount;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        addInput(path);
+        return;
+    }
+    if ((dir = opendir(path)) == NULL) {
+        fprintf(stderr, "error: couldn't read directory \"%s\"!\n", path);
+        countError();
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        ext = strrchr(entry->d_name, '.');
+        if (ext == NULL || (strcmp(ext, ".pgm") && strcmp(ext, ".ppm") && strcmp(ext, ".pnm")
+                && strcmp(ext, ".nii") && strcmp(ext, ".brk")))
+            continue;
+        name = (char*) malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(name, "%s/%s", path, entry->d_name);
+        addInput(name);
+        free(name);
+    }
+    closedir(dir);
+    qsort(inputs + first, inputCount - first, sizeof (char*), compareNames);
+}
+
+/*
+ * Derives <outdir>/<name><suffix>_edges.pgm from the input name.
+ * @param slice The slice.
+ * @param input Input file name.
+ * @param suffix Slice suffix ("" for 2D inputs).
+ */
+void setOutputName(Slice *slice, const char *input, const char *suffix) {
+    const char *base = strrchr(input, '/');
+    const char *ext;
+    size_t len;
+
+#ifdef _WIN32
+    if (strrchr(input, '\\') > base)
+        base = strrchr(input, '\\');
+#endif
+    base = base ? base + 1 : input;
+    ext = strrchr(base, '.');
+    len = ext ? (size_t) (ext - base) : strlen(base);
+    slice->output = (char*) malloc(strlen(outputDir) + len + strlen(suffix) + 12);
+    sprintf(slice->output, "%s/%.*s%s_edges.pgm", outputDir, (int) len, base, suffix);
+}
+
+/*
+ * Counts a failed slice (any thread).
+ */
+void countError() {
+    pthread_mutex_lock(&lock);
+    errorCount++;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Drops a reference to a volume, unmapping it with the last one.
+ * @param volume The volume.
+ */
+void releaseVolume(Volume *volume) {
+    int refs;
+
+    pthread_mutex_lock(&lock);
+    refs = --volume->refs;
+    pthread_mutex_unlock(&lock);
+    if (refs == 0) {
+        niiClose(&volume->nii);
+        free(volume);
+    }
+}
+
+/*
+ * Releases the decoded pixels of a slice.
+ * @param slice The slice.
+ */
+void releaseSlice(Slice *slice) {
+    if (slice->volume != NULL) {
+        releaseVolume(slice->volume);
+        slice->volume = NULL;
+    } else {
+        free_pnm_image(&slice->pnm);
+    }
+    free(slice->buffer);
+    slice->buffer = NULL;
+    slice->img.pixel_data = NULL;
+}
+
+/*
+ * Hands a decoded slice to the detect stage.
+ * @param slice The slice.
+ * @return 0 on success, -1 if the pipeline is shutting down.
+ */
+int pushSlice(Slice *slice) {
+    if (bqPush(detectQueue, slice) == 0)
+        return 0;
+    releaseSlice(slice);
+    free(slice->output);
+    free(slice);
+    return -1;
+}
+
+/*
+ * Decodes a PGM/PPM file into a single slice.
+ * @param input File name.
+ */
+void decodePnm(const char *input) {
+    Slice *slice = (Slice*) calloc(1, sizeof (Slice));
+    double t = sysNow();
+
+    if (read_pnm_image(input, &slice->pnm) != 0) {
+        countError();
+        free(slice);
+        return;
+    }
+    if (prefetchDistance > 0 && slice->pnm.mapped)
+        mmfLoad(&slice->pnm.file, slice->pnm.img.pixel_data - slice->pnm.file.data,
+                (size_t) slice->pnm.img.width * slice->pnm.img.height);
+    slice->seconds[STAGE_DECODE] = sysNow() - t;
+    decodeSeconds += slice->seconds[STAGE_DECODE];
+    slice->img = slice->pnm.img;
+    setOutputName(slice, input, "");
+    pushSlice(slice);
+}
+
+/*
+ * Prefetches (or, with load set, faults in) one axial slice of a volume.
+ * @param volume The volume.
+ * @param k Slice number counting through all time points (t * nz + z).
+ * @param load 1 to touch the pages on this thread, 0 for a read-ahead hint.
+ */
+void prefetchNiftiSlice(Volume *volume, int k, int load) {
+    NiiVolume *nii = &volume->nii;
+    const unsigned char *data = (const unsigned char*) niiSliceData(nii, k % nii->nz, k / nii->nz);
+    size_t size = (size_t) nii->nx * nii->ny * nii->voxelSize;
+
+    if (data == NULL)
+        return;
+    if (load)
+        mmfLoad(&nii->file, data - nii->file.data, size);
+    else
+        mmfPrefetch(&nii->file, data - nii->file.data, size);
+}
+
+/*
+ * Decodes every axial slice of a NIfTI volume.
+ * @param input File name.
+ */
+void decodeNifti(const char *input) {
+    Volume *volume = (Volume*) malloc(sizeof (Volume));
+    Slice *slice;
+    char suffix[32];
+    double t = sysNow();
+    int z, tp, k;
+
+    if (niiOpen(&volume->nii, input) != 0) {
+        countError();
+        free(volume);
+        return;
+    }
+    volume->refs = 1;
+    for (k = 0; k < prefetchDistance; k++)
+        prefetchNiftiSlice(volume, k, 0);
+    for (tp = 0; tp < volume->nii.nt; tp++) {
+        for (z = 0; z < volume->nii.nz; z++) {
+            if (prefetchDistance > 0) {
+                k = tp * volume->nii.nz + z;
+                prefetchNiftiSlice(volume, k + prefetchDistance, 0);
+                if (volume->nii.datatype == NII_UINT8)
+                    prefetchNiftiSlice(volume, k, 1);
+            }
+            slice = (Slice*) calloc(1, sizeof (Slice));
+            pthread_mutex_lock(&lock);
+            volume->refs++;
+            pthread_mutex_unlock(&lock);
+            slice->volume = volume;
+            if (volume->nii.datatype != NII_UINT8)
+                slice->buffer = (unsigned char*) malloc((size_t) volume->nii.nx * volume->nii.ny);
+            niiGetSlice(&volume->nii, z, tp, &slice->img, slice->buffer);
+            slice->seconds[STAGE_DECODE] = sysNow() - t;
+            decodeSeconds += slice->seconds[STAGE_DECODE];
+            if (volume->nii.nt > 1)
+                sprintf(suffix, "_t%02d_z%03d", tp, z);
+            else
+                sprintf(suffix, "_z%03d", z);
+            setOutputName(slice, input, suffix);
+            if (pushSlice(slice) != 0)
+                break;
+            t = sysNow();
+        }
+    }
+    releaseVolume(volume);
+}
+
+/*
+ * Gathers every slice of the chosen orientation out of a bricked volume.
+ * The slices are copied out of the bricks, so the volume is closed as soon
+ * as the last one has been queued.
+ * @param input File name.
+ */
+void decodeBricks(const char *input) {
+    BrkVolume volume;
+    Slice *slice;
+    char suffix[32];
+    double t = sysNow();
+    int i, count, w, h;
+
+    if (brkOpen(&volume, input) != 0) {
+        countError();
+        return;
+    }
+    count = brkSliceSize(&volume, brickAxis, &w, &h);
+    for (i = 0; i < count; i++) {
+        slice = (Slice*) calloc(1, sizeof (Slice));
+        slice->buffer = (unsigned char*) malloc((size_t) w * h);
+        brkGetSlice(&volume, brickAxis, i, &slice->img, slice->buffer);
+        slice->seconds[STAGE_DECODE] = sysNow() - t;
+        decodeSeconds += slice->seconds[STAGE_DECODE];
+        sprintf(suffix, "_%c%03d", "acs"[brickAxis], i);
+        setOutputName(slice, input, suffix);
+        if (pushSlice(slice) != 0)
+            break;
+        t = sysNow();
+    }
+    brkClose(&volume);
+}
+
+/*
+ * Decode stage: maps each input and converts it to 8-bit grayscale slices,
+ * keeping the next prefetchDistance files on their way into the page cache.
+ * Bricked slices are gathered (copied) here anyway, so they need no help.
+ */
+void* decodeStage(void *arg) {
+    const char *ext;
+    int i;
+
+    (void) arg;
+
+    for (i = 0; i < prefetchDistance && i < inputCount; i++)
+        mmfPrefetchFile(inputs[i]);
+    for (i = 0; i < inputCount; i++) {
+        if (prefetchDistance > 0 && i + prefetchDistance < inputCount)
+            mmfPrefetchFile(inputs[i + prefetchDistance]);
+        ext = strrchr(inputs[i], '.');
+        if (ext != NULL && !strcmp(ext, ".nii"))
+            decodeNifti(inputs[i]);
+        else if (ext != NULL && !strcmp(ext, ".brk"))
+            decodeBricks(inputs[i]);
+        else
+            decodePnm(inputs[i]);
+    }
+    bqClose(detectQueue);
+    return NULL;
+}
+
+/*
+ * Detect stage (one per worker): noise reduction and Canny edge detection.
+ */
+void* detectStage(void *arg) {
+    struct image gauss;
+    Slice *slice;
+    size_t size;
+    double t, starved = 0.0;
+
+    (void) arg;
+
+    for (;;) {
+        t = sysNow();
+        if ((slice = (Slice*) bqPop(detectQueue)) == NULL)
+            break;
+        starved += sysNow() - t;
+        size = (size_t) slice->img.width * slice->img.height;
+        gauss.pixel_data = (unsigned char*) calloc(size, 1);
+        slice->out.width = slice->img.width;
+        slice->out.height = slice->img.height;
+        slice->out.pixel_data = (unsigned char*) malloc(size);
+
+        t = sysNow();
+        gaussian_noise_reduce(&slice->img, &gauss);
+        slice->seconds[STAGE_GAUSS] = sysNow() - t;
+        releaseSlice(slice);
+
+        t = sysNow();
+        canny_edge_detect(&gauss, &slice->out);
+        slice->seconds[STAGE_CANNY] = sysNow() - t;
+        free(gauss.pixel_data);
+
+        slice->submitted = sysNow();
+        if (pgm_writer_submit(writer, &slice->out, slice->output, slice) != 0) {
+            countError();
+            free(slice->out.pixel_data);
+            free(slice->output);
+            free(slice);
+        }
+    }
+    pthread_mutex_lock(&lock);
+    starvedSeconds += starved;
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/*
+ * Write stage (called on the pgm_writer thread once an edge map is out):
+ * records the slice latencies. The write latency runs from the hand-over to
+ * the writer, so it includes the time spent queued behind other slices.
+ * @param tag The slice.
+ * @param status 0 if the edge map was written.
+ */
+void sliceWritten(void *tag, int status) {
+    Slice *slice = (Slice*) tag;
+    int s;
+
+    if (status != 0) {
+        countError();
+    } else {
+        slice->seconds[STAGE_WRITE] = sysNow() - slice->submitted;
+        if (sliceCount == latencyCapacity) {
+            latencyCapacity = latencyCapacity ? 2 * latencyCapacity : 256;
+            for (s = 0; s < STAGE_COUNT; s++)
+                latencies[s] = (double*) realloc(latencies[s], sizeof (double) * latencyCapacity);
+        }
+        for (s = 0; s < STAGE_COUNT; s++)
+            latencies[s][sliceCount] = slice->seconds[s];
+        sliceCount++;
+    }
+    free(slice->output);
+    free(slice);
+}
+
+/*
+ * Prints throughput, per-stage latency percentiles and how much of the
+ * decode/I/O time the workers did not have to wait for.
+ * @param elapsed Wall time of the whole run in seconds.
+ * @param workerCount Number of detect workers.
+ */
+void printReport(double elapsed, int workerCount) {
+    double *v, starved = starvedSeconds / workerCount;
+    int s;
+
+    printf("\n\nBatch Edge Detection\n");
+    printf("====================\n");
+    printf("Slices: %d (%d failed)\n", sliceCount, errorCount);
+    printf("Elapsed: %.3f s\n", elapsed);
+    printf("Throughput: %.2f slices/s\n", elapsed > 0 ? sliceCount / elapsed : 0.0);
+    if (sliceCount == 0)
+        return;
+    printf("%-8s %10s %10s %10s %10s\n", "stage", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (s = 0; s < STAGE_COUNT; s++) {
+        v = latencies[s];
+        qsort(v, sliceCount, sizeof (double), sysCompareDoubles);
+        printf("%-8s %10.3f %10.3f %10.3f %10.3f\n", STAGE_NAMES[s],
+                v[(sliceCount - 1) * 50 / 100] * 1e3, v[(sliceCount - 1) * 90 / 100] * 1e3,
+                v[(sliceCount - 1) * 99 / 100] * 1e3, v[sliceCount - 1] * 1e3);
+    }
+    printf("Prefetch: %d ahead\n", prefetchDistance);
+    printf("Decode/I/O: %.3f s on the decoder, %.3f s hidden behind detection\n",
+            decodeSeconds, decodeSeconds > starved ? decodeSeconds - starved : 0.0);
+    printf("Workers idle for input: %.3f s each (%.1f%% of elapsed)\n",
+            starved, elapsed > 0 ? 100.0 * starved / elapsed : 0.0);
+}
+
+/*
+ * Main function.
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ * @return Status code.
+ */
+int main(int argc, char **argv) {
+    pthread_t decoder, *workers;
+    int workerCount = sysProcessorCount();
+    int depth = DEFAULT_QUEUE_DEPTH;
+    double start;
+    int i, s;
+
+    /* Parse the command line */
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            prefetchDistance = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+            i++;
+            brickAxis = !strcmp(argv[i], "axial") ? BRK_AXIAL : !strcmp(argv[i], "coronal")
+                    ? BRK_CORONAL : !strcmp(argv[i], "sagittal") ? BRK_SAGITTAL : -1;
+        } else if (argv[i][0] == '-') {
+            break;
+        } else {
+            addInputs(argv[i]);
+        }
+    }
+    if (prefetchDistance < 0)
+        prefetchDistance = depth;
+    if (i < argc || inputCount == 0 || workerCount < 1 || depth < 1 || brickAxis < 0) {
+        fprintf(stderr, "usage: %s [-j workers] [-q depth] [-p ahead] [-o outdir] [-a axis] input...\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    detectQueue = bqCreate(depth);
+    writer = pgm_writer_create(depth, sliceWritten);
+    workers = (pthread_t*) malloc(sizeof (pthread_t) * workerCount);
+    if (detectQueue == NULL || writer == NULL || workers == NULL) {
+        fprintf(stderr, "error: couldn't start the pipeline!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Run the pipeline */
+    start = sysNow();
+    pthread_create(&decoder, NULL, decodeStage, NULL);
+    for (i = 0; i < workerCount; i++)
+        pthread_create(&workers[i], NULL, detectStage, NULL);
+
+    pthread_join(decoder, NULL);
+    for (i = 0; i < workerCount; i++)
+        pthread_join(workers[i], NULL);
+    pgm_writer_destroy(writer);
+
+    printReport(sysNow() - start, workerCount);
+
+    /* Clean up */
+    bqDestroy(&detectQueue);
+    free(workers);
+    for (s = 0; s < STAGE_COUNT; s++)
+        free(latencies[s]);
+    for (i = 0; i < inputCount; i++)
+        free(inputs[i]);
+    free(inputs);
+
+    return errorCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+/* End of file -------------------------------------------------------------- */
@@ -48,15 +48,14 @@ void canny_edge_detect(struct image * img_in, struct image * img_out) {
         struct image img_scratch;
         int high, low;
         #ifndef WIDTH
-        int * g = malloc(img_in->width * img_in->height * sizeof(int));
-        int * dir = malloc(img_in->width * img_in->height * sizeof(int));
+        int * g = calloc(img_in->width * img_in->height, sizeof(int));  // the Sobel pass leaves a 3 pixel border untouched
+        int * dir = calloc(img_in->width * img_in->height, sizeof(int));
         unsigned char * img_scratch_data = malloc(img_in->width * img_in->height * sizeof(char));
         #endif
         img_scratch.width = img_in->width;
         img_scratch.height = img_in->height;
         img_scratch.pixel_data = img_scratch_data;
         calc_gradient_sobel(img_in, g, dir);
-        printf("*** performing non-maximum suppression ***\n");
         non_max_suppression(&img_scratch, g, dir);
         estimate_threshold(&img_scratch, &high, &low);
         hysteresis(high, low, &img_scratch, img_out);
@@ -286,10 +285,11 @@ void non_max_suppression(struct image * img, int g[], int dir[]) {//float theta[
         int w, h, x, y, max_x, max_y;
         w = img->width;
         h = img->height;
-        max_x = w;
-        max_y = w * h;
-        for (y = 0; y < max_y; y += w) {
-                for (x = 0; x < max_x; x++) {
+        max_x = w - 1;
+        max_y = w * (h - 1);
+        memset(img->pixel_data, 0, w * h); // the outermost pixels have no neighbours to compare with
+        for (y = w; y < max_y; y += w) {
+                for (x = 1; x < max_x; x++) {
                         switch (dir[x + y]) {
                                 case 0:
                                         if (g[x + y] > g[x + y - w] && g[x + y] > g[x + y + w]) {
@@ -363,16 +363,22 @@ void estimate_threshold(struct image * img, int * high, int * low) {
         for (i = 0; i < max; i++) {
                 histogram[img->pixel_data[i]]++;
         }
+        if (histogram[0] == max) {
+                /* no edge pixels at all (a blank or uniform image): keep none */
+                *high = 255;
+                *low = 255;
+                return;
+        }
         pixels = (max - histogram[0]) * HIGH_THRESHOLD_PERCENTAGE;
         high_cutoff = 0;
         i = 255;
-        while (high_cutoff < pixels) {
+        while (high_cutoff < pixels && i > 0) {
                 high_cutoff += histogram[i];
                 i--;
         }
         *high = i;
         i = 1;
-        while (histogram[i] == 0) {
+        while (histogram[i] == 0 && i < 255) {
                 i++;
         }
         *low = (*high + i) * LOW_THRESHOLD_PERCENTAGE;
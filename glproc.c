@@ -0,0 +1,83 @@
+/**
+ * glproc.c - This module contains the definition/implementation of functions
+ * to look up the OpenGL entry points newer than 1.1 at run time.
+ * <p>
+ * opengl32.dll only exports OpenGL 1.1, so buffer objects and primitive
+ * restart have to be fetched from the driver once a context exists. The
+ * same lookup is used on every platform; a missing entry point (or a context
+ * that is too old) leaves the matching feature flag cleared and callers fall
+ * back to what 1.1 offers.
+ * <p>
+ * Functions that start with 'glp' are considered as GL procedure functions.
+ */
+#define _GLPROC_C_
+
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+#include "glproc.h"
+
+/*
+ * Global variables
+ */
+GlpProcs glp;
+
+/*
+ * Functions
+ */
+
+/**
+ * Looks up an OpenGL entry point of the current context.
+ * @param name Function name.
+ * @return The function, NULL if the driver doesn't have it.
+ */
+void* glpGetProcAddress(const char *name)
+{
+#ifdef _WIN32
+    void *p = (void*) wglGetProcAddress(name);
+
+    /* Some drivers return small error codes instead of NULL */
+    if (p == (void*) 1 || p == (void*) 2 || p == (void*) 3 || p == (void*) -1)
+        p = NULL;
+    return p;
+#else
+    return dlsym(RTLD_DEFAULT, name);
+#endif
+}
+
+/**
+ * Fetches the entry points and sets the feature flags.
+ * @pre A current OpenGL context.
+ */
+void glpInit()
+{
+    const char *version = (const char*) glGetString(GL_VERSION);
+    int major = 1, minor = 0;
+
+    memset(&glp, 0, sizeof (glp));
+    if (version != NULL)
+        sscanf(version, "%d.%d", &major, &minor);
+
+    if (major > 1 || minor >= 3) {
+        *(void**) &glp.activeTexture = glpGetProcAddress("glActiveTexture");
+        *(void**) &glp.clientActiveTexture = glpGetProcAddress("glClientActiveTexture");
+        glp.hasMultitexture = glp.activeTexture && glp.clientActiveTexture;
+    }
+    if (major > 1 || minor >= 5) {
+        *(void**) &glp.genBuffers = glpGetProcAddress("glGenBuffers");
+        *(void**) &glp.deleteBuffers = glpGetProcAddress("glDeleteBuffers");
+        *(void**) &glp.bindBuffer = glpGetProcAddress("glBindBuffer");
+        *(void**) &glp.bufferData = glpGetProcAddress("glBufferData");
+        *(void**) &glp.bufferSubData = glpGetProcAddress("glBufferSubData");
+        glp.hasBuffers = glp.genBuffers && glp.deleteBuffers && glp.bindBuffer
+                && glp.bufferData && glp.bufferSubData;
+    }
+    if (major > 3 || (major == 3 && minor >= 1)) {
+        *(void**) &glp.primitiveRestartIndex = glpGetProcAddress("glPrimitiveRestartIndex");
+        glp.hasPrimitiveRestart = glp.primitiveRestartIndex != NULL;
+    }
+}
+
+/* End of file -------------------------------------------------------------- */
@@ -0,0 +1,95 @@
+/**
+ * glproc.h - This module contains the definition/implementation of functions
+ * to look up the OpenGL entry points newer than 1.1 at run time.
+ * <p>
+ * opengl32.dll only exports OpenGL 1.1, so buffer objects and primitive
+ * restart have to be fetched from the driver once a context exists. The
+ * same lookup is used on every platform; a missing entry point (or a context
+ * that is too old) leaves the matching feature flag cleared and callers fall
+ * back to what 1.1 offers.
+ * <p>
+ * Functions that start with 'glp' are considered as GL procedure functions.
+ */
+#ifndef _GLPROC_H_
+#define _GLPROC_H_
+
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <GL/gl.h>
+#else
+#include <OpenGL/gl.h>
+#endif
+
+/*
+ * Definitions
+ */
+#ifdef _WIN32
+#define GLP_APIENTRY APIENTRY
+#else
+#define GLP_APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER             0x8892
+#define GL_ELEMENT_ARRAY_BUFFER     0x8893
+#define GL_STATIC_DRAW              0x88E4
+#define GL_DYNAMIC_DRAW             0x88E8
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0                 0x84C0
+#define GL_TEXTURE1                 0x84C1
+#endif
+#ifndef GL_PRIMITIVE_RESTART
+#define GL_PRIMITIVE_RESTART        0x8F9D
+#endif
+
+/**
+ * Entry points and the features they make available.
+ */
+typedef struct
+{
+    /**
+     * Multitexture (OpenGL 1.3).
+     */
+    void (GLP_APIENTRY *activeTexture)(GLenum texture);
+    void (GLP_APIENTRY *clientActiveTexture)(GLenum texture);
+
+    /**
+     * Buffer objects (OpenGL 1.5).
+     */
+    void (GLP_APIENTRY *genBuffers)(GLsizei n, GLuint *buffers);
+    void (GLP_APIENTRY *deleteBuffers)(GLsizei n, const GLuint *buffers);
+    void (GLP_APIENTRY *bindBuffer)(GLenum target, GLuint buffer);
+    void (GLP_APIENTRY *bufferData)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+    void (GLP_APIENTRY *bufferSubData)(GLenum target, ptrdiff_t offset, ptrdiff_t size,
+            const void *data);
+
+    /**
+     * Primitive restart (OpenGL 3.1).
+     */
+    void (GLP_APIENTRY *primitiveRestartIndex)(GLuint index);
+
+    /**
+     * Feature flags (1 if usable).
+     */
+    int hasMultitexture;
+    int hasBuffers;
+    int hasPrimitiveRestart;
+
+} GlpProcs;
+
+/**
+ * Global variables
+ */
+extern GlpProcs glp;
+
+/**
+ * Prototypes
+ */
+void glpInit();
+void* glpGetProcAddress(const char *name);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
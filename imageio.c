@@ -27,21 +27,192 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
 
 #include "imageio.h"
+#include "bqueue.h"
 
 void write_pgm_image(struct image * img) 
 {
+        write_pgm_file(img, "fast_canny_output.pgm");
+}
+
+/*
+        WRITE_PGM_FILE
+        writes an 8-bit binary PGM; the header and the pixel block go out in a single writev (one fwrite per part on Windows)
+        returns 0 on success, -1 on error (reported on stderr)
+*/
+int write_pgm_file(struct image * img, const char *filename)
+{
+        char hdr[64];
+        size_t size = (size_t) img->width * img->height;
+        int hdr_len = sprintf(hdr, "P5\n#FAST-EDGE\n%d %d\n255\n", img->width, img->height);
+        #ifdef _WIN32
         FILE *fp_out;
-        int i = 0;
-        if((fp_out =fopen("fast_canny_output.pgm","w"))== 0)
-                printf("Error opening output file.");
-        fprintf(fp_out, "P5\n#FAST-EDGE\n%d %d\n255\n", img->width, img->height);
-        for(i = 0; i < (img->height * img->width); i++)
-                fputc(img->pixel_data[i], fp_out);
-        fclose(fp_out);
+        if ((fp_out = fopen(filename, "wb")) == NULL) {
+                fprintf(stderr, "error: couldn't open \"%s\" for writing!\n", filename);
+                return(-1);
+        }
+        if (fwrite(hdr, 1, hdr_len, fp_out) != (size_t) hdr_len || fwrite(img->pixel_data, 1, size, fp_out) != size) {
+                fprintf(stderr, "error: couldn't write \"%s\"!\n", filename);
+                fclose(fp_out);
+                return(-1);
+        }
+        if (fclose(fp_out) != 0) {
+                fprintf(stderr, "error: couldn't write \"%s\"!\n", filename);
+                return(-1);
+        }
+        #else
+        struct iovec iov[2];
+        ssize_t n;
+        int fd, i = 0;
+        if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                fprintf(stderr, "error: couldn't open \"%s\" for writing: %s\n", filename, strerror(errno));
+                return(-1);
+        }
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = hdr_len;
+        iov[1].iov_base = img->pixel_data;
+        iov[1].iov_len = size;
+        while (i < 2) {
+                n = writev(fd, iov + i, 2 - i);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        fprintf(stderr, "error: couldn't write \"%s\": %s\n", filename, strerror(errno));
+                        close(fd);
+                        return(-1);
+                }
+                /* short write - skip what went out and retry with the rest */
+                while (i < 2 && (size_t) n >= iov[i].iov_len) {
+                        n -= iov[i].iov_len;
+                        i++;
+                }
+                if (i < 2) {
+                        iov[i].iov_base = (char *) iov[i].iov_base + n;
+                        iov[i].iov_len -= n;
+                }
+        }
+        if (close(fd) != 0) {
+                fprintf(stderr, "error: couldn't write \"%s\": %s\n", filename, strerror(errno));
+                return(-1);
+        }
+        #endif
+        return(0);
+}
+
+/*
+        PGM WRITE-BEHIND
+        a single background thread drains a bounded queue of finished images so that output I/O
+        overlaps with detection of the next slice; submitting blocks while the queue is full
+*/
+struct pgm_job {
+        struct image img;
+        char *filename;
+        void *tag;
+};
+
+struct pgm_writer {
+        BQueue *queue;
+        pthread_t thread;
+        pgm_written_fn written;
+        int errors;
+};
+
+static void *pgm_writer_run(void *arg)
+{
+        struct pgm_writer *writer = arg;
+        struct pgm_job *job;
+        int status;
+        while ((job = bqPop(writer->queue)) != NULL) {
+                status = write_pgm_file(&job->img, job->filename);
+                if (status != 0) {
+                        writer->errors++;
+                }
+                if (writer->written != NULL) {
+                        writer->written(job->tag, status);
+                }
+                free(job->img.pixel_data);
+                free(job->filename);
+                free(job);
+        }
+        return(NULL);
+}
+
+/*
+        PGM_WRITER_CREATE
+        starts the write-behind thread; depth is the number of images that may be queued
+        written (may be NULL) is told the outcome of every image, with the tag it was submitted with
+*/
+struct pgm_writer * pgm_writer_create(int depth, pgm_written_fn written)
+{
+        struct pgm_writer *writer = malloc(sizeof(struct pgm_writer));
+        if (writer == NULL) {
+                return(NULL);
+        }
+        writer->written = written;
+        writer->errors = 0;
+        if ((writer->queue = bqCreate(depth)) == NULL) {
+                free(writer);
+                return(NULL);
+        }
+        if (pthread_create(&writer->thread, NULL, pgm_writer_run, writer) != 0) {
+                bqDestroy(&writer->queue);
+                free(writer);
+                return(NULL);
+        }
+        return(writer);
+}
+
+/*
+        PGM_WRITER_SUBMIT
+        queues img for writing to filename; the writer takes ownership of img->pixel_data (released with free)
+        returns 0 on success, -1 on error, in which case the caller keeps the pixel data
+*/
+int pgm_writer_submit(struct pgm_writer *writer, struct image * img, const char *filename, void *tag)
+{
+        struct pgm_job *job = malloc(sizeof(struct pgm_job));
+        if (job == NULL) {
+                return(-1);
+        }
+        job->img = *img;
+        job->tag = tag;
+        if ((job->filename = malloc(strlen(filename) + 1)) == NULL) {
+                free(job);
+                return(-1);
+        }
+        strcpy(job->filename, filename);
+        if (bqPush(writer->queue, job) != 0) {
+                free(job->filename);
+                free(job);
+                return(-1);
+        }
+        return(0);
+}
+
+/*
+        PGM_WRITER_DESTROY
+        flushes the queue, stops the thread and returns the number of images that failed to write
+*/
+int pgm_writer_destroy(struct pgm_writer *writer)
+{
+        int errors;
+        bqClose(writer->queue);
+        pthread_join(writer->thread, NULL);
+        errors = writer->errors;
+        bqDestroy(&writer->queue);
+        free(writer);
+        return(errors);
 }
 
 int read_pgm_hdr(FILE *fp, int *w, int *h)
@@ -63,3 +234,149 @@ int skipcomment(FILE *fp)
         }
         return(ungetc(i, fp));
 }
+
+/*
+        PNM_NUMBER
+        skips whitespace and comments in a mapped PNM header, then parses an unsigned decimal number
+*/
+static int pnm_number(const unsigned char *buf, size_t len, size_t *pos, int *value)
+{
+        long v = 0;
+        size_t start;
+        while (*pos < len && (isspace(buf[*pos]) || buf[*pos] == '#')) {
+                if (buf[*pos] == '#') {
+                        while (*pos < len && buf[*pos] != '\n')
+                                (*pos)++;
+                } else {
+                        (*pos)++;
+                }
+        }
+        start = *pos;
+        while (*pos < len && isdigit(buf[*pos]) && v <= 0xFFFFFF) {
+                v = v * 10 + (buf[*pos] - '0');
+                (*pos)++;
+        }
+        if (*pos == start || v > 0xFFFFFF) {
+                return(-1);
+        }
+        *value = (int) v;
+        return(0);
+}
+
+static int pnm_fail(const char *filename, struct pnm_image *pnm)
+{
+        fprintf(stderr, "error: \"%s\" is not a valid P2/P5/P6 file!\n", filename);
+        free(pnm->img.pixel_data);
+        pnm->img.pixel_data = NULL;
+        mmfClose(&pnm->file);
+        return(-1);
+}
+
+/*
+        READ_PNM_IMAGE
+        loads a P2 (ASCII), P5 (binary gray) or P6 (binary RGB) file with 8- or 16-bit samples into an 8-bit grayscale image
+        the file is memory-mapped; binary gray files with maxval 255 are returned as a view into the mapping (no copy),
+        everything else is converted into a malloc'd buffer and the mapping is released immediately
+        the pixel data of a mapped image is read-only
+        returns 0 on success, -1 on error
+*/
+int read_pnm_image(const char *filename, struct pnm_image *pnm)
+{
+        const unsigned char *buf, *data;
+        unsigned char lut[256];
+        unsigned char *out;
+        size_t len, pos, n, npix, channels, sample_size;
+        int w, h, maxval, c, v[3], half;
+
+        pnm->img.width = pnm->img.height = 0;
+        pnm->img.pixel_data = NULL;
+        pnm->maxval = 0;
+        pnm->mapped = 0;
+        if (mmfOpen(&pnm->file, filename) != 0) {
+                return(-1);
+        }
+        buf = pnm->file.data;
+        len = pnm->file.size;
+        pos = 2;
+        if (len < 2 || buf[0] != 'P' || (buf[1] != '2' && buf[1] != '5' && buf[1] != '6') ||
+                        pnm_number(buf, len, &pos, &w) || pnm_number(buf, len, &pos, &h) || pnm_number(buf, len, &pos, &maxval) ||
+                        w <= 0 || h <= 0 || maxval <= 0 || maxval > 65535 || pos >= len || !isspace(buf[pos])) {
+                return(pnm_fail(filename, pnm));
+        }
+        pos++; // exactly one whitespace character separates the header from the raster
+        pnm->img.width = w;
+        pnm->img.height = h;
+        pnm->maxval = maxval;
+        npix = (size_t) w * h;
+        channels = buf[1] == '6' ? 3 : 1;
+        sample_size = maxval > 255 ? 2 : 1;
+        if (buf[1] != '2' && len - pos < npix * channels * sample_size) {
+                return(pnm_fail(filename, pnm));
+        }
+        data = buf + pos;
+
+        /* zero-copy: the raster already is what the detector expects */
+        if (buf[1] == '5' && maxval == 255) {
+                pnm->img.pixel_data = (unsigned char *) data;
+                pnm->mapped = 1;
+                return(0);
+        }
+
+        if ((out = malloc(npix)) == NULL) {
+                return(pnm_fail(filename, pnm));
+        }
+        pnm->img.pixel_data = out;
+        half = maxval / 2;
+        for (n = 0; n < 256; n++) {
+                lut[n] = n > (size_t) maxval ? 255 : (n * 255 + half) / maxval;
+        }
+        if (buf[1] == '2') {
+                for (n = 0; n < npix; n++) {
+                        if (pnm_number(buf, len, &pos, &v[0]) || v[0] > maxval) {
+                                return(pnm_fail(filename, pnm));
+                        }
+                        out[n] = (v[0] * 255 + half) / maxval;
+                }
+        } else if (sample_size == 1) {
+                if (channels == 1) {
+                        for (n = 0; n < npix; n++) {
+                                out[n] = lut[data[n]];
+                        }
+                } else {
+                        for (n = 0; n < npix; n++, data += 3) {
+                                out[n] = lut[(77 * data[0] + 151 * data[1] + 28 * data[2]) >> 8];
+                        }
+                }
+        } else {
+                /* 16-bit samples are stored most significant byte first */
+                for (n = 0; n < npix; n++) {
+                        for (c = 0; c < (int) channels; c++, data += 2) {
+                                v[c] = (data[0] << 8) | data[1];
+                                if (v[c] > maxval) {
+                                        v[c] = maxval;
+                                }
+                        }
+                        if (channels == 3) {
+                                v[0] = (77 * v[0] + 151 * v[1] + 28 * v[2]) >> 8;
+                        }
+                        out[n] = ((unsigned) v[0] * 255 + half) / maxval;
+                }
+        }
+        mmfClose(&pnm->file);
+        return(0);
+}
+
+/*
+        FREE_PNM_IMAGE
+        releases the mapping or the converted pixel buffer of an image loaded with read_pnm_image
+*/
+void free_pnm_image(struct pnm_image *pnm)
+{
+        if (pnm->mapped) {
+                mmfClose(&pnm->file);
+        } else {
+                free(pnm->img.pixel_data);
+        }
+        pnm->img.pixel_data = NULL;
+        pnm->mapped = 0;
+}
@@ -27,14 +27,42 @@
 #ifndef _IMAGEIO
 #define _IMAGEIO
 
+#include <stdio.h>
+#include "mmfile.h"
+
 struct image {
         int width;
         int height;
         unsigned char * pixel_data;
 };
 
+/*
+        8-bit grayscale image loaded from a PGM/PPM file
+        img.pixel_data points straight into the file mapping when the file already holds
+        8-bit (maxval 255) grayscale binary data, otherwise it is a malloc'd converted copy
+*/
+struct pnm_image {
+        struct image img;
+        int maxval;             // maxval from the file header
+        int mapped;             // 1 if img.pixel_data points into file
+        MmFile file;
+};
+
+struct pgm_writer;
+
+/*
+        called on the writer thread once an image has been written (status 0) or has failed to write (-1)
+*/
+typedef void (*pgm_written_fn)(void *tag, int status);
+
 void write_pgm_image(struct image * img);
+int write_pgm_file(struct image * img, const char *filename);
+struct pgm_writer * pgm_writer_create(int depth, pgm_written_fn written);
+int pgm_writer_submit(struct pgm_writer *writer, struct image * img, const char *filename, void *tag);
+int pgm_writer_destroy(struct pgm_writer *writer);
 int read_pgm_hdr(FILE *fp, int *w, int *h);
 int skipcomment(FILE *fp);
+int read_pnm_image(const char *filename, struct pnm_image *pnm);
+void free_pnm_image(struct pnm_image *pnm);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,600 @@
+/**
+ * lod.c - This module contains the definition/implementation of functions
+ * to draw a height field grid at a level of detail that follows the view
+ * (chunked geomipmapping).
+ * <p>
+ * The grid is cut into chunks of chunkSize x chunkSize quads. Level l of a
+ * chunk uses every 2^l-th vertex of the full-resolution grid (plus the
+ * chunk's last row and column), so all levels share one vertex buffer and
+ * only the triangle list changes. For each chunk the bounds and the
+ * vertical error of every level are precomputed; the chunks hang under a
+ * quadtree whose nodes hold the union of their children's bounds. Each
+ * frame the coarsest level whose error projects to at most a few pixels is
+ * chosen per chunk, neighbours are kept within one level of each other, and
+ * the coarser chunk of each such pair splits its border edges at the
+ * midpoints the finer one uses, so there are no cracks. Chunks whose bounds
+ * are outside the view frustum are left out.
+ * <p>
+ * Functions that start with 'lod' are considered as level-of-detail
+ * functions.
+ */
+#define _LOD_C_
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lod.h"
+
+/*
+ * Local definitions
+ */
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+/*
+ * Offsets of the vertices of a level along a chunk side of n quads: every
+ * step-th one, and the last one.
+ * @return Number of offsets.
+ */
+static int _lodPoints(int n, int step, int *points)
+{
+    int i, count = 0;
+
+    for (i = 0; i < n; i += step)
+        points[count++] = i;
+    points[count++] = n;
+    return count;
+}
+
+/*
+ * Builds the quadtree over the chunks [cx0, cx1) x [cy0, cy1).
+ * @return Index of the node.
+ */
+static int _lodBuildNode(LodTerrain *terrain, int cx0, int cy0, int cx1, int cy1)
+{
+    int node = terrain->nodeCount++;
+    int mx = (cx0 + cx1 + 1) / 2, my = (cy0 + cy1 + 1) / 2;
+    int k = 0;
+
+    terrain->nodes[node].chunk = -1;
+    terrain->nodes[node].child[0] = terrain->nodes[node].child[1] = -1;
+    terrain->nodes[node].child[2] = terrain->nodes[node].child[3] = -1;
+    if (cx1 - cx0 == 1 && cy1 - cy0 == 1) {
+        terrain->nodes[node].chunk = cy0 * terrain->chunksX + cx0;
+        return node;
+    }
+
+    /* Quadrants (the empty ones of odd or thin blocks are skipped) */
+    if (mx > cx0 && my > cy0)
+        terrain->nodes[node].child[k++] = _lodBuildNode(terrain, cx0, cy0, mx, my);
+    if (cx1 > mx && my > cy0)
+        terrain->nodes[node].child[k++] = _lodBuildNode(terrain, mx, cy0, cx1, my);
+    if (mx > cx0 && cy1 > my)
+        terrain->nodes[node].child[k++] = _lodBuildNode(terrain, cx0, my, mx, cy1);
+    if (cx1 > mx && cy1 > my)
+        terrain->nodes[node].child[k++] = _lodBuildNode(terrain, mx, my, cx1, cy1);
+    return node;
+}
+
+/*
+ * Bounds and errors of a chunk, from the full-resolution positions.
+ */
+static void _lodChunkUpdate(LodTerrain *terrain, LodChunk *chunk, LodNode *leaf,
+        const float *x, const float *y, const float *z)
+{
+    int rows[LOD_MAX_CHUNK + 1], cols[LOD_MAX_CHUNK + 1];
+    int fineRows[LOD_MAX_CHUNK + 1], fineCols[LOD_MAX_CHUNK + 1];
+    int nr, nc, nfr, nfc, fr, fc, a, b, i, j, r, c, l, k, step;
+    const float *h;
+    float u, v, du, dv, e, err, hTL, hTR, hBL, hBR, x0, x1, y0, y1, z0, z1;
+
+    /* Bounds */
+    k = chunk->row0 * terrain->width + chunk->col0;
+    x0 = x1 = x[k];
+    y0 = y1 = y[k];
+    z0 = z1 = z[k];
+    for (r = 0; r <= chunk->rows; r++) {
+        for (c = 0; c <= chunk->cols; c++) {
+            k = (chunk->row0 + r) * terrain->width + chunk->col0 + c;
+            x0 = x[k] < x0 ? x[k] : x0;
+            x1 = x[k] > x1 ? x[k] : x1;
+            y0 = y[k] < y0 ? y[k] : y0;
+            y1 = y[k] > y1 ? y[k] : y1;
+            z0 = z[k] < z0 ? z[k] : z0;
+            z1 = z[k] > z1 ? z[k] : z1;
+        }
+    }
+    leaf->min[0] = x0;
+    leaf->max[0] = x1;
+    leaf->min[1] = y0;
+    leaf->max[1] = y1;
+    leaf->min[2] = z0;
+    leaf->max[2] = z1;
+
+    /* Errors: how far level l is from level l - 1 at the vertices of
+     * l - 1 (planar interpolation over the (TL, BL, TR) or (TR, BL, BR)
+     * triangle of the coarse cell), accumulated over the levels. That bounds
+     * the distance from the full grid and reads each level's vertices only
+     * once (a cell takes its bottom and right sides only at the chunk's
+     * border; elsewhere the next cell has the same values there). */
+    h = y + chunk->row0 * terrain->width + chunk->col0;
+    chunk->error[0] = 0.0f;
+    for (l = 1; l < terrain->levels; l++) {
+        step = 1 << l;
+        nr = _lodPoints(chunk->rows, step, rows);
+        nc = _lodPoints(chunk->cols, step, cols);
+        nfr = _lodPoints(chunk->rows, step / 2, fineRows);
+        nfc = _lodPoints(chunk->cols, step / 2, fineCols);
+        err = 0.0f;
+        for (a = 0, fr = 0; a + 1 < nr; a++) {
+            while (fineRows[fr] < rows[a])
+                fr++;
+            for (b = 0, fc = 0; b + 1 < nc; b++) {
+                while (fineCols[fc] < cols[b])
+                    fc++;
+                hTL = h[rows[a] * terrain->width + cols[b]];
+                hTR = h[rows[a] * terrain->width + cols[b + 1]];
+                hBL = h[rows[a + 1] * terrain->width + cols[b]];
+                hBR = h[rows[a + 1] * terrain->width + cols[b + 1]];
+                du = 1.0f / (cols[b + 1] - cols[b]);
+                dv = 1.0f / (rows[a + 1] - rows[a]);
+                for (i = fr; i < nfr && (fineRows[i] < rows[a + 1] || a + 2 == nr); i++) {
+                    r = fineRows[i];
+                    v = (r - rows[a]) * dv;
+                    for (j = fc; j < nfc && (fineCols[j] < cols[b + 1] || b + 2 == nc); j++) {
+                        c = fineCols[j];
+                        u = (c - cols[b]) * du;
+                        if (u + v <= 1.0f)
+                            e = hTL + u * (hTR - hTL) + v * (hBL - hTL);
+                        else
+                            e = hBR + (1.0f - u) * (hBL - hBR) + (1.0f - v) * (hTR - hBR);
+                        e = fabsf(h[r * terrain->width + c] - e);
+                        if (e > err)
+                            err = e;
+                    }
+                }
+            }
+        }
+        chunk->error[l] = chunk->error[l - 1] + err;
+    }
+    leaf->error = chunk->error[terrain->levels - 1];
+}
+
+/*
+ * Union of the children's bounds and errors (post-order).
+ */
+static void _lodNodeUpdate(LodTerrain *terrain, LodNode *node)
+{
+    LodNode *child;
+    int i, k;
+
+    if (node->chunk >= 0)
+        return;
+    for (i = 0; i < 4 && node->child[i] >= 0; i++) {
+        child = &terrain->nodes[node->child[i]];
+        _lodNodeUpdate(terrain, child);
+        for (k = 0; k < 3; k++) {
+            if (i == 0 || child->min[k] < node->min[k])
+                node->min[k] = child->min[k];
+            if (i == 0 || child->max[k] > node->max[k])
+                node->max[k] = child->max[k];
+        }
+        if (i == 0 || child->error > node->error)
+            node->error = child->error;
+    }
+}
+
+/*
+ * Distance from the eye to the scaled bounds of a node (0 inside).
+ */
+static float _lodDistance(const LodNode *node, const float eye[3], const float scale[3])
+{
+    float d, sum = 0.0f;
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        d = node->min[k] * scale[k] - eye[k];
+        if (d < 0.0f)
+            d = eye[k] - node->max[k] * scale[k];
+        if (d > 0.0f)
+            sum += d * d;
+    }
+    return sqrtf(sum);
+}
+
+/*
+ * Classifies the scaled bounds of a node against the frustum planes.
+ * @return -1 if outside a plane, 1 if inside all of them, 0 otherwise.
+ */
+static int _lodClassify(const LodNode *node, const float scale[3], const float *planes)
+{
+    const float *p;
+    float lo, hi, dMin, dMax;
+    int i, k, result = 1;
+
+    for (i = 0; i < 6; i++) {
+        p = planes + 4 * i;
+        dMin = dMax = p[3];
+        for (k = 0; k < 3; k++) {
+            lo = node->min[k] * scale[k] * p[k];
+            hi = node->max[k] * scale[k] * p[k];
+            dMin += lo < hi ? lo : hi;
+            dMax += lo < hi ? hi : lo;
+        }
+        if (dMax < 0.0f)
+            return -1;
+        if (dMin < 0.0f)
+            result = 0;
+    }
+    return result;
+}
+
+/*
+ * Gives a node's chunks the coarsest level whose error, scaled by
+ * pixelScale / distance, stays within maxError pixels. Below a node that is
+ * far enough for the coarsest level of all its chunks, the chunks' own
+ * errors are not tested; below a node inside the frustum (planes is NULL
+ * then) neither are their bounds, and below one outside it they are culled.
+ */
+static void _lodSelectNode(LodTerrain *terrain, int index, const float eye[3],
+        const float scale[3], const float *planes, float pixelScale, float maxError,
+        int coarsest, int visible)
+{
+    LodNode *node = &terrain->nodes[index];
+    float limit = maxError * _lodDistance(node, eye, scale) / (pixelScale * scale[1]);
+    LodChunk *chunk;
+    int i;
+
+    if (node->error <= limit)
+        coarsest = 1;
+    if (visible && planes != NULL) {
+        switch (_lodClassify(node, scale, planes)) {
+            case -1:
+                visible = 0;
+                break;
+            case 1:
+                planes = NULL;
+        }
+    }
+    if (node->chunk >= 0) {
+        chunk = &terrain->chunks[node->chunk];
+        chunk->visible = visible;
+        chunk->level = terrain->levels - 1;
+        if (!coarsest)
+            while (chunk->level > 0 && chunk->error[chunk->level] > limit)
+                chunk->level--;
+        return;
+    }
+    for (i = 0; i < 4 && node->child[i] >= 0; i++)
+        _lodSelectNode(terrain, node->child[i], eye, scale, planes, pixelScale, maxError,
+                coarsest, visible);
+}
+
+/*
+ * Appends an index to the list, growing it as needed.
+ */
+static void _lodPush(LodTerrain *terrain, unsigned int index)
+{
+    if (terrain->indexCount == terrain->indexCapacity) {
+        terrain->indexCapacity = terrain->indexCapacity ? 2 * terrain->indexCapacity : 4096;
+        terrain->indices = (unsigned int*) realloc(terrain->indices,
+                sizeof (unsigned int) * terrain->indexCapacity);
+    }
+    terrain->indices[terrain->indexCount++] = index;
+}
+
+/*
+ * Appends a triangle given as (row, column) pairs of the chunk. It is
+ * wound like the (TL, BL, TR) triangles of the full grid, so that the
+ * front faces stay the same at every level.
+ */
+static void _lodTriangle(LodTerrain *terrain, const LodChunk *chunk,
+        int r0, int c0, int r1, int c1, int r2, int c2)
+{
+    int cross = (c1 - c0) * (r2 - r0) - (r1 - r0) * (c2 - c0);
+    int base = chunk->row0 * terrain->width + chunk->col0;
+
+    if (cross == 0)
+        return;
+    _lodPush(terrain, base + r0 * terrain->width + c0);
+    if (cross < 0) {
+        _lodPush(terrain, base + r1 * terrain->width + c1);
+        _lodPush(terrain, base + r2 * terrain->width + c2);
+    } else {
+        _lodPush(terrain, base + r2 * terrain->width + c2);
+        _lodPush(terrain, base + r1 * terrain->width + c1);
+    }
+}
+
+/*
+ * Offsets of the finer level strictly inside (lo, hi), plus hi.
+ * @return Number of offsets written after out[0] = lo.
+ */
+static int _lodSide(const int *fine, int count, int lo, int hi, int *out)
+{
+    int i, n = 0;
+
+    out[n++] = lo;
+    for (i = 0; i < count; i++)
+        if (fine[i] > lo && fine[i] < hi)
+            out[n++] = fine[i];
+    out[n++] = hi;
+    return n;
+}
+
+/*
+ * Triangulates the chunks at their selected levels, splitting the sides
+ * that border a finer chunk at the finer chunk's vertices.
+ */
+static void _lodTriangulate(LodTerrain *terrain)
+{
+    int rows[LOD_MAX_CHUNK + 1], cols[LOD_MAX_CHUNK + 1];
+    int fineRows[LOD_MAX_CHUNK + 1], fineCols[LOD_MAX_CHUNK + 1];
+    int top[LOD_MAX_CHUNK + 1], bottom[LOD_MAX_CHUNK + 1];
+    int left[LOD_MAX_CHUNK + 1], right[LOD_MAX_CHUNK + 1];
+    int nr, nc, nfr = 0, nfc = 0, nt, nb, nl, nq, a, b, i, j, k;
+    int r0, r1, c0, c1, rc, cc;
+    LodChunk *chunk;
+
+    terrain->indexCount = 0;
+    for (k = 0; k < terrain->chunksX * terrain->chunksY; k++) {
+        chunk = &terrain->chunks[k];
+        if (!chunk->visible) {
+            chunk->drawnLevel = -2;
+            continue;
+        }
+        nr = _lodPoints(chunk->rows, 1 << chunk->level, rows);
+        nc = _lodPoints(chunk->cols, 1 << chunk->level, cols);
+        if (chunk->mask) {
+            nfr = _lodPoints(chunk->rows, 1 << (chunk->level - 1), fineRows);
+            nfc = _lodPoints(chunk->cols, 1 << (chunk->level - 1), fineCols);
+        }
+
+        for (a = 0; a + 1 < nr; a++) {
+            for (b = 0; b + 1 < nc; b++) {
+                r0 = rows[a];
+                r1 = rows[a + 1];
+                c0 = cols[b];
+                c1 = cols[b + 1];
+
+                /* Vertices along each side of the cell */
+                nt = (a == 0 && (chunk->mask & LOD_NORTH))
+                        ? _lodSide(fineCols, nfc, c0, c1, top) : _lodSide(cols, 0, c0, c1, top);
+                nb = (a + 2 == nr && (chunk->mask & LOD_SOUTH))
+                        ? _lodSide(fineCols, nfc, c0, c1, bottom) : _lodSide(cols, 0, c0, c1, bottom);
+                nl = (b == 0 && (chunk->mask & LOD_WEST))
+                        ? _lodSide(fineRows, nfr, r0, r1, left) : _lodSide(rows, 0, r0, r1, left);
+                nq = (b + 2 == nc && (chunk->mask & LOD_EAST))
+                        ? _lodSide(fineRows, nfr, r0, r1, right) : _lodSide(rows, 0, r0, r1, right);
+
+                if (nt == 2 && nb == 2 && nl == 2 && nq == 2) {
+                    /* Plain cell: the two triangles of the full grid */
+                    _lodTriangle(terrain, chunk, r0, c0, r1, c0, r0, c1);
+                    _lodTriangle(terrain, chunk, r0, c1, r1, c0, r1, c1);
+                } else if (nl == 2 && nq == 2) {
+                    /* Split top/bottom only: zip the two rows */
+                    for (i = j = 0; i + 1 < nt || j + 1 < nb;) {
+                        if (i + 1 < nt && (j + 1 == nb || top[i + 1] <= bottom[j + 1])) {
+                            _lodTriangle(terrain, chunk, r0, top[i], r1, bottom[j], r0, top[i + 1]);
+                            i++;
+                        } else {
+                            _lodTriangle(terrain, chunk, r0, top[i], r1, bottom[j], r1, bottom[j + 1]);
+                            j++;
+                        }
+                    }
+                } else if (nt == 2 && nb == 2) {
+                    /* Split left/right only: zip the two columns */
+                    for (i = j = 0; i + 1 < nl || j + 1 < nq;) {
+                        if (i + 1 < nl && (j + 1 == nq || left[i + 1] <= right[j + 1])) {
+                            _lodTriangle(terrain, chunk, left[i], c0, right[j], c1, left[i + 1], c0);
+                            i++;
+                        } else {
+                            _lodTriangle(terrain, chunk, left[i], c0, right[j], c1, right[j + 1], c1);
+                            j++;
+                        }
+                    }
+                } else {
+                    /* Corner cell: fan around the centre (both sides are
+                     * split, so the cell is at least 2 x 2 quads) */
+                    rc = (r0 + r1) / 2;
+                    cc = (c0 + c1) / 2;
+                    for (i = 0; i + 1 < nt; i++)
+                        _lodTriangle(terrain, chunk, rc, cc, r0, top[i], r0, top[i + 1]);
+                    for (i = 0; i + 1 < nb; i++)
+                        _lodTriangle(terrain, chunk, rc, cc, r1, bottom[i], r1, bottom[i + 1]);
+                    for (i = 0; i + 1 < nl; i++)
+                        _lodTriangle(terrain, chunk, rc, cc, left[i], c0, left[i + 1], c0);
+                    for (i = 0; i + 1 < nq; i++)
+                        _lodTriangle(terrain, chunk, rc, cc, right[i], c1, right[i + 1], c1);
+                }
+            }
+        }
+        chunk->drawnLevel = chunk->level;
+        chunk->drawnMask = chunk->mask;
+    }
+    terrain->triangleCount = terrain->indexCount / 3;
+}
+
+/*
+ * Functions
+ */
+
+/**
+ * Creates the chunks and the quadtree of a grid. Bounds and errors are
+ * undefined until lodUpdate is called.
+ * @pre Valid terrain structure (non-null), width and height >= 2.
+ * @param terrain Reference to the structure that receives the terrain.
+ * @param width Number of vertex columns of the grid.
+ * @param height Number of vertex rows of the grid.
+ * @param chunkSize Chunk side in quads (a power of 2, at most LOD_MAX_CHUNK).
+ */
+void lodCreate(LodTerrain *terrain, int width, int height, int chunkSize)
+{
+    LodChunk *chunk;
+    int i, j;
+
+    memset(terrain, 0, sizeof (LodTerrain));
+    terrain->width = width;
+    terrain->height = height;
+    terrain->chunkSize = chunkSize;
+    for (terrain->levels = 1; (1 << terrain->levels) <= chunkSize
+            && terrain->levels < LOD_MAX_LEVELS; terrain->levels++);
+
+    /* Chunks (the last row/column may be narrower) */
+    terrain->chunksX = (width - 1 + chunkSize - 1) / chunkSize;
+    terrain->chunksY = (height - 1 + chunkSize - 1) / chunkSize;
+    terrain->chunks = (LodChunk*) calloc(terrain->chunksX * terrain->chunksY, sizeof (LodChunk));
+    for (i = 0; i < terrain->chunksY; i++) {
+        for (j = 0; j < terrain->chunksX; j++) {
+            chunk = &terrain->chunks[i * terrain->chunksX + j];
+            chunk->row0 = i * chunkSize;
+            chunk->col0 = j * chunkSize;
+            chunk->rows = height - 1 - chunk->row0 < chunkSize ? height - 1 - chunk->row0 : chunkSize;
+            chunk->cols = width - 1 - chunk->col0 < chunkSize ? width - 1 - chunk->col0 : chunkSize;
+            chunk->visible = 1;
+            chunk->drawnLevel = -1;
+        }
+    }
+
+    /* Quadtree (fewer than 2 nodes per chunk) */
+    terrain->nodes = (LodNode*) malloc(sizeof (LodNode) * 2 * terrain->chunksX * terrain->chunksY);
+    _lodBuildNode(terrain, 0, 0, terrain->chunksX, terrain->chunksY);
+}
+
+/**
+ * Frees the chunks, the quadtree and the index list.
+ * @param terrain Reference to the terrain.
+ */
+void lodDestroy(LodTerrain *terrain)
+{
+    free(terrain->chunks);
+    free(terrain->nodes);
+    free(terrain->indices);
+    memset(terrain, 0, sizeof (LodTerrain));
+}
+
+/**
+ * Recalculates the bounds and level errors after the grid has changed. The
+ * next lodSelect rebuilds the index list.
+ * @pre Terrain created with lodCreate.
+ * @param terrain Reference to the terrain.
+ * @param x Vertex x coordinates (height rows of width, row major).
+ * @param y Vertex heights.
+ * @param z Vertex z coordinates.
+ */
+void lodUpdate(LodTerrain *terrain, const float *x, const float *y, const float *z)
+{
+    LodNode *node;
+    int i;
+
+    for (i = 0; i < terrain->nodeCount; i++) {
+        node = &terrain->nodes[i];
+        if (node->chunk >= 0) {
+            _lodChunkUpdate(terrain, &terrain->chunks[node->chunk], node, x, y, z);
+            terrain->chunks[node->chunk].drawnLevel = -1;
+        }
+    }
+    _lodNodeUpdate(terrain, &terrain->nodes[0]);
+}
+
+/**
+ * Restores the bounds and level errors saved from a terrain of the same
+ * size and chunk size (see lodUpdate), instead of recalculating them.
+ * @pre Terrain created with lodCreate.
+ * @param terrain Reference to the terrain.
+ * @param chunks Copy of the chunks (chunksX x chunksY of them).
+ * @param nodes Copy of the quadtree (nodeCount nodes).
+ */
+void lodLoad(LodTerrain *terrain, const LodChunk *chunks, const LodNode *nodes)
+{
+    int i;
+
+    memcpy(terrain->chunks, chunks, sizeof (LodChunk) * terrain->chunksX * terrain->chunksY);
+    memcpy(terrain->nodes, nodes, sizeof (LodNode) * terrain->nodeCount);
+    for (i = 0; i < terrain->chunksX * terrain->chunksY; i++) {
+        terrain->chunks[i].visible = 1;
+        terrain->chunks[i].drawnLevel = -1;
+    }
+}
+
+/**
+ * Selects the level of every chunk for a view and rebuilds the triangle
+ * list (GL_TRIANGLES) if the selection changed.
+ * @pre Terrain updated with lodUpdate.
+ * @param terrain Reference to the terrain.
+ * @param eye Eye position in world coordinates.
+ * @param scale Scaling from the grid coordinates to world coordinates.
+ * @param planes Frustum planes (six times a, b, c, d, with the normals
+ * pointing inwards) in world coordinates, NULL to draw every chunk.
+ * @param pixelScale Pixels covered by one world unit at distance 1
+ * (viewport height / (2 tan(fovy / 2))).
+ * @param maxError Largest allowed screen-space error in pixels.
+ * @return 1 if the triangle list changed, 0 otherwise.
+ */
+int lodSelect(LodTerrain *terrain, const float eye[3], const float scale[3],
+        const float *planes, float pixelScale, float maxError)
+{
+    LodChunk *chunk;
+    int i, j, n, changed, limit;
+
+    _lodSelectNode(terrain, 0, eye, scale, planes, pixelScale, maxError, 0, 1);
+
+    /* Keep neighbours within one level: refine the coarser one. Culled
+     * chunks take part too, so the levels don't depend on the view
+     * direction; a seam next to one is outside the frustum anyway. */
+    do {
+        changed = 0;
+        for (i = 0; i < terrain->chunksY; i++) {
+            for (j = 0; j < terrain->chunksX; j++) {
+                chunk = &terrain->chunks[i * terrain->chunksX + j];
+                limit = chunk->level;
+                if (i > 0)
+                    limit = min(limit, chunk[-terrain->chunksX].level + 1);
+                if (i + 1 < terrain->chunksY)
+                    limit = min(limit, chunk[terrain->chunksX].level + 1);
+                if (j > 0)
+                    limit = min(limit, chunk[-1].level + 1);
+                if (j + 1 < terrain->chunksX)
+                    limit = min(limit, chunk[1].level + 1);
+                if (limit < chunk->level) {
+                    chunk->level = limit;
+                    changed = 1;
+                }
+            }
+        }
+    } while (changed);
+
+    /* Stitch masks */
+    n = terrain->chunksX;
+    for (i = 0; i < terrain->chunksY; i++) {
+        for (j = 0; j < n; j++) {
+            chunk = &terrain->chunks[i * n + j];
+            chunk->mask = 0;
+            if (i > 0 && chunk[-n].level < chunk->level)
+                chunk->mask |= LOD_NORTH;
+            if (i + 1 < terrain->chunksY && chunk[n].level < chunk->level)
+                chunk->mask |= LOD_SOUTH;
+            if (j > 0 && chunk[-1].level < chunk->level)
+                chunk->mask |= LOD_WEST;
+            if (j + 1 < n && chunk[1].level < chunk->level)
+                chunk->mask |= LOD_EAST;
+            if (chunk->visible ? chunk->level != chunk->drawnLevel || chunk->mask != chunk->drawnMask
+                    : chunk->drawnLevel != -2)
+                changed = 1;
+        }
+    }
+
+    if (changed)
+        _lodTriangulate(terrain);
+    terrain->chunkCount = terrain->culledCount = 0;
+    for (i = 0; i < terrain->chunksX * terrain->chunksY; i++) {
+        if (terrain->chunks[i].visible)
+            terrain->chunkCount++;
+        else
+            terrain->culledCount++;
+    }
+    return changed;
+}
+
+/* End of file -------------------------------------------------------------- */
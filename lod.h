@@ -0,0 +1,155 @@
+/**
+ * lod.h - This module contains the definition/implementation of functions
+ * to draw a height field grid at a level of detail that follows the view
+ * (chunked geomipmapping).
+ * <p>
+ * The grid is cut into chunks of chunkSize x chunkSize quads. Level l of a
+ * chunk uses every 2^l-th vertex of the full-resolution grid (plus the
+ * chunk's last row and column), so all levels share one vertex buffer and
+ * only the triangle list changes. For each
+ * chunk the bounds and the vertical error of every level are precomputed;
+ * the chunks hang under a quadtree whose nodes hold the union of their
+ * children's bounds. Each frame the coarsest level whose error projects to
+ * at most a few pixels is chosen per chunk, neighbours are kept within one
+ * level of each other, and the coarser chunk of each such pair splits its
+ * border edges at the midpoints the finer one uses, so there are no cracks.
+ * Chunks whose bounds are outside the view frustum are left out.
+ * <p>
+ * Functions that start with 'lod' are considered as level-of-detail
+ * functions.
+ */
+#ifndef _LOD_H_
+#define _LOD_H_
+
+/*
+ * Definitions
+ */
+#define LOD_MAX_LEVELS      8
+#define LOD_MAX_CHUNK       (1 << (LOD_MAX_LEVELS - 1))
+#define LOD_DEFAULT_CHUNK   64
+#define LOD_DEFAULT_ERROR   2.0f    /* pixels */
+
+/* Chunk sides (bits of the stitch mask) */
+#define LOD_NORTH           1   /* first row */
+#define LOD_SOUTH           2   /* last row */
+#define LOD_WEST            4   /* first column */
+#define LOD_EAST            8   /* last column */
+
+/**
+ * A chunk of the grid.
+ */
+typedef struct
+{
+    /**
+     * First vertex row/column and size in quads.
+     */
+    int row0, col0, rows, cols;
+
+
+    /**
+     * Largest height deviation of each level from the full grid.
+     */
+    float error[LOD_MAX_LEVELS];
+
+    /**
+     * Level and stitch mask (sides with a finer neighbour) of the current
+     * selection.
+     */
+    int level, mask;
+
+    /**
+     * 0 if the chunk is outside the view frustum.
+     */
+    int visible;
+
+    /**
+     * Level and mask the index list was built with (-1: none yet, -2: not
+     * drawn).
+     */
+    int drawnLevel, drawnMask;
+
+} LodChunk;
+
+/**
+ * A quadtree node: the bounds of a block of chunks.
+ */
+typedef struct
+{
+    /**
+     * Axis-aligned bounding box (model coordinates).
+     */
+    float min[3], max[3];
+
+    /**
+     * Largest error of the coarsest level in the subtree.
+     */
+    float error;
+
+    /**
+     * Children (-1 where there is none); all -1 for a leaf.
+     */
+    int child[4];
+
+    /**
+     * Chunk of a leaf, -1 for inner nodes.
+     */
+    int chunk;
+
+} LodNode;
+
+/**
+ * Chunked level-of-detail terrain.
+ */
+typedef struct
+{
+    /**
+     * Grid size in vertices, and chunk side in quads (a power of 2).
+     */
+    int width, height, chunkSize;
+
+    /**
+     * Number of levels (the coarsest one steps chunkSize vertices).
+     */
+    int levels;
+
+    /**
+     * The chunks (chunksX x chunksY, row major).
+     */
+    LodChunk *chunks;
+    int chunksX, chunksY;
+
+    /**
+     * The quadtree (node 0 is the root).
+     */
+    LodNode *nodes;
+    int nodeCount;
+
+    /**
+     * Triangle list of the current selection (vertex indices into the
+     * row-major grid).
+     */
+    unsigned int *indices;
+    int indexCount, indexCapacity;
+
+    /**
+     * Statistics of the last selection: triangles, chunks drawn and chunks
+     * culled.
+     */
+    int triangleCount, chunkCount, culledCount;
+
+} LodTerrain;
+
+/**
+ * Prototypes
+ */
+void lodCreate(LodTerrain *terrain, int width, int height, int chunkSize);
+void lodDestroy(LodTerrain *terrain);
+
+void lodUpdate(LodTerrain *terrain, const float *x, const float *y, const float *z);
+void lodLoad(LodTerrain *terrain, const LodChunk *chunks, const LodNode *nodes);
+int lodSelect(LodTerrain *terrain, const float eye[3], const float scale[3],
+        const float *planes, float pixelScale, float maxError);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
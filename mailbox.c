@@ -0,0 +1,58 @@
+/**
+ * mailbox.c - This module contains the definition/implementation of functions
+ * to hand results from one thread to another through a single-slot mailbox.
+ * <p>
+ * The mailbox is one slot holding the latest message (any pointer) or
+ * nothing. It only ever keeps the newest result: posting puts a message in
+ * the slot and hands back the one it replaces, if the consumer hadn't taken
+ * it yet, so the poster can free or reuse it. Taking empties the slot. Each
+ * side is a single atomic exchange, without a lock, so neither ever waits
+ * and the consumer can poll from an event loop.
+ * <p>
+ * Functions that start with 'mbx' are considered as mailbox functions.
+ */
+#define _MAILBOX_C_
+
+#include <stddef.h>
+#include "mailbox.h"
+
+/*
+ * Functions
+ */
+
+/**
+ * Initializes an empty mailbox.
+ * @param box Reference to the mailbox.
+ */
+void mbxInit(Mailbox *box)
+{
+    __atomic_store_n(&box->item, NULL, __ATOMIC_RELEASE);
+}
+
+/**
+ * Posts a message. Everything written to the message before is visible to
+ * the thread that takes it.
+ * @param box Reference to the mailbox.
+ * @param data The message (non-null).
+ * @return The message it replaced (back to the caller), NULL if the
+ * mailbox was empty.
+ */
+void* mbxPost(Mailbox *box, void *data)
+{
+    return __atomic_exchange_n(&box->item, data, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Takes the waiting message, if any.
+ * @param box Reference to the mailbox.
+ * @return The message (now owned by the caller), NULL if there is none.
+ */
+void* mbxTake(Mailbox *box)
+{
+    /* Cheap check first: polling an empty box doesn't dirty the line */
+    if (__atomic_load_n(&box->item, __ATOMIC_RELAXED) == NULL)
+        return NULL;
+    return __atomic_exchange_n(&box->item, NULL, __ATOMIC_ACQ_REL);
+}
+
+/* End of file -------------------------------------------------------------- */
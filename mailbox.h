@@ -0,0 +1,43 @@
+/**
+ * mailbox.h - This module contains the definition/implementation of functions
+ * to hand results from one thread to another through a single-slot mailbox.
+ * <p>
+ * The mailbox is one slot holding the latest message (any pointer) or
+ * nothing. It only ever keeps the newest result: posting puts a message in
+ * the slot and hands back the one it replaces, if the consumer hadn't taken
+ * it yet, so the poster can free or reuse it. Taking empties the slot. Each
+ * side is a single atomic exchange, without a lock, so neither ever waits
+ * and the consumer can poll from an event loop.
+ * <p>
+ * Functions that start with 'mbx' are considered as mailbox functions.
+ */
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+
+/*
+ * Definitions
+ */
+
+/**
+ * Single-slot mailbox.
+ */
+typedef struct
+{
+    /**
+     * The message waiting to be taken, NULL if there is none.
+     */
+    void *volatile item;
+
+} Mailbox;
+
+/**
+ * Prototypes
+ */
+void mbxInit(Mailbox *box);
+
+void* mbxPost(Mailbox *box, void *data);
+void* mbxTake(Mailbox *box);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
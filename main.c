@@ -7,12 +7,17 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
 #ifdef _WIN32
 #include <windows.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/glut.h>
 #else
+#include <unistd.h>
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
 #include <Glut/glut.h>
@@ -20,14 +25,61 @@
 #include "camera.h"
 #include "tgaMagic.h"
 #include "map.h"
+#include "tilemap.h"
+#include "glproc.h"
+#include "lod.h"
+#include "offscreen.h"
+#include "modelcache.h"
 #include "alg.h"
+#include "pick.h"
+#include "sysutil.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
  * Definitions
  */
 #ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
-#define MAP_SIZE 512 // Size Of Our .RAW Height Map ( NEW )
+#define VIEW_TILES 3 /* The model covers VIEW_TILES x VIEW_TILES map tiles */
+#define VERTEX_ALIGNMENT 64 /* Cache line */
+#define VERTEX(i, j) (vertices[(i) * viewWidth + (j)])
+#define MAX_NORMAL_THREADS 16
+#define DEFAULT_HEIGHT_FACTOR 5 /* Heights are drawn at 1/300 at this factor */
+#define RESTART_INDEX 0xFFFFFFFFu
+#define CACHE_SUFFIX ".cache" /* Model cache next to the map file */
+#define PICK_GRID_X 64 /* Rays through the window in the benchmark report */
+#define PICK_GRID_Y 48
+
+/*
+ * Vertex of the model, laid out as GL_T2F_N3F_V3F (32 bytes).
+ */
+typedef struct {
+    GLfloat texCoord[2];
+    GLfloat normal[3];
+    GLfloat position[3];
+} Vertex;
+
+/*
+ * A band of rows handled by one thread of a model pass.
+ */
+typedef struct {
+    int first, last;
+} Band;
+
+/*
+ * Camera commands of benchmark scripts
+ */
+enum {
+    BENCH_MOVE = 0,
+    BENCH_TURN,
+    BENCH_AROUND
+};
 
 /* 
  * Menu options
@@ -35,6 +87,7 @@
 enum {
     MENU_AMBIENT_LIGHT = 1,
     MENU_EDGE_DETECT,
+    MENU_EDGE_OVERLAY,
     MENU_EXIT
 };
 
@@ -44,6 +97,7 @@ enum {
 const int WINDOW_WIDTH = 1024;
 const int WINDOW_HEIGHT = 768;
 const GLfloat BASIC_ANGLE = 5.0f;
+const GLdouble FIELD_OF_VIEW = 45.0;
 
 /*
  * Global variables
@@ -51,10 +105,17 @@ const GLfloat BASIC_ANGLE = 5.0f;
 
 /* Scaling factors */
 int DISTANCE_FACTOR = 10;
-int HEIGHT_FACTOR = 5;
+int HEIGHT_FACTOR = DEFAULT_HEIGHT_FACTOR;
+
+/* The factors the vertices were built with; changes since then are applied
+ * as a scaling of the modelview matrix */
+int modelDistanceFactor, modelHeightFactor;
 
-/* Aspect ratio of the window */
+/* Aspect ratio and height of the window, and depth range of the
+ * projection */
 GLdouble aspectRatio;
+int windowHeight = 1;
+GLdouble zNear = 1.0, zFar;
 
 
 /* Basic dimension */
@@ -63,24 +124,77 @@ int BASIC_DIMENSION;
 /* The world size */
 int WORLD_SIZE;
 
-/* The map */
-int* mapData;
-int ** mapArray;
-int mapWidth = MAP_SIZE;
-int mapHeight = MAP_SIZE;
+/* The texture */
+const char *textureFile = "knee.tga";
 
-/* The actual model */
-GLfloat **X, **Y, **Z; /* Vertices */
-GLfloat **Nx, **Ny, **Nz; /* Normals */
-GLfloat **Tx, **Ty, **Tz; /* Normals */
+/* The map */
+const char *mapFile = "Test.int.raw";
+int mapFormat = MAP_INT32 | MAP_BIG_ENDIAN;
+TileMap theMap;
+int mapWidth;
+int mapHeight;
+
+/* The window of the map that is modelled (around the camera) */
+int viewX0 = -1, viewY0 = -1;
+int viewWidth, viewHeight;
+
+/* The actual model (viewHeight x viewWidth vertices, row major) */
+Vertex *vertices;
+
+/* Triangle strips over the model, one per row, separated by RESTART_INDEX */
+GLuint *indices;
+int indexCount;
+
+/* GL copies of vertices/indices (0 without buffer objects), and whether the
+ * vertex buffer is out of date */
+GLuint vertexBuffer, indexBuffer;
+int modelDirty = 1;
+
+/* Chunked level of detail over the model, its GL index list (0 without
+ * buffer objects), and whether it is used instead of the full grid */
+LodTerrain theTerrain;
+GLuint lodBuffer;
+int useLod = 1;
+
+/* Scratch for the normal passes (SoA): vertex positions, and the normals of
+ * the two triangles of every quad surrounded by a border of zero normals */
+GLfloat *posX, *posY, *posZ;
+GLfloat *faceX[2], *faceY[2], *faceZ[2];
+int faceStride;
+int normalThreads = 1;
+
+/* 1 for central-difference normals, 0 for triangle-averaged normals */
+int gradientNormals = 0;
+
+/* Min/max height pyramid over the model, for picking */
+PckPyramid thePicker;
 
 /* The camera */
 Camera theCamera;
 
+/* Draw calls and triangles submitted by paintModel (reset by the caller) */
+int drawCalls, drawnTriangles;
+
+/* Startup: the loader threads (map and model, texture) that run while the
+ * window is created, the decoded texture, and the start time and the time
+ * each step was done (0 once the first frame is out) */
+pthread_t modelLoader, textureLoader;
+int loading = 0;
+gl_texture_t *theTexture;
+double startTime, modelTime, textureTime, windowTime;
+
 /* Texture values */
 GLuint textureID;
 /* texture id for example */
 GLuint texId = 0;
+
+/* Luminance of the texture (what edges are detected in), the edge overlay
+ * texture, whether it holds an edge map yet and whether it is shown */
+unsigned char *textureLuminance;
+int textureWidth, textureHeight;
+GLuint edgeTexId = 0;
+int hasEdges = 0;
+int showEdges = 0;
 GLubyte *image;
 
 /*
@@ -90,65 +204,169 @@ void RenderScene();
 void SetupRC();
 void ChangeSize(GLsizei w, GLsizei h);
 void KeyPressedStd(unsigned char key, int x, int y);
+void MousePressed(int button, int state, int x, int y);
 int BuildPopupMenu();
 void SelectFromMenu(int id);
+void Idle();
+void drawModel(const char *indexBase);
 void paintModel();
 void initialize();
 void finalize();
+void* modelLoaderMain(void *arg);
+void* textureLoaderMain(void *arg);
+void startLoading();
+void finishLoading();
 void setPerspectiveProjection(GLdouble aspectRatio);
 void resetCamera(Camera *camera);
 void calcModelCoordinates();
-void addNormal(M3DVector3f n, int r, int c);
-GLfloat** createMatrix(int m, int n);
-void destroyMatrix(GLfloat **A, int m);
+void updatePicker();
+int pickRay(int x, int y, GLfloat origin[3], GLfloat direction[3]);
+unsigned long long modelCacheKey();
+void loadModel();
+int updateView();
+void runBands(void* (*pass)(void*), int rows);
+void* faceNormalBand(void *arg);
+void* vertexNormalBand(void *arg);
+void setGradientNormal(GLfloat *n, GLfloat gx, GLfloat gz);
+void* gradientNormalBand(void *arg);
+Vertex* createVertices(int m, int n);
+void destroyVertices(Vertex *V);
+void createIndices();
+void uploadModel();
+void selectLod();
+void drawScene();
+int parseAxis(const char *name);
+void writeFrame(const char *filename, int width, int height);
+int runBenchmark(const char *script, const char *dumpDir);
 
 /*
  * Function definitions
  */
 
 /**
- * Creates a m by n matrix.
+ * Creates a zeroed m by n grid of vertices in one cache-line aligned block.
  * @pre Number of rows is positive (m>0).
  * @pre Number of columns is positive (n>0).
- * @param m Number of rows in the matrix.
- * @param n Number of columns in the matrix.
- * @return Reference to the matrix.
+ * @param m Number of rows in the grid.
+ * @param n Number of columns in the grid.
+ * @return Reference to the vertices (NULL if out of memory).
  */
-GLfloat** createMatrix(int m, int n) {
-    GLfloat **A;
-    int i;
+Vertex* createVertices(int m, int n) {
+    size_t size = sizeof (Vertex) * m * n;
+    Vertex *V;
 
-    /* Allocate the memory for the matrix */
-    A = (GLfloat**) calloc(m, sizeof (GLfloat*));
-    for (i = 0; i < m; i++) {
-        A[i] = (GLfloat*) calloc(n, sizeof (GLfloat));
-    }
+    /* Allocate the memory for the grid */
+#ifdef _WIN32
+    V = (Vertex*) _aligned_malloc(size, VERTEX_ALIGNMENT);
+#else
+    if (posix_memalign((void**) &V, VERTEX_ALIGNMENT, size) != 0)
+        V = NULL;
+#endif
+    if (V != NULL)
+        memset(V, 0, size);
 
-    return A;
+    return V;
 }
 
 /**
- * Destroys a matrix. Note: It's not necessary to reset the original
- * pointer to NULL.
- * @pre Valid matrix (non-null).
- * @param m Number of rows in the matrix.
- * @param A Reference to the matrix.
+ * Destroys a grid of vertices. Note: It's not necessary to reset the
+ * original pointer to NULL.
+ * @param V Reference to the vertices (may be NULL).
  */
-void destroyMatrix(GLfloat **A, int m) {
-    int i;
+void destroyVertices(Vertex *V) {
+#ifdef _WIN32
+    _aligned_free(V);
+#else
+    free(V);
+#endif
+}
+
+/**
+ * Builds the strip indices of the model: for each row of quads, the
+ * vertices of rows i and i + 1 alternately, then RESTART_INDEX.
+ */
+void createIndices() {
+    GLuint *p;
+    int i, j;
+
+    indexCount = (viewHeight - 1) * (2 * viewWidth + 1);
+    p = indices = (GLuint*) malloc(sizeof (GLuint) * indexCount);
+    for (i = 0; i < viewHeight - 1; i++) {
+        for (j = 0; j < viewWidth; j++) {
+            *p++ = i * viewWidth + j;
+            *p++ = (i + 1) * viewWidth + j;
+        }
+        *p++ = RESTART_INDEX;
+    }
+}
 
-    /* Deallocate the memory of the matrix */
-    for (i = 0; i < m; i++) {
-        free(A[i]);
+/**
+ * Brings the GL copy of the model up to date. Buffer objects are created
+ * on first use (a context is needed) and the vertex buffer is re-uploaded
+ * only after calcModelCoordinates has changed the vertices.
+ */
+void uploadModel() {
+    size_t size = sizeof (Vertex) * viewWidth * viewHeight;
+
+    if (!glp.hasBuffers)
+        return;
+    if (vertexBuffer == 0) {
+        glp.genBuffers(1, &vertexBuffer);
+        glp.genBuffers(1, &indexBuffer);
+        glp.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glp.bufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+        glp.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glp.bufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof (GLuint) * indexCount, indices,
+                GL_STATIC_DRAW);
+        glp.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    } else if (modelDirty) {
+        glp.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glp.bufferSubData(GL_ARRAY_BUFFER, 0, size, vertices);
+    }
+    glp.bindBuffer(GL_ARRAY_BUFFER, 0);
+    modelDirty = 0;
+}
+
+/**
+ * Chooses the chunk levels for the current camera and window, leaving out
+ * the chunks outside the view frustum, and re-uploads the triangle list
+ * when the choice changed. Leaves the LOD index buffer bound (if there is
+ * one).
+ */
+void selectLod() {
+    M3DVector4f planes[6];
+    GLfloat scale[3];
+    int changed;
+
+    scale[0] = scale[2] = (GLfloat) DISTANCE_FACTOR / modelDistanceFactor;
+    scale[1] = (GLfloat) HEIGHT_FACTOR / modelHeightFactor;
+    cmrGetFrustum(&theCamera, FIELD_OF_VIEW, aspectRatio, zNear, zFar, planes);
+    changed = lodSelect(&theTerrain, theCamera.position, scale, planes[0],
+            windowHeight / (2.0f * (GLfloat) tan(m3dDegToRad(FIELD_OF_VIEW) / 2.0)),
+            LOD_DEFAULT_ERROR);
+    if (!glp.hasBuffers)
+        return;
+    if (lodBuffer == 0) {
+        glp.genBuffers(1, &lodBuffer);
+        changed = 1;
     }
-    free(A);
+    glp.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, lodBuffer);
+    if (changed)
+        glp.bufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof (GLuint) * theTerrain.indexCount,
+            theTerrain.indices, GL_DYNAMIC_DRAW);
 }
 
 /* 
- * This function runs the texture loading portion of the program
- * @param the filename of the texture to be applied to the map
+ * This function runs the texture loading portion of the program: it waits
+ * for the loader threads and hands their texture to the GL.
  */
-void init(const char *filename) {
+void init() {
+    /* Wait for the map, the model and the texture */
+    windowTime = sysNow() - startTime;
+    finishLoading();
+    printf("Startup: map and model %.1f ms, texture %.1f ms, window %.1f ms\n",
+            1000.0 * modelTime, 1000.0 * textureTime, 1000.0 * windowTime);
+
     /* init OpenGL */
     glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
     glShadeModel(GL_SMOOTH);
@@ -158,10 +376,11 @@ void init(const char *filename) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    /* load tga texture */
-    if (!(texId = loadTGATexture(filename))) {
+    /* upload the tga texture */
+    if (!(texId = UploadTGATexture(theTexture))) {
         exit(-1);
     }
+    theTexture = NULL;
 }
 
 /*
@@ -171,26 +390,14 @@ void initialize() {
 
     float pos;
 
-    /* Create the map */
-    mapData = mapCreate("Test.int.raw", MAP_SIZE * MAP_SIZE);
-
-    /*Convert to little Endian*/
-    convertLittleEndian(mapData, MAP_SIZE * MAP_SIZE);
-
-    /*Take the 1d array and split it into a 2d array*/
-    //Malloc for this
-    mapArray = (int**) malloc(sizeof (int*) * MAP_SIZE);
-    int i, j, k;
-    for (i = 0; i < MAP_SIZE; i++) {
-        mapArray[i] = (int*) malloc(sizeof (int) * MAP_SIZE);
-    }
-    //Actually put this in the array
-    k = 0;
-    for (i = 0; i < MAP_SIZE; i++) {
-        for (j = 0; j < MAP_SIZE; j++) {
-            mapArray[i][j] = (int) mapData[(i * MAP_SIZE) + j];
-        }
+    /* Open the map; tiles are loaded as the camera gets near them */
+    if (mapReadSize(mapFile, mapFormat, &mapWidth, &mapHeight) != 0
+            || tlmOpen(&theMap, mapFile, mapWidth, mapHeight, mapFormat,
+            TLM_DEFAULT_TILE_SIZE, TLM_DEFAULT_CAPACITY) != 0) {
+        exit(1);
     }
+    viewWidth = min(mapWidth, VIEW_TILES * TLM_DEFAULT_TILE_SIZE);
+    viewHeight = min(mapHeight, VIEW_TILES * TLM_DEFAULT_TILE_SIZE);
 
     /* Print report */
     printf("\n\nTerrain Modeling\n");
@@ -199,6 +406,7 @@ void initialize() {
     printf("Height: %d\n", mapHeight);
     printf("No. of triangles: %d\n", ((mapWidth - 1)*(mapHeight - 1)*2));
     printf("No. of vertices: %d\n", (mapWidth * mapHeight));
+    printf("Modelled window: %d x %d\n", viewWidth, viewHeight);
 
     /* Calculate basic dimensions */
     WORLD_SIZE = mapWidth * DISTANCE_FACTOR;
@@ -211,40 +419,113 @@ void initialize() {
     /* Initialize the camera */
     resetCamera(&theCamera);
 
-    /* Create the model */
-    X = createMatrix(mapHeight, mapWidth);
-    Y = createMatrix(mapHeight, mapWidth);
-    Z = createMatrix(mapHeight, mapWidth);
-    Tx = createMatrix(mapHeight, mapWidth);
-    Ty = createMatrix(mapHeight, mapWidth);
-    Tz = createMatrix(mapHeight, mapWidth);
-    Nx = createMatrix(mapHeight, mapWidth);
-    Ny = createMatrix(mapHeight, mapWidth);
-    Nz = createMatrix(mapHeight, mapWidth);
-
-    /* Calculate the model coordinates */
-    calcModelCoordinates();
+    /* Create the model (window sized, not map sized) */
+    vertices = createVertices(viewHeight, viewWidth);
+    faceStride = viewWidth + 1;
+    posX = (GLfloat*) malloc(sizeof (GLfloat) * 3 * viewWidth * viewHeight);
+    faceX[0] = (GLfloat*) calloc(6 * faceStride * (viewHeight + 1), sizeof (GLfloat));
+    if (vertices == NULL || posX == NULL || faceX[0] == NULL) {
+        printf("Not enough memory for the model.\n");
+        exit(1);
+    }
+    posY = posX + viewWidth * viewHeight;
+    posZ = posY + viewWidth * viewHeight;
+    faceY[0] = faceX[0] + faceStride * (viewHeight + 1);
+    faceZ[0] = faceY[0] + faceStride * (viewHeight + 1);
+    faceX[1] = faceZ[0] + faceStride * (viewHeight + 1);
+    faceY[1] = faceX[1] + faceStride * (viewHeight + 1);
+    faceZ[1] = faceY[1] + faceStride * (viewHeight + 1);
+    normalThreads = min(sysProcessorCount(), MAX_NORMAL_THREADS);
+    createIndices();
+    lodCreate(&theTerrain, viewWidth, viewHeight, LOD_DEFAULT_CHUNK);
+    pckCreate(&thePicker, viewWidth, viewHeight);
+
+    /* Calculate the model coordinates (or take them from the cache) */
+    updateView();
+    loadModel();
+}
+
+/*
+ * Loader thread: opens the map and builds the model (see initialize).
+ * @param arg Unused.
+ * @return NULL.
+ */
+void* modelLoaderMain(void *arg) {
+    initialize();
+    modelTime = sysNow() - startTime;
+    return NULL;
+}
+
+/*
+ * Loader thread: decodes the texture and builds its mipmaps.
+ * @param arg Unused.
+ * @return NULL.
+ */
+void* textureLoaderMain(void *arg) {
+    theTexture = ReadTGAFile(textureFile);
+    if (theTexture != NULL) {
+        textureWidth = theTexture->width;
+        textureHeight = theTexture->height;
+        textureLuminance = GetTextureLuminance(theTexture);
+        BuildTGAMipmaps(theTexture);
+    }
+    textureTime = sysNow() - startTime;
+    return NULL;
+}
+
+/*
+ * Starts loading the map, the model and the texture in the background.
+ * Nothing of the model may be touched before finishLoading; nothing of it
+ * needs a GL context.
+ */
+void startLoading() {
+    startTime = sysNow();
+    pthread_create(&modelLoader, NULL, modelLoaderMain, NULL);
+    pthread_create(&textureLoader, NULL, textureLoaderMain, NULL);
+    loading = 1;
+}
+
+/*
+ * Waits for the loader threads (if they are running).
+ */
+void finishLoading() {
+    if (!loading)
+        return;
+    pthread_join(modelLoader, NULL);
+    pthread_join(textureLoader, NULL);
+    loading = 0;
 }
 
 /*
  * "Finalize" the app.
  */
 void finalize() {
+    finishLoading();
+    free(textureLuminance);
+    textureLuminance = NULL;
     /* Destroy the map */
-    mapDestroy(mapData, mapHeight);
+    tlmClose(&theMap);
 
     /* Destroy the model */
-    destroyMatrix(X, mapHeight);
-    destroyMatrix(Y, mapHeight);
-    destroyMatrix(Z, mapHeight);
-    destroyMatrix(Nx, mapHeight);
-    destroyMatrix(Ny, mapHeight);
-    destroyMatrix(Nz, mapHeight);
+    destroyVertices(vertices);
+    vertices = NULL;
+    free(indices);
+    indices = NULL;
+    lodDestroy(&theTerrain);
+    pckDestroy(&thePicker);
+    free(posX);
+    free(faceX[0]);
 }
 
 /*Close out the program*/
 void ShutdownRC(void) {
     glDeleteTextures(1, &textureID);
+    if (vertexBuffer != 0) {
+        glp.deleteBuffers(1, &vertexBuffer);
+        glp.deleteBuffers(1, &indexBuffer);
+    }
+    if (lodBuffer != 0)
+        glp.deleteBuffers(1, &lodBuffer);
 }
 
 /*
@@ -267,122 +548,719 @@ void resetCamera(Camera *camera) {
 }
 
 /*
- * Add the contribution to the normal vector.
- * @param vector normal
- * @param coord value
- * @param coord value
+ * Runs a pass over bands of rows, one band per thread.
+ * @param pass Function processing the rows of a Band.
+ * @param rows Number of rows.
+ */
+void runBands(void* (*pass)(void*), int rows) {
+    pthread_t threads[MAX_NORMAL_THREADS];
+    Band bands[MAX_NORMAL_THREADS];
+    int i, n = max(1, min(normalThreads, rows));
+
+    for (i = 0; i < n; i++) {
+        bands[i].first = rows * i / n;
+        bands[i].last = rows * (i + 1) / n;
+    }
+    for (i = 1; i < n; i++)
+        pthread_create(&threads[i], NULL, pass, &bands[i]);
+    pass(&bands[0]);
+    for (i = 1; i < n; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/*
+ * Face pass: normals of the two triangles of each quad in a band of quad
+ * rows. They are not normalized, so their length (twice the triangle area)
+ * weights them in the vertex pass.
+ * @param arg The Band.
  */
-void addNormal(M3DVector3f n, int r, int c) {
-    M3DVector3f nc, nr;
+void* faceNormalBand(void *arg) {
+    const Band *band = (const Band*) arg;
+    const GLfloat *ax, *ay, *az, *bx, *by, *bz;
+    GLfloat *f1x, *f1y, *f1z, *f2x, *f2y, *f2z;
+    int i;
 
-    m3dLoadVector3f(nc, Nx[r][c], Ny[r][c], Nz[r][c]);
-    m3dAddVectors3f(nr, nc, n);
-    m3dNormalizeVector3f(nr);
-    Nx[r][c] = m3dGetVectorX(nr);
-    Ny[r][c] = m3dGetVectorY(nr);
-    Nz[r][c] = m3dGetVectorZ(nr);
+    for (i = band->first; i < band->last; i++) {
+        /* Row i (a) and row i + 1 (b) */
+        ax = posX + i * viewWidth;
+        ay = posY + i * viewWidth;
+        az = posZ + i * viewWidth;
+        bx = ax + viewWidth;
+        by = ay + viewWidth;
+        bz = az + viewWidth;
+        f1x = faceX[0] + (i + 1) * faceStride + 1;
+        f1y = faceY[0] + (i + 1) * faceStride + 1;
+        f1z = faceZ[0] + (i + 1) * faceStride + 1;
+        f2x = faceX[1] + (i + 1) * faceStride + 1;
+        f2y = faceY[1] + (i + 1) * faceStride + 1;
+        f2z = faceZ[1] + (i + 1) * faceStride + 1;
+
+        /* First triangles (a[j], b[j], a[j+1]), then (a[j+1], b[j], b[j+1]) */
+        m3dFindNormals3f(f1x, f1y, f1z, ax, ay, az, bx, by, bz,
+                ax + 1, ay + 1, az + 1, viewWidth - 1);
+        m3dFindNormals3f(f2x, f2y, f2z, ax + 1, ay + 1, az + 1, bx, by, bz,
+                bx + 1, by + 1, bz + 1, viewWidth - 1);
+    }
+    return NULL;
 }
 
 /*
- * Calculates the model coordinates 
+ * Vertex pass: sums the normals of the (up to six) triangles around each
+ * vertex of a band of rows and normalizes the sum once. The zero border of
+ * the face arrays stands in for the missing triangles at the edges.
+ * @param arg The Band.
  */
-void calcModelCoordinates() {
-    M3DVector3f v1, v2, v3, v4, n;
+void* vertexNormalBand(void *arg) {
+    const Band *band = (const Band*) arg;
+    const GLfloat *f[2][3], *g[2][3];
+    GLfloat *nx, *ny, *nz, *n;
+    int i, j, t, c;
+
+    /* One row of sums, normalized in a batch */
+    nx = (GLfloat*) malloc(3 * viewWidth * sizeof (GLfloat));
+    ny = nx + viewWidth;
+    nz = ny + viewWidth;
+
+    for (i = band->first; i < band->last; i++) {
+        /* Quads of row i (f) and row i - 1 (g), shifted by the border */
+        for (t = 0; t < 2; t++) {
+            f[t][0] = faceX[t] + (i + 1) * faceStride + 1;
+            f[t][1] = faceY[t] + (i + 1) * faceStride + 1;
+            f[t][2] = faceZ[t] + (i + 1) * faceStride + 1;
+            for (c = 0; c < 3; c++)
+                g[t][c] = f[t][c] - faceStride;
+        }
+
+        for (j = 0; j < viewWidth; j++) {
+            nx[j] = f[0][0][j] + g[0][0][j] + f[0][0][j - 1] + f[1][0][j - 1] + g[1][0][j] + g[1][0][j - 1];
+            ny[j] = f[0][1][j] + g[0][1][j] + f[0][1][j - 1] + f[1][1][j - 1] + g[1][1][j] + g[1][1][j - 1];
+            nz[j] = f[0][2][j] + g[0][2][j] + f[0][2][j - 1] + f[1][2][j - 1] + g[1][2][j] + g[1][2][j - 1];
+        }
+        m3dNormalizeVectors3f(nx, ny, nz, viewWidth);
+
+        for (j = 0; j < viewWidth; j++) {
+            n = VERTEX(i, j).normal;
+            if (nx[j] != 0.0f || ny[j] != 0.0f || nz[j] != 0.0f) {
+                n[0] = nx[j];
+                n[1] = ny[j];
+                n[2] = nz[j];
+            } else {
+                n[0] = n[2] = 0.0f;
+                n[1] = 1.0f;
+            }
+        }
+    }
+    free(nx);
+    return NULL;
+}
+
+/*
+ * Stores the unit normal (gx, 1, gz) of a height field.
+ * @param n The normal.
+ * @param gx Minus the height slope along x.
+ * @param gz Minus the height slope along z.
+ */
+void setGradientNormal(GLfloat *n, GLfloat gx, GLfloat gz) {
+    GLfloat inv = 1.0f / sqrtf(gx * gx + 1.0f + gz * gz);
+
+    n[0] = gx * inv;
+    n[1] = inv;
+    n[2] = gz * inv;
+}
+
+/*
+ * Gradient pass: normals straight from the heights of a band of rows, using
+ * central differences (one-sided ones at the edges). On a regular grid this
+ * needs neither triangles nor cross products, and it reads each height row
+ * once.
+ * @param arg The Band.
+ */
+void* gradientNormalBand(void *arg) {
+    const Band *band = (const Band*) arg;
+    const GLfloat *y, *up, *down;
+    GLfloat sx = 2.0f * DISTANCE_FACTOR, sz;
+    int i, j, last = viewWidth - 1;
+#ifdef __SSE2__
+    float gx[4], gz[4], inv[4];
+    __m128 vx, vz, len, rsx, rsz;
+    int k;
+#endif
+
+    for (i = band->first; i < band->last; i++) {
+        y = posY + i * viewWidth;
+        up = posY + max(i - 1, 0) * viewWidth;
+        down = posY + min(i + 1, viewHeight - 1) * viewWidth;
+        sz = (min(i + 1, viewHeight - 1) - max(i - 1, 0)) * (GLfloat) DISTANCE_FACTOR;
+
+        /* Interior columns, four at a time where SSE is available */
+        j = 1;
+#ifdef __SSE2__
+        rsx = _mm_set1_ps(1.0f / sx);
+        rsz = _mm_set1_ps(1.0f / sz);
+        for (; j + 4 <= last; j += 4) {
+            vx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + j - 1), _mm_loadu_ps(y + j + 1)), rsx);
+            vz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)), rsz);
+            len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz)), _mm_set1_ps(1.0f));
+            len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len));
+            _mm_storeu_ps(gx, _mm_mul_ps(vx, len));
+            _mm_storeu_ps(gz, _mm_mul_ps(vz, len));
+            _mm_storeu_ps(inv, len);
+            for (k = 0; k < 4; k++) {
+                VERTEX(i, j + k).normal[0] = gx[k];
+                VERTEX(i, j + k).normal[1] = inv[k];
+                VERTEX(i, j + k).normal[2] = gz[k];
+            }
+        }
+#endif
+        for (; j < last; j++)
+            setGradientNormal(VERTEX(i, j).normal, (y[j - 1] - y[j + 1]) / sx, (up[j] - down[j]) / sz);
+
+        /* Edge columns */
+        setGradientNormal(VERTEX(i, 0).normal, (y[0] - y[1]) * 2.0f / sx, (up[0] - down[0]) / sz);
+        setGradientNormal(VERTEX(i, last).normal, (y[last - 1] - y[last]) * 2.0f / sx,
+                (up[last] - down[last]) / sz);
+    }
+    return NULL;
+}
+
+/*
+ * Moves the modelled window over the tiles around the camera (clamped to
+ * the map).
+ * @return 1 if the window moved and the model has to be recalculated.
+ */
+int updateView() {
     GLfloat dx = -(mapWidth * DISTANCE_FACTOR) / 2.0f;
     GLfloat dz = -(mapHeight * DISTANCE_FACTOR) / 2.0f;
-    int i, j;
+    int tx = (int) ((theCamera.position[0] - dx) / DISTANCE_FACTOR) / TLM_DEFAULT_TILE_SIZE;
+    int ty = (int) ((theCamera.position[2] - dz) / DISTANCE_FACTOR) / TLM_DEFAULT_TILE_SIZE;
+    int x0 = (tx - VIEW_TILES / 2) * TLM_DEFAULT_TILE_SIZE;
+    int y0 = (ty - VIEW_TILES / 2) * TLM_DEFAULT_TILE_SIZE;
+
+    x0 = max(0, min(x0, mapWidth - viewWidth));
+    y0 = max(0, min(y0, mapHeight - viewHeight));
+    if (x0 == viewX0 && y0 == viewY0)
+        return 0;
+    viewX0 = x0;
+    viewY0 = y0;
+    return 1;
+}
 
-    /* Vertices */
-    for (i = 0; i < MAP_SIZE; i++) {
-        for (j = 0; j < MAP_SIZE; j++) {
-            X[i][j] = j * DISTANCE_FACTOR + dx;
-            Y[i][j] = mapArray[i][j] / 300;
-            Z[i][j] = i * DISTANCE_FACTOR + dz;
-            Nx[i][j] = Ny[i][j] = Nz[i][j] = 0.0f;
-        }
+/*
+ * Builds the key of the model cache: a hash of the raw samples of the
+ * window and of everything the model is made from.
+ * @return The key.
+ */
+unsigned long long modelCacheKey() {
+    int params[] = {mapWidth, mapHeight, mapFormat, viewX0, viewY0, viewWidth, viewHeight,
+        DISTANCE_FACTOR, HEIGHT_FACTOR, gradientNormals, LOD_DEFAULT_CHUNK,
+        sizeof (Vertex), sizeof (LodChunk), sizeof (LodNode)};
+    size_t rowSize = (size_t) viewWidth * mapSampleSize(mapFormat);
+    unsigned long long key = mdcHash(MDC_HASH_SEED, params, sizeof (params));
+    int i;
+
+    for (i = 0; i < viewHeight; i++) {
+        key = mdcHash(key, theMap.file.data
+                + ((size_t) (viewY0 + i) * mapWidth + viewX0) * mapSampleSize(mapFormat), rowSize);
     }
+    return key;
+}
 
-    /* Texture Vertices*/
-    for (i = 0; i < mapHeight; i++) {
-        for (j = 0; j < mapWidth; j++) {
-            Tx[i][j] = j;
-            Ty[i][j] = mapArray[i][j];
-            Tz[i][j] = i;
+/*
+ * Builds the model of the startup window. The vertices and the level-of-
+ * detail data come from the cache file next to the map when it matches;
+ * otherwise they are calculated and the cache is (re)written.
+ */
+void loadModel() {
+    char *cacheFile = (char*) malloc(strlen(mapFile) + strlen(CACHE_SUFFIX) + 1);
+    size_t sizes[3];
+    const void *sections[3];
+    unsigned long long key = modelCacheKey();
+    MdcFile cache;
+    double start = sysNow();
+
+    sprintf(cacheFile, "%s%s", mapFile, CACHE_SUFFIX);
+    sizes[0] = sizeof (Vertex) * viewWidth * viewHeight;
+    sizes[1] = sizeof (LodChunk) * theTerrain.chunksX * theTerrain.chunksY;
+    sizes[2] = sizeof (LodNode) * theTerrain.nodeCount;
+
+    /* Hit: copy the sections out of the mapping */
+    if (mdcOpen(&cache, cacheFile, key) == 0) {
+        sections[0] = mdcSection(&cache, 0, sizes[0]);
+        sections[1] = mdcSection(&cache, 1, sizes[1]);
+        sections[2] = mdcSection(&cache, 2, sizes[2]);
+        if (sections[0] != NULL && sections[1] != NULL && sections[2] != NULL) {
+            memcpy(vertices, sections[0], sizes[0]);
+            lodLoad(&theTerrain, (const LodChunk*) sections[1], (const LodNode*) sections[2]);
+            modelDirty = 1;
+            modelDistanceFactor = DISTANCE_FACTOR;
+            modelHeightFactor = HEIGHT_FACTOR;
+            updatePicker();
+            mdcClose(&cache);
+            printf("Model: from %s (%.1f ms)\n", cacheFile, 1000.0 * (sysNow() - start));
+            free(cacheFile);
+            return;
         }
+        mdcClose(&cache);
     }
 
-    /* Normals */
-    for (i = 0; i < mapHeight - 1; i++) {
-        for (j = 0; j < mapWidth - 1; j++) {
-            m3dLoadVector3f(v1, X[i][j], Y[i][j], Z[i][j]);
-            m3dLoadVector3f(v2, X[i + 1][j], Y[i + 1][j], Z[i + 1][j]);
-            m3dLoadVector3f(v3, X[i][j + 1], Y[i][j + 1], Z[i][j + 1]);
-            m3dLoadVector3f(v4, X[i + 1][j + 1], Y[i + 1][j + 1], Z[i + 1][j + 1]);
-
-            /* First triangle */
-            m3dFindNormal3f(n, v1, v2, v3);
-            addNormal(n, i, j);
-            addNormal(n, i + 1, j);
-            addNormal(n, i, j + 1);
-
-            /* Second triangle */
-            m3dFindNormal3f(n, v3, v2, v4);
-            addNormal(n, i, j + 1);
-            addNormal(n, i + 1, j);
-            addNormal(n, i + 1, j + 1);
+    /* Miss: build and save */
+    calcModelCoordinates();
+    printf("Model: built (%.1f ms)\n", 1000.0 * (sysNow() - start));
+    sections[0] = vertices;
+    sections[1] = theTerrain.chunks;
+    sections[2] = theTerrain.nodes;
+    mdcWrite(cacheFile, key, 3, sections, sizes);
+    free(cacheFile);
+}
+
+/*
+ * Calculates the model coordinates for the current scaling factors.
+ */
+void calcModelCoordinates() {
+    Vertex *v;
+    GLfloat dx = -(mapWidth * DISTANCE_FACTOR) / 2.0f;
+    GLfloat dz = -(mapHeight * DISTANCE_FACTOR) / 2.0f;
+    GLfloat hy = (GLfloat) HEIGHT_FACTOR / DEFAULT_HEIGHT_FACTOR;
+    int *row = (int*) malloc(sizeof (int) * viewWidth);
+    int i, j, k;
+
+    /* Vertices and texture coordinates (positions also go to the SoA copy) */
+    for (i = 0; i < viewHeight; i++) {
+        tlmGetRow(&theMap, viewX0, viewY0 + i, viewWidth, row);
+        for (j = 0; j < viewWidth; j++) {
+            k = i * viewWidth + j;
+            v = &vertices[k];
+            v->texCoord[0] = (float) (viewX0 + j) / (float) mapWidth;
+            v->texCoord[1] = (float) (viewY0 + i) / (float) mapHeight;
+            v->position[0] = posX[k] = (viewX0 + j) * DISTANCE_FACTOR + dx;
+            v->position[1] = posY[k] = (row[j] / 300) * hy;
+            v->position[2] = posZ[k] = (viewY0 + i) * DISTANCE_FACTOR + dz;
         }
     }
+    free(row);
+    lodUpdate(&theTerrain, posX, posY, posZ);
+    modelDirty = 1;
+    modelDistanceFactor = DISTANCE_FACTOR;
+    modelHeightFactor = HEIGHT_FACTOR;
+    updatePicker();
+
+    /* Normals: from the height gradient, or the area-weighted average of
+     * the surrounding triangles */
+    if (gradientNormals) {
+        runBands(gradientNormalBand, viewHeight);
+    } else {
+        runBands(faceNormalBand, viewHeight - 1);
+        runBands(vertexNormalBand, viewHeight);
+    }
 }
 
 /*
- * Paints the model.
+ * Rebuilds the picking pyramid over the heights of the model.
  */
-void paintModel() {
-    int i, j;
+void updatePicker() {
+    pckUpdate(&thePicker, &vertices[0].position[1], sizeof (Vertex) / sizeof (GLfloat),
+            vertices[0].position[0], vertices[0].position[2],
+            (GLfloat) modelDistanceFactor, (GLfloat) modelDistanceFactor);
+}
 
-    glPushMatrix();
+/*
+ * Ray through a pixel of the window, in model coordinates (the model is
+ * drawn scaled when the factors changed since it was built).
+ * @param x X-coordinate of the pixel (from the left).
+ * @param y Y-coordinate of the pixel (from the top).
+ * @param origin Receives the point on the near plane.
+ * @param direction Receives the way to the point on the far plane.
+ * @return 0 if the matrices can't be inverted.
+ */
+int pickRay(int x, int y, GLfloat origin[3], GLfloat direction[3]) {
+    GLdouble modelview[16], projection[16], nearPoint[3], farPoint[3], winX, winY;
+    GLint viewport[4];
+    GLfloat scale[3];
+    int i;
 
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
     glPushMatrix();
+    cmrLookAt(&theCamera);
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
     glPopMatrix();
+    /* Through the pixel's center (GL rows go up) */
+    winX = x + 0.5;
+    winY = viewport[3] - y - 0.5;
+    if (!gluUnProject(winX, winY, 0.0, modelview, projection, viewport,
+            &nearPoint[0], &nearPoint[1], &nearPoint[2])
+            || !gluUnProject(winX, winY, 1.0, modelview, projection, viewport,
+            &farPoint[0], &farPoint[1], &farPoint[2]))
+        return 0;
+
+    scale[0] = scale[2] = (GLfloat) modelDistanceFactor / DISTANCE_FACTOR;
+    scale[1] = (GLfloat) modelHeightFactor / HEIGHT_FACTOR;
+    for (i = 0; i < 3; i++) {
+        origin[i] = (GLfloat) nearPoint[i] * scale[i];
+        direction[i] = (GLfloat) (farPoint[i] - nearPoint[i]) * scale[i];
+    }
+    return 1;
+}
+
+/*
+ * Issues the draw calls of the model with the current arrays: one indexed
+ * draw of the triangles of the chunk levels chosen for the view or, at full
+ * resolution, of restart-separated strips (one draw per row where
+ * primitive restart isn't available). Only issues draws, so passes over the
+ * same frame can repeat it.
+ * @pre With useLod, selectLod has chosen the levels for this frame.
+ * @param indexBase Start of the strip indices (NULL for the index buffer).
+ */
+void drawModel(const char *indexBase) {
+    int i, rowCount = 2 * viewWidth + 1;
+
+    if (useLod) {
+        glDrawElements(GL_TRIANGLES, theTerrain.indexCount, GL_UNSIGNED_INT,
+                glp.hasBuffers ? NULL : theTerrain.indices);
+        drawCalls++;
+        drawnTriangles += theTerrain.triangleCount;
+    } else if (glp.hasPrimitiveRestart) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glp.primitiveRestartIndex(RESTART_INDEX);
+        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, indexBase);
+        glDisable(GL_PRIMITIVE_RESTART);
+        drawCalls++;
+        drawnTriangles += 2 * (viewWidth - 1) * (viewHeight - 1);
+    } else {
+        for (i = 0; i < viewHeight - 1; i++)
+            glDrawElements(GL_TRIANGLE_STRIP, rowCount - 1, GL_UNSIGNED_INT,
+                indexBase + sizeof (GLuint) * rowCount * i);
+        drawCalls += viewHeight - 1;
+        drawnTriangles += 2 * (viewWidth - 1) * (viewHeight - 1);
+    }
+}
+
+/*
+ * Paints the model (see drawModel) with the texture and, when shown, the
+ * edge overlay added on top: on the second texture unit, or as a second
+ * additive pass with OpenGL 1.1. The vertices come from buffer objects
+ * when the GL has them and from client memory otherwise.
+ */
+void paintModel() {
+    const char *vertexBase, *indexBase;
+    int overlay = showEdges && hasEdges;
+
+    glPushMatrix();
+
+    /* Factors changed since the build are a scaling of the model; the
+     * normals only need renormalizing (per vertex, on the GL side) then */
+    if (modelDistanceFactor != DISTANCE_FACTOR || modelHeightFactor != HEIGHT_FACTOR) {
+        glScalef((GLfloat) DISTANCE_FACTOR / modelDistanceFactor,
+                (GLfloat) HEIGHT_FACTOR / modelHeightFactor,
+                (GLfloat) DISTANCE_FACTOR / modelDistanceFactor);
+        glEnable(GL_NORMALIZE);
+    } else {
+        glDisable(GL_NORMALIZE);
+    }
 
     glColor3f(0.8f, 0.6f, 0.6f);
     glEnable(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, texId);
 
-    for (i = 0; i < mapHeight - 1; i++) {
-        glBegin(GL_TRIANGLE_STRIP);
-        for (j = 0; j < mapWidth; j++) {
-            glNormal3f(Nx[i][j], Ny[i][j], Nz[i][j]);
-            glTexCoord2f((float) j / (float) mapWidth, (float) i / (float) mapHeight);
-            glVertex3f(X[i][j], Y[i][j], Z[i][j]);
+    /* Vertex and index sources */
+    uploadModel();
+    if (glp.hasBuffers) {
+        glp.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glp.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        vertexBase = NULL;
+        indexBase = NULL;
+    } else {
+        vertexBase = (const char*) vertices;
+        indexBase = (const char*) indices;
+    }
+    glInterleavedArrays(GL_T2F_N3F_V3F, 0, vertexBase);
+
+    /* Edge overlay on unit 1, same texture coordinates */
+    if (overlay && glp.hasMultitexture) {
+        glp.activeTexture(GL_TEXTURE1);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, edgeTexId);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
+        glp.clientActiveTexture(GL_TEXTURE1);
+        glTexCoordPointer(2, GL_FLOAT, sizeof (Vertex), vertexBase);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
 
-            glNormal3f(Nx[i][j], Ny[i + 1][j], Nz[i + 1][j]);
-            glTexCoord2f((float) j / (float) mapWidth, (float) (i + 1) / (float) mapHeight);
-            glVertex3f(X[i][j], Y[i + 1][j], Z[i + 1][j]);
-        }
-        glEnd();
+    /* Draw (the chunk levels are chosen once for all the passes) */
+    if (useLod)
+        selectLod();
+    drawModel(indexBase);
+
+    if (overlay && glp.hasMultitexture) {
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glp.clientActiveTexture(GL_TEXTURE0);
+        glDisable(GL_TEXTURE_2D);
+        glp.activeTexture(GL_TEXTURE0);
+    } else if (overlay) {
+        /* Same triangles again, edges added to what is there */
+        glDepthFunc(GL_LEQUAL);
+        glDisable(GL_LIGHTING);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glBindTexture(GL_TEXTURE_2D, edgeTexId);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+        drawModel(indexBase);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_LIGHTING);
+        glDepthFunc(GL_LESS);
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (glp.hasBuffers) {
+        glp.bindBuffer(GL_ARRAY_BUFFER, 0);
+        glp.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
     glPopMatrix();
 }
 
 /*
- * Renders the model/scene.
+ * Draws the model/scene into the current framebuffer.
  */
-void RenderScene() {
+void drawScene() {
     /* Clear the color buffer and depth buffer */
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     /* Draw the object(s) */
     paintModel();
 
+    /* Startup latency, once */
+    if (startTime > 0.0) {
+        glFinish();
+        printf("First frame: %.1f ms after start\n", 1000.0 * (sysNow() - startTime));
+        startTime = 0.0;
+    }
+}
+
+/*
+ * Renders the model/scene.
+ */
+void RenderScene() {
+    drawScene();
+
     /* Update the screen */
     glutSwapBuffers();
 }
 
+/*
+ * Parses a camera axis name: x, y, z (local) or X, Y, Z (global).
+ * @return X_LOCAL_AXIS..Z_GLOBAL_AXIS, or -1.
+ */
+int parseAxis(const char *name) {
+    if (name[0] >= 'X' && name[0] <= 'Z' && name[1] == '\0')
+        return X_GLOBAL_AXIS + name[0] - 'X';
+    if (name[0] >= 'x' && name[0] <= 'z' && name[1] == '\0')
+        return X_LOCAL_AXIS + name[0] - 'x';
+    return -1;
+}
+
+/*
+ * Writes the current framebuffer as a binary PPM.
+ * @param filename Name of the file.
+ * @param width Width of the framebuffer.
+ * @param height Height of the framebuffer.
+ */
+void writeFrame(const char *filename, int width, int height) {
+    GLubyte *pixels = (GLubyte*) malloc((size_t) 3 * width * height);
+    FILE *fp = fopen(filename, "wb");
+    int i;
+
+    if (pixels == NULL || fp == NULL) {
+        printf("Can't write \"%s\".\n", filename);
+    } else {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        fprintf(fp, "P6\n%d %d\n255\n", width, height);
+        for (i = height - 1; i >= 0; i--)
+            fwrite(pixels + (size_t) 3 * width * i, 3, width, fp);
+    }
+    if (fp != NULL)
+        fclose(fp);
+    free(pixels);
+}
+
+/*
+ * Replays a camera script without a window and reports the frame times.
+ * Every line is one command ('#' starts a comment):
+ *   move|turn|around <axis> <amount> [count]
+ *       cmrMove/cmrTurn/cmrTurnAround, count times (1 by default) with a
+ *       frame after each; axes are x, y, z (camera) or X, Y, Z (world)
+ *   frame [count]   frames without moving the camera
+ *   reset           back to the initial camera
+ *   lod 0|1         full grid or chunk levels
+ * A frame is timed from the start of drawScene to the end of glFinish. At
+ * the end a batch of picks through a grid of pixels of the view is timed.
+ * @param script Name of the script file.
+ * @param dumpDir Directory for <dumpDir>/frame_<n>.ppm, NULL for none.
+ * @return Status code.
+ */
+int runBenchmark(const char *script, const char *dumpDir) {
+    FILE *fp = fopen(script, "r");
+    char line[256], command[16], axisName[8], filename[1024];
+    double *frameTimes = NULL, *grown, wallStart, wallTotal = 0.0;
+    GLfloat *origins, *directions;
+    PckHit *hits;
+    clock_t cpuStart, cpuTotal = 0;
+    long calls = 0, triangles = 0;
+    int frameCount = 0, capacity = 0, lineNo = 0;
+    int op, axis, count, i, n;
+    float amount;
+
+    if (fp == NULL) {
+        printf("Can't open \"%s\".\n", script);
+        return EXIT_FAILURE;
+    }
+    if (ofsCreate(WINDOW_WIDTH, WINDOW_HEIGHT) != 0) {
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+    init();
+    SetupRC();
+    ChangeSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        lineNo++;
+        if (strchr(line, '#') != NULL)
+            *strchr(line, '#') = '\0';
+        count = 1;
+        n = sscanf(line, "%15s %7s %f %d", command, axisName, &amount, &count);
+        if (n <= 0)
+            continue;
+
+        /* Camera commands and frames */
+        op = !strcmp(command, "move") ? BENCH_MOVE : !strcmp(command, "turn") ? BENCH_TURN
+                : !strcmp(command, "around") ? BENCH_AROUND : -1;
+        axis = n >= 2 ? parseAxis(axisName) : -1;
+        if (op >= 0 && (n < 3 || axis < 0 || (op == BENCH_AROUND && axis < X_GLOBAL_AXIS))) {
+            printf("%s:%d: bad command.\n", script, lineNo);
+            continue;
+        }
+        if (!strcmp(command, "frame")) {
+            count = n >= 2 ? atoi(axisName) : 1;
+        } else if (!strcmp(command, "reset")) {
+            resetCamera(&theCamera);
+            if (updateView())
+                calcModelCoordinates();
+            cmrLookAt(&theCamera);
+            continue;
+        } else if (!strcmp(command, "lod") && n >= 2) {
+            useLod = atoi(axisName) != 0;
+            continue;
+        } else if (op < 0) {
+            printf("%s:%d: unknown command \"%s\".\n", script, lineNo, command);
+            continue;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (op == BENCH_MOVE)
+                cmrMove(&theCamera, axis, amount);
+            else if (op == BENCH_TURN)
+                cmrTurn(&theCamera, axis, amount);
+            else if (op == BENCH_AROUND)
+                cmrTurnAround(&theCamera, axis, amount);
+
+            /* Time the frame (a window move rebuilds the model, which is
+             * counted in) */
+            if (frameCount == capacity) {
+                capacity = capacity ? 2 * capacity : 256;
+                grown = (double*) realloc(frameTimes, sizeof (double) * capacity);
+                if (grown == NULL) {
+                    fprintf(stderr, "error: out of memory after %d frames!\n", frameCount);
+                    free(frameTimes);
+                    fclose(fp);
+                    ShutdownRC();
+                    ofsDestroy();
+                    return EXIT_FAILURE;
+                }
+                frameTimes = grown;
+            }
+            drawCalls = drawnTriangles = 0;
+            wallStart = sysNow();
+            cpuStart = clock();
+            if (op >= 0 && updateView())
+                calcModelCoordinates();
+            cmrLookAt(&theCamera);
+            drawScene();
+            glFinish();
+            cpuTotal += clock() - cpuStart;
+            frameTimes[frameCount] = sysNow() - wallStart;
+            wallTotal += frameTimes[frameCount];
+            calls += drawCalls;
+            triangles += drawnTriangles;
+
+            if (dumpDir != NULL) {
+                sprintf(filename, "%.1000s/frame_%05d.ppm", dumpDir, frameCount);
+                writeFrame(filename, WINDOW_WIDTH, WINDOW_HEIGHT);
+            }
+            frameCount++;
+        }
+    }
+    fclose(fp);
+
+    /* Report */
+    printf("\n\nRender Benchmark\n");
+    printf("================\n");
+    printf("Renderer: %s\n", (const char*) glGetString(GL_RENDERER));
+    printf("Frames: %d at %d x %d\n", frameCount, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (frameCount > 0) {
+        printf("Frame time: %.3f ms mean (%.1f frames/s), %.3f ms CPU\n",
+                wallTotal * 1e3 / frameCount, frameCount / wallTotal,
+                (double) cpuTotal * 1e3 / CLOCKS_PER_SEC / frameCount);
+        printf("Per frame: %.1f draw calls, %.0f triangles\n",
+                (double) calls / frameCount, (double) triangles / frameCount);
+        qsort(frameTimes, frameCount, sizeof (double), sysCompareDoubles);
+        printf("%10s %10s %10s %10s\n", "p50 ms", "p90 ms", "p99 ms", "max ms");
+        printf("%10.3f %10.3f %10.3f %10.3f\n", frameTimes[(frameCount - 1) * 50 / 100] * 1e3,
+                frameTimes[(frameCount - 1) * 90 / 100] * 1e3,
+                frameTimes[(frameCount - 1) * 99 / 100] * 1e3, frameTimes[frameCount - 1] * 1e3);
+    }
+    free(frameTimes);
+
+    /* Picks through a grid of pixels of the last view, in one batch (pixels
+     * that can't be unprojected are left out) */
+    origins = (GLfloat*) malloc(sizeof (GLfloat) * 6 * PICK_GRID_X * PICK_GRID_Y);
+    hits = (PckHit*) malloc(sizeof (PckHit) * PICK_GRID_X * PICK_GRID_Y);
+    if (origins == NULL || hits == NULL) {
+        fprintf(stderr, "error: out of memory for %d picks!\n", PICK_GRID_X * PICK_GRID_Y);
+        free(origins);
+        free(hits);
+        ShutdownRC();
+        ofsDestroy();
+        return EXIT_FAILURE;
+    }
+    directions = origins + 3 * PICK_GRID_X * PICK_GRID_Y;
+    count = 0;
+    for (i = 0; i < PICK_GRID_X * PICK_GRID_Y; i++) {
+        if (pickRay((2 * (i % PICK_GRID_X) + 1) * WINDOW_WIDTH / (2 * PICK_GRID_X),
+                (2 * (i / PICK_GRID_X) + 1) * WINDOW_HEIGHT / (2 * PICK_GRID_Y),
+                origins + 3 * count, directions + 3 * count))
+            count++;
+    }
+    wallStart = sysNow();
+    n = pckRays(&thePicker, count, origins, directions, hits);
+    printf("Picks: %d rays, %d hits, %.2f us per ray\n", count, n,
+            count > 0 ? (sysNow() - wallStart) * 1e6 / count : 0.0);
+    free(origins);
+    free(hits);
+
+    ShutdownRC();
+    ofsDestroy();
+    return EXIT_SUCCESS;
+}
+
 /*
  * Initializes the rendering context.
  */
 void SetupRC() {
+    /* Entry points beyond OpenGL 1.1 */
+    glpInit();
+
     /* Set the background color */
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -408,8 +1286,8 @@ void SetupRC() {
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
     glEnable(GL_COLOR_MATERIAL);
 
-    /* Rescale normals to unit length */
-    glEnable(GL_NORMALIZE);
+    /* Normals are unit length unless the model is scaled (see paintModel) */
+    glDisable(GL_NORMALIZE);
 
 }
 
@@ -430,6 +1308,7 @@ void ChangeSize(GLsizei w, GLsizei h) {
 
     /* Calculate the aspect ratio of the window */
     aspectRatio = (GLfloat) w / (GLfloat) h;
+    windowHeight = h;
 
     /* Set the projection */
     setPerspectiveProjection(aspectRatio);
@@ -443,16 +1322,14 @@ void ChangeSize(GLsizei w, GLsizei h) {
  * @param aspectRatio Aspect ratio of the window.
  */
 void setPerspectiveProjection(GLdouble aspectRatio) {
-    GLdouble zNear = 1.0;
-    GLdouble zFar = 5 * WORLD_SIZE;
-    GLdouble angle = 45.0;
+    zFar = 5 * WORLD_SIZE;
 
     /* Select the projection matrix */
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
 
     /* Set the projection */
-    gluPerspective(angle, aspectRatio, zNear, zFar);
+    gluPerspective(FIELD_OF_VIEW, aspectRatio, zNear, zFar);
 
     /* Select the modelview matrix */
     glMatrixMode(GL_MODELVIEW);
@@ -472,15 +1349,18 @@ void KeyPressedStd(unsigned char key, int x, int y) {
     } else if (key == 'r') {
         /* Reset visualization parameters */
         resetCamera(&theCamera);
+        if (updateView())
+            calcModelCoordinates();
     } else if (cmrIsCtrlKey(key)) {
-        /* Process camera ctrl key */
+        /* Process camera ctrl key; follow the camera with the window */
         cmrProcessCtrlKey(&theCamera, key,
                 cmrIsMoveCtrlKey(key) ? BASIC_DIMENSION : BASIC_ANGLE);
+        if (updateView())
+            calcModelCoordinates();
     } else if (key == '+') {
         HEIGHT_FACTOR++;
         WORLD_SIZE = max(mapWidth*DISTANCE_FACTOR, 255 * HEIGHT_FACTOR);
         BASIC_DIMENSION = WORLD_SIZE / 100;
-        calcModelCoordinates();
         setPerspectiveProjection(aspectRatio);
     } else if (key == '-') {
         HEIGHT_FACTOR--;
@@ -488,13 +1368,13 @@ void KeyPressedStd(unsigned char key, int x, int y) {
             HEIGHT_FACTOR = 1;
         WORLD_SIZE = max(mapWidth*DISTANCE_FACTOR, 255 * HEIGHT_FACTOR);
         BASIC_DIMENSION = WORLD_SIZE / 100;
-        calcModelCoordinates();
         setPerspectiveProjection(aspectRatio);
     } else if (key == '>') {
         DISTANCE_FACTOR++;
         WORLD_SIZE = max(mapWidth*DISTANCE_FACTOR, 255 * HEIGHT_FACTOR);
         BASIC_DIMENSION = WORLD_SIZE / 100;
-        calcModelCoordinates();
+        if (updateView())
+            calcModelCoordinates();
         setPerspectiveProjection(aspectRatio);
     } else if (key == '<') {
         DISTANCE_FACTOR--;
@@ -502,8 +1382,27 @@ void KeyPressedStd(unsigned char key, int x, int y) {
             DISTANCE_FACTOR = 10;
         WORLD_SIZE = max(mapWidth*DISTANCE_FACTOR, 255 * HEIGHT_FACTOR);
         BASIC_DIMENSION = WORLD_SIZE / 100;
-        calcModelCoordinates();
+        if (updateView())
+            calcModelCoordinates();
         setPerspectiveProjection(aspectRatio);
+    } else if (key == 'g') {
+        /* Switch the normal generator */
+        gradientNormals = !gradientNormals;
+        printf("Normals: %s\n", gradientNormals ? "central differences" : "triangle average");
+        calcModelCoordinates();
+    } else if (key == 'L') {
+        /* Switch between the chunk levels and the full grid */
+        useLod = !useLod;
+        printf("Level of detail: %s\n", useLod ? "on" : "off");
+    } else if (key == 'i') {
+        /* Statistics of the last chunk selection (none before the first frame) */
+        int chunks = theTerrain.chunkCount + theTerrain.culledCount;
+
+        printf("Chunks: %d drawn, %d culled (%.0f%%); %d of %d triangles\n",
+                theTerrain.chunkCount, theTerrain.culledCount,
+                chunks > 0 ? 100.0 * theTerrain.culledCount / chunks : 0.0,
+                theTerrain.triangleCount, 2 * (viewWidth - 1) * (viewHeight - 1));
+        return;
     } else if (key == 'x') {
         exit(0);
     } else {
@@ -513,6 +1412,30 @@ void KeyPressedStd(unsigned char key, int x, int y) {
     glutPostRedisplay();
 }
 
+/*
+ * Callback used for mouse button events: a left click prints the map
+ * sample under the mouse.
+ * @param button Button.
+ * @param state GLUT_DOWN or GLUT_UP.
+ * @param x X-coordinate of the mouse in the window.
+ * @param y Y-coordinate of the mouse in the window.
+ */
+void MousePressed(int button, int state, int x, int y) {
+    GLfloat origin[3], direction[3];
+    PckHit hit;
+    double start;
+
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN || !pickRay(x, y, origin, direction))
+        return;
+    start = sysNow();
+    if (pckRay(&thePicker, origin, direction, &hit))
+        printf("Pick: row %d, column %d, height %d (%.1f us)\n", viewY0 + hit.row,
+                viewX0 + hit.col, tlmGetSample(&theMap, viewX0 + hit.col, viewY0 + hit.row),
+                1e6 * (sysNow() - start));
+    else
+        printf("Pick: no terrain there\n");
+}
+
 /*
  * Menu callback.
  * @param id Item id.
@@ -521,7 +1444,26 @@ void SelectFromMenu(int id) {
     /* Check item id */
     switch (id) {
         case MENU_EDGE_DETECT:
-            edgeDetect();
+            /* Runs in the background; Idle picks up the results */
+            if (edgeTexId == 0) {
+                glGenTextures(1, &edgeTexId);
+                glBindTexture(GL_TEXTURE_2D, edgeTexId);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            }
+            if (textureLuminance == NULL) {
+                printf("No texture to detect edges in.\n");
+            } else if (startEdgeDetect(textureLuminance, textureWidth, textureHeight) == 0) {
+                showEdges = 1;
+                glutIdleFunc(Idle);
+            } else {
+                printf("Edge detection is already running.\n");
+            }
+            break;
+        case MENU_EDGE_OVERLAY:
+            showEdges = !showEdges;
             break;
         case MENU_EXIT:
             exit(0);
@@ -531,6 +1473,28 @@ void SelectFromMenu(int id) {
     glutPostRedisplay();
 }
 
+/*
+ * Idle callback while edge detection runs: shows each result as it comes
+ * in and unregisters itself after the last one.
+ */
+void Idle() {
+    int done;
+
+    if (pollEdgeDetect(edgeTexId, &done)) {
+        hasEdges = 1;
+        glutPostRedisplay();
+    } else {
+        /* Nothing yet: leave the CPU to the worker */
+#ifdef _WIN32
+        Sleep(5);
+#else
+        usleep(5000);
+#endif
+    }
+    if (done)
+        glutIdleFunc(NULL);
+}
+
 /*
  * Creates the popup menu and its items.
  * @return Id of the popup menu.
@@ -541,6 +1505,7 @@ int BuildPopupMenu() {
     /* Creates the menu */
     menu = glutCreateMenu(SelectFromMenu);
     glutAddMenuEntry("Edge Detect", MENU_EDGE_DETECT);
+    glutAddMenuEntry("Show/Hide Edges", MENU_EDGE_OVERLAY);
     glutAddMenuEntry("Exit", MENU_EXIT);
 
     return menu;
@@ -553,18 +1518,63 @@ int BuildPopupMenu() {
  * @return Status code.
  */
 int main(int argc, char **argv) {
-    /* Initialize the app */
-    initialize();
+    const char *script = NULL, *dumpDir = NULL;
+    int status, missing = 0;
+
+    /* Raw layout of the height map (default: big-endian int32), benchmark
+     * script and frame dump directory, and file (other options are left to
+     * GLUT) */
+    while (argc > 1 && (!strcmp(argv[1], "-f") || !strcmp(argv[1], "-b")
+            || !strcmp(argv[1], "-d"))) {
+        if (argc < 3) {
+            missing = 1;
+            break;
+        }
+        if (!strcmp(argv[1], "-f"))
+            mapFormat = mapParseFormat(argv[2]);
+        else if (!strcmp(argv[1], "-b"))
+            script = argv[2];
+        else
+            dumpDir = argv[2];
+        if (mapFormat < 0)
+            break;
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (mapFormat < 0 || missing || (dumpDir != NULL && script == NULL)) {
+        fprintf(stderr, "usage: %s [-f int32|int16|float32[be|le]] [-b script [-d dir]] [map.raw]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc > 1 && argv[1][0] != '-') {
+        mapFile = argv[1];
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
+    /* Initialize the app: the map, the model and the texture are loaded on
+     * worker threads while the window (or offscreen context) is created */
+    startLoading();
+
+    /* Offscreen benchmark */
+    if (script != NULL) {
+        status = runBenchmark(script, dumpDir);
+        finalize();
+        return status;
+    }
 
     /* Initialization process */
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
     glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     glutCreateWindow("Edge Detect");
-    init("knee.tga");
+    init();
     glutReshapeFunc(ChangeSize);
     glutDisplayFunc(RenderScene);
     glutKeyboardFunc(KeyPressedStd);
+    glutMouseFunc(MousePressed);
     BuildPopupMenu();
     glutAttachMenu(GLUT_RIGHT_BUTTON);
 
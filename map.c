@@ -1,12 +1,19 @@
 /**
  * This module contains functions to create "maps" based on image files. The 
  * information about the map should be stored in a targa file (*.tga).
+ * <p>
+ * Height maps are raw grids of int32, int16 or float32 samples in either
+ * byte order. They are memory mapped and read a tile at a time (see
+ * tilemap.h), each tile converted to host-order ints in a single (SIMD where
+ * available) pass.
  */
 
 #define _MAP_C_
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #ifdef _WIN32
 #include <windows.h>
 #include <GL/gl.h>
@@ -17,6 +24,12 @@
 #include <OpenGL/glu.h>
 #include <Glut/glut.h>
 #endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "mmfile.h"
 #include "map.h"
 
 
@@ -26,60 +39,218 @@
  */
 
 /*
- * Reads raw data into 1d array file. 
- * @param filename TARGA file name.
- * @param size of the entire data set
- * @return 1d array.
+ * Tells whether the host stores ints most significant byte first.
+ * @return 1 on big-endian hosts, 0 otherwise.
  */
-int * mapCreate(char *filename, int nSize) {
+static int hostIsBigEndian() {
+    const int one = 1;
 
-    FILE * rawFile;
-    int * tempData;
-    rawFile = fopen(filename, "r");
-    tempData = (int*) malloc(sizeof (int) * nSize);
+    return *(const unsigned char*) &one == 0;
+}
 
-    if (!rawFile) {
-        printf("File could not be opened.\n");
-        free(tempData);
-        exit(1);
-    }
-    fread(tempData, 4, nSize, rawFile);
-    fclose (rawFile);
-    return tempData;
+/*
+ * Byte-swapping helpers for the scalar path (and the vector tails).
+ */
+static unsigned int swap32(unsigned int v) {
+#if defined(__GNUC__)
+    return __builtin_bswap32(v);
+#else
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+#endif
+}
+
+static unsigned short swap16(unsigned short v) {
+    return (unsigned short) ((v >> 8) | (v << 8));
+}
 
+#if defined(__SSE2__)
+/*
+ * Reverses the bytes of each 32-bit lane.
+ */
+static __m128i swapLanes32(__m128i v) {
+#if defined(__SSSE3__)
+    return _mm_shuffle_epi8(v, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+            4, 5, 6, 7, 0, 1, 2, 3));
+#else
+    /* Swap the 16-bit halves, then the bytes within them */
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+#endif
+}
+
+/*
+ * Reverses the bytes of each 16-bit lane.
+ */
+static __m128i swapLanes16(__m128i v) {
+#if defined(__SSSE3__)
+    return _mm_shuffle_epi8(v, _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9,
+            6, 7, 4, 5, 2, 3, 0, 1));
+#else
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+#endif
 }
+#endif
 
 /*
- * Function to convert data to little endian
- * @param array of data
- * @param size of the array
+ * Converts raw samples to host-order ints in one pass.
+ * @param src Raw samples (any alignment).
+ * @param dst Destination array.
+ * @param n Number of samples.
+ * @param type MAP_INT32, MAP_INT16 or MAP_FLOAT32.
+ * @param swap 1 if the samples are in the opposite byte order.
  */
-void convertLittleEndian(int * data, int size) {
-
-    int i;
-    for (i = 0; i < (size); i++) {
-        int value = data[i];
-        int b0 = (value >> 24) & 0xFF;
-        int b1 = (value >> 16) & 0xFF;
-        int b2 = (value >> 8) & 0xFF;
-        int b3 = value & 0xFF;
-        int actualValue = (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
-        data[i] = actualValue;
+static void convertSamples(const unsigned char *src, int *dst, size_t n, int type, int swap) {
+    size_t i = 0;
+    unsigned int u;
+    unsigned short h;
+    float f;
+
+#if defined(__SSE2__)
+    __m128i v, sign;
+
+    switch (type) {
+        case MAP_INT32:
+            for (; i + 4 <= n; i += 4) {
+                v = _mm_loadu_si128((const __m128i*) (src + 4 * i));
+                _mm_storeu_si128((__m128i*) (dst + i), swap ? swapLanes32(v) : v);
+            }
+            break;
+        case MAP_INT16:
+            for (; i + 8 <= n; i += 8) {
+                v = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+                if (swap)
+                    v = swapLanes16(v);
+                sign = _mm_srai_epi16(v, 15);
+                _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi16(v, sign));
+                _mm_storeu_si128((__m128i*) (dst + i + 4), _mm_unpackhi_epi16(v, sign));
+            }
+            break;
+        case MAP_FLOAT32:
+            for (; i + 4 <= n; i += 4) {
+                v = _mm_loadu_si128((const __m128i*) (src + 4 * i));
+                if (swap)
+                    v = swapLanes32(v);
+                _mm_storeu_si128((__m128i*) (dst + i), _mm_cvtps_epi32(_mm_castsi128_ps(v)));
+            }
+            break;
+    }
+#endif
+
+    /* Scalar path (whole array without SSE2, the tail otherwise) */
+    for (; i < n; i++) {
+        switch (type) {
+            case MAP_INT32:
+                memcpy(&u, src + 4 * i, 4);
+                dst[i] = (int) (swap ? swap32(u) : u);
+                break;
+            case MAP_INT16:
+                memcpy(&h, src + 2 * i, 2);
+                dst[i] = (short) (swap ? swap16(h) : h);
+                break;
+            case MAP_FLOAT32:
+                memcpy(&u, src + 4 * i, 4);
+                u = swap ? swap32(u) : u;
+                memcpy(&f, &u, 4);
+                dst[i] = (int) lrintf(f);
+                break;
+        }
     }
 }
 
+/*
+ * Parses a raw layout name: "int32", "int16" or "float32" followed by "be"
+ * or "le" (e.g. "int16le"). Without a suffix big-endian is assumed.
+ * @param name Layout name.
+ * @return The format (MAP_* type | byte order), -1 if unknown.
+ */
+int mapParseFormat(const char *name) {
+    int type;
+    size_t len;
+
+    if (!strncmp(name, "int32", 5))
+        type = MAP_INT32;
+    else if (!strncmp(name, "int16", 5))
+        type = MAP_INT16;
+    else if (!strncmp(name, "float32", 7))
+        type = MAP_FLOAT32;
+    else
+        return -1;
+    len = type == MAP_FLOAT32 ? 7 : 5;
+    if (name[len] == '\0' || !strcmp(name + len, "be"))
+        return type | MAP_BIG_ENDIAN;
+    if (!strcmp(name + len, "le"))
+        return type | MAP_LITTLE_ENDIAN;
+    return -1;
+}
+
+/*
+ * Size of one raw sample.
+ * @param format The format.
+ * @return Bytes per sample.
+ */
+int mapSampleSize(int format) {
+    return (format & MAP_TYPE_MASK) == MAP_INT16 ? 2 : 4;
+}
+
+/*
+ * Converts raw samples of the given format to host-order ints.
+ * @param src Raw samples (any alignment).
+ * @param dst Destination array.
+ * @param n Number of samples.
+ * @param format Sample type and byte order of the samples.
+ */
+void mapConvert(const void *src, int *dst, size_t n, int format) {
+    int swap = ((format & MAP_BIG_ENDIAN) != 0) != hostIsBigEndian();
 
+    convertSamples((const unsigned char*) src, dst, n, format & MAP_TYPE_MASK, swap);
+}
 
 /*
- * Destroys the map
+ * Finds the dimensions of a raw height map. They are read from the sidecar
+ * file "<filename>.hdr" ("width height") when there is one; otherwise the
+ * map is assumed to be square and its side follows from the file size.
+ * @param filename Raw file name.
+ * @param format Sample type and byte order of the file.
+ * @param width Receives the number of columns.
+ * @param height Receives the number of rows.
+ * @return 0 on success, -1 if the size can't be determined.
  */
-void mapDestroy(int *map, int height) {
+int mapReadSize(const char *filename, int format, int *width, int *height) {
+    FILE *sidecar;
+    char *name;
+    MmFile rawFile;
+    size_t samples;
+    long side;
+    int n = 0;
 
-    /* Deallocate the memory */
-    if (map == NULL)
-        return;
+    name = (char*) malloc(strlen(filename) + 5);
+    sprintf(name, "%s.hdr", filename);
+    sidecar = fopen(name, "r");
+    free(name);
+    if (sidecar != NULL) {
+        n = fscanf(sidecar, "%d %d", width, height);
+        fclose(sidecar);
+        if (n == 2 && *width > 1 && *height > 1)
+            return 0;
+        printf("Bad sidecar header for \"%s\".\n", filename);
+        return -1;
+    }
 
-    free(map);
+    if (mmfOpen(&rawFile, filename) != 0)
+        return -1;
+    samples = rawFile.size / mapSampleSize(format);
+    mmfClose(&rawFile);
+    side = (long) sqrt((double) samples);
+    while (side * side > (long) samples)
+        side--;
+    while ((side + 1) * (side + 1) <= (long) samples)
+        side++;
+    if (side < 2 || (size_t) (side * side) != samples) {
+        printf("\"%s\" is not square; give its size in \"%s.hdr\".\n", filename, filename);
+        return -1;
+    }
+    *width = *height = (int) side;
+    return 0;
 }
 
 /* End of file -------------------------------------------------------------- */
@@ -1,15 +1,38 @@
 /**
  * This module contains functions to create "maps" based on image files. The 
  * information about the map should be stored in a targa file (*.tga).
+ * <p>
+ * Height maps are raw grids of int32, int16 or float32 samples in either
+ * byte order. They are memory mapped and read a tile at a time (see
+ * tilemap.h), each tile converted to host-order ints in a single (SIMD where
+ * available) pass.
  */
 #ifndef _MAP_H_
 #define _MAP_H_
 
+#include <stddef.h>
+
+/*
+ * Definitions
+ */
+
+/* Raw sample types */
+#define MAP_INT32           0x00
+#define MAP_INT16           0x01
+#define MAP_FLOAT32         0x02
+#define MAP_TYPE_MASK       0x0F
+
+/* Byte order of the raw file (or'ed with the sample type) */
+#define MAP_LITTLE_ENDIAN   0x00
+#define MAP_BIG_ENDIAN      0x10
+
 /*
  * Protoypes
  */
-int * mapCreate(char *filename, int nSize);
-void mapDestroy(int *map, int height);
+int mapParseFormat(const char *name);
+int mapSampleSize(int format);
+void mapConvert(const void *src, int *dst, size_t n, int format);
+int mapReadSize(const char *filename, int format, int *width, int *height);
 
 /* End of file -------------------------------------------------------------- */
 #endif
@@ -10,6 +10,16 @@
 
 #include "math3d.h"
 
+/*
+ * The batch functions pick SSE or AVX code at run time (GCC on x86 only)
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define M3D_DISPATCH
+#include <immintrin.h>
+#define M3D_SSE __attribute__((target("sse2")))
+#define M3D_AVX __attribute__((target("avx")))
+#endif
+
 /* 
  * Local defintions
  */
@@ -21,39 +31,6 @@
  * Implementation
  */
 
-/*
- * Initializes the components of the vector as 0s.
- */
-void m3dNullVector2f(M3DVector2f v)
-{
-    v[0] = v[1] = 0.0f;
-}
-
-void m3dNullVector3f(M3DVector3f v)
-{
-    v[0] = v[1] = v[2] = 0.0f;
-}
-
-void m3dNullVector4f(M3DVector4f v)
-{
-    v[0] = v[1] = v[2] = v[3] = 0.0f;
-}
-
-void m3dNullVector2d(M3DVector2d v)
-{
-    v[0] = v[1] = 0.0;
-}
-
-void m3dNullVector3d(M3DVector3d v)
-{
-    v[0] = v[1] = v[2] = 0.0;
-}
-
-void m3dNullVector4d(M3DVector4d v)
-{
-    v[0] = v[1] = v[2] = v[3] = 0.0;
-}
-
 /*
  * Returns the same number if it is a power of two. 
  * Returns a larger integer if it is not a 
@@ -69,322 +46,6 @@ unsigned int m3dIsPOW2(unsigned int iValue)
 	return nPow2;
 }
 
-/* 
- * Load vector with (x, y, z, w).
- */
-void m3dLoadVector2f(M3DVector2f v, float x, float y)
-{
-	v[0] = x; v[1] = y; 
-}
-
-void m3dLoadVector2d(M3DVector2d v, float x, float y)
-{
-	v[0] = x; v[1] = y; 
-}
-
-void m3dLoadVector3f(M3DVector3f v, float x, float y, float z)
-{
-	v[0] = x; v[1] = y; v[2] = z;
-}
-
-void m3dLoadVector3d(M3DVector3d v, double x, double y, double z)
-{
-	v[0] = x; v[1] = y; v[2] = z;
-}
-
-void m3dLoadVector4f(M3DVector4f v, float x, float y, float z, float w)
-{
-	v[0] = x; v[1] = y; v[2] = z; v[3] = w;
-}
-
-void m3dLoadVector4d(M3DVector4d v, double x, double y, double z, double w)
-{
-	v[0] = x; v[1] = y; v[2] = z; v[3] = w;
-}
-
-/*
- * Copy vector src into vector dst.
- */
-void m3dCopyVector2f(M3DVector2f dst, M3DVector2f src)
-{
-	memcpy(dst, src, sizeof(M3DVector2f));
-}
-
-void m3dCopyVector2d(M3DVector2d dst, M3DVector2d src)
-{
-	memcpy(dst, src, sizeof(M3DVector2d));
-}
-
-void m3dCopyVector3f(M3DVector3f dst, M3DVector3f src)
-{
-	memcpy(dst, src, sizeof(M3DVector3f));
-}
-
-void m3dCopyVector3d(M3DVector3d dst, M3DVector3d src)
-{
-	memcpy(dst, src, sizeof(M3DVector3d));
-}
-
-void m3dCopyVector4f(M3DVector4f dst, M3DVector4f src)
-{
-	memcpy(dst, src, sizeof(M3DVector4f));
-}
-
-void m3dCopyVector4d(M3DVector4d dst, M3DVector4d src)
-{
-	memcpy(dst, src, sizeof(M3DVector4d));
-}
-
-/*
- * Add vectors (r, a, b) r = a + b.
- */
-void m3dAddVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; 
-}
-
-void m3dAddVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; 
-}
-
-void m3dAddVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	
-}
-
-void m3dAddVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	
-}
-
-void m3dAddVectors4f(M3DVector4f r, M3DVector4f a, M3DVector4f b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	r[3] = a[3] + b[3];	
-}
-
-void m3dAddVectors4d(M3DVector4d r, M3DVector4d a, M3DVector4d b)
-{
-	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	r[3] = a[3] + b[3];	
-}
-
-/*
- * Subtract vectors (r, a, b) r = a - b.
- */
-void m3dSubtractVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; 
-}
-
-void m3dSubtractVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; 
-}
-
-void m3dSubtractVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	
-}
-
-void m3dSubtractVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	
-}
-
-void m3dSubtractVectors4d(M3DVector4f r, M3DVector4f a, M3DVector4f b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	r[3] = a[3] - b[3];	
-}
-
-void m3dSubtractVectors4f(M3DVector4d r, M3DVector4d a, M3DVector4d b)
-{
-	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	r[3] = a[3] - b[3];	
-}
-
-/*
- * Scale vectors (in place).
- */
-void m3dScaleVector2f(M3DVector2f v, float scale)
-{
-	v[0] *= scale; v[1] *= scale;
-}
-
-void m3dScaleVector2d(M3DVector2d v, double scale)
-{
-	v[0] *= scale; v[1] *= scale;
-}
-
-void m3dScaleVector3f(M3DVector3f v, float scale)
-{
-	v[0] *= scale; v[1] *= scale; v[2] *= scale;
-}
-
-void m3dScaleVector3d(M3DVector3d v, double scale)
-{
-	v[0] *= scale; v[1] *= scale; v[2] *= scale;
-}
-
-void m3dScaleVector4f(M3DVector4f v, float scale)
-{
-	v[0] *= scale; v[1] *= scale; v[2] *= scale; v[3] *= scale;
-}
-
-void m3dScaleVector4d(M3DVector4d v, double scale)
-{
-	v[0] *= scale; v[1] *= scale; v[2] *= scale; v[3] *= scale;
-}
-
-/*
- * Cross product
- * u x v = result
- * We only need one version for floats, and one version for doubles. A 3 component
- * vector fits in a 4 component vector. If  M3DVector4d or M3DVector4f are passed
- * we will be OK because 4th component is not used.
- */
-void m3dCrossProduct3f(M3DVector3f result, M3DVector3f u, M3DVector3f v)
-{
-	result[0] = u[1]*v[2] - v[1]*u[2];
-	result[1] = -u[0]*v[2] + v[0]*u[2];
-	result[2] = u[0]*v[1] - v[0]*u[1];
-}
-
-void m3dCrossProduct3d(M3DVector3d result, M3DVector3d u, M3DVector3d v)
-{
-	result[0] = u[1]*v[2] - v[1]*u[2];
-	result[1] = -u[0]*v[2] + v[0]*u[2];
-	result[2] = u[0]*v[1] - v[0]*u[1];
-}
-
-/*
- * Dot product, only for three component vectors -> return u dot v
- */
-float m3dDotProduct3f(M3DVector3f u, M3DVector3f v)
-{
-	return u[0]*v[0] + u[1]*v[1] + u[2]*v[2]; 
-}
-
-double m3dDotProduct3d(M3DVector3d u, M3DVector3d v)
-{
-	return u[0]*v[0] + u[1]*v[1] + u[2]*v[2]; 
-}
-
-/*
- * Angle between vectors, only for three component vectors. 
- * Angle is in radians...
- */
-float m3dGetAngleBetweenVectors3f(M3DVector3f u, M3DVector3f v)
-{
-    float dTemp = m3dDotProduct3f(u, v);
-    return (float)(acos((double)dTemp));
-}
-
-double m3dGetAngleBetweenVectors3d(M3DVector3d u, M3DVector3d v)
-{
-    double dTemp = m3dDotProduct3d(u, v);
-    return acos(dTemp);
-}
-
-/*
- * Get Square of a vectors length (only for three component vectors)
- */
-float m3dGetVectorLengthSquared3f(M3DVector3f u)
-{
-	return (u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]);
-}
-
-double m3dGetVectorLengthSquared3d(M3DVector3d u)
-{
-	return (u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]);
-}
-
-/*
- * Get lenght of vector.
- */
-float m3dGetVectorLength3f(M3DVector3f u)
-{
-	return (float)(sqrt(m3dGetVectorLengthSquared3f(u)));
-}
-
-double m3dGetVectorLength3d(M3DVector3d u)
-{
-	return sqrt(m3dGetVectorLengthSquared3d(u));
-}
-
-/*
- * Normalize a vector.
- */
-void m3dNormalizeVector3f(M3DVector3f u)
-{
-	m3dScaleVector3f(u, 1.0f / m3dGetVectorLength3f(u));
-}
-
-void m3dNormalizeVector3d(M3DVector3d u)
-{
-	m3dScaleVector3d(u, 1.0 / m3dGetVectorLength3d(u));
-}
-
-/*
- * Get the distance between two points. The distance between two points is just
- * the magnitude of the difference between two vectors
- */
-float m3dGetDistanceSquared3f(M3DVector3f u, M3DVector3f v)
-{
-	float x = u[0] - v[0];
-	x = x*x;
-	
-	float y = u[1] - v[1];
-	y = y*y;
-
-	float z = u[2] - v[2];
-	z = z*z;
-
-	return (x + y + z);
-}
-
-double m3dGetDistanceSquared3d(M3DVector3d u, M3DVector3d v)
-{
-	double x = u[0] - v[0];
-	x = x*x;
-	
-	double y = u[1] - v[1];
-	y = y*y;
-
-	double z = u[2] - v[2];
-	z = z*z;
-
-	return (x + y + z);
-}
-
-float m3dGetDistance3f(M3DVector3f u, M3DVector3f v)
-{
-	return (float)(sqrt(m3dGetDistanceSquared3f(u, v)));
-}
-
-double m3dGetDistance3d(M3DVector3d u, M3DVector3d v)
-{
-	return sqrt(m3dGetDistanceSquared3d(u, v));
-}
-
-float m3dGetMagnitudeSquared3f(M3DVector3f u)
-{
-	return u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
-}
-
-double m3dGetMagnitudeSquared3d(M3DVector3d u)
-{
-	return u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
-}
-
-float m3dGetMagnitude3f(M3DVector3f u)
-{
-	return (float)(sqrt(m3dGetMagnitudeSquared3f(u)));
-}
-
-double m3dGetMagnitude3d(M3DVector3d u)
-{
-	return sqrt(m3dGetMagnitudeSquared3d(u));
-}
-
 /*
  * Copy matrix
  */
@@ -576,9 +237,36 @@ void m3dInjectRotation44d(M3DMatrix44d dst, M3DMatrix33d src)
 /*
  * Multiply two 4x4 matricies
  */
+#ifdef M3D_DISPATCH
+/*
+ * SSE version: each column of the product is the columns of a weighted by
+ * the matching column of b. a is read completely before anything is stored.
+ */
+static M3D_SSE void m3dMatrixMultiply44fSSE(float *product, const float *a, const float *b)
+{
+	__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+	__m128 p;
+	int j;
+	for (j = 0; j < 4; j++) {
+		p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[4 * j])),
+				_mm_mul_ps(a1, _mm_set1_ps(b[4 * j + 1]))),
+				_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[4 * j + 2])),
+				_mm_mul_ps(a3, _mm_set1_ps(b[4 * j + 3]))));
+		_mm_storeu_ps(product + 4 * j, p);
+	}
+}
+#endif
+
 void m3dMatrixMultiply44f(M3DMatrix44f product, M3DMatrix44f a, M3DMatrix44f b )
 {
 	int i;
+#ifdef M3D_DISPATCH
+	if (m3dGetSimdLevel() >= M3D_SIMD_SSE) {
+		m3dMatrixMultiply44fSSE(product, a, b);
+		return;
+	}
+#endif
 	for (i = 0; i < 4; i++) {
 		float ai0=A(i,0),  ai1=A(i,1),  ai2=A(i,2),  ai3=A(i,3);
 		P(i,0) = ai0 * B(0,0) + ai1 * B(1,0) + ai2 * B(2,0) + ai3 * B(3,0);
@@ -1237,60 +925,6 @@ int m3dInvertMatrix44d(M3DMatrix44d dst, M3DMatrix44d src)
 	return 1;
 }
 
-/*
- * Find a normal from three points
- */
-void m3dFindNormal3f(M3DVector3f result, M3DVector3f point1, M3DVector3f point2, M3DVector3f point3)
-{
-	M3DVector3f v1,v2;		// Temporary vectors
-
-	// Calculate two vectors from the three points. Assumes counter clockwise
-	// winding!
-	v1[0] = point1[0] - point2[0];
-	v1[1] = point1[1] - point2[1];
-	v1[2] = point1[2] - point2[2];
-
-	v2[0] = point2[0] - point3[0];
-	v2[1] = point2[1] - point3[1];
-	v2[2] = point2[2] - point3[2];
-
-	// Take the cross product of the two vectors to get
-	// the normal vector.
-	m3dCrossProduct3f(result, v1, v2);	
-}
-
-void m3dFindNormal3d(M3DVector3d result, M3DVector3d point1, M3DVector3d point2, M3DVector3d point3)
-{
-	M3DVector3d v1,v2;		// Temporary vectors
-
-	// Calculate two vectors from the three points. Assumes counter clockwise
-	// winding!
-	v1[0] = point1[0] - point2[0];
-	v1[1] = point1[1] - point2[1];
-	v1[2] = point1[2] - point2[2];
-
-	v2[0] = point2[0] - point3[0];
-	v2[1] = point2[1] - point3[1];
-	v2[2] = point2[2] - point3[2];
-
-	// Take the cross product of the two vectors to get
-	// the normal vector.
-	m3dCrossProduct3d(result, v1, v2);
-}
-
-/*
- * Calculates the signed distance of a point to a plane
- */
-float m3dGetDistanceToPlane3f(M3DVector3f point, M3DVector4f plane)
-{
-	return point[0]*plane[0] + point[1]*plane[1] + point[2]*plane[2] + plane[3];
-}
-
-double m3dGetDistanceToPlane3d(M3DVector3d point, M3DVector4d plane)
-{
-	return point[0]*plane[0] + point[1]*plane[1] + point[2]*plane[2] + plane[3]; 
-}
-
 /*
  * Calculate the plane equation of the plane that the three specified points lay in. The
  * points are given in clockwise winding order, with normal pointing out of clockwise face
@@ -1553,3 +1187,327 @@ double m3dClosestPointOnRay3d(M3DVector3d vPointOnRay, M3DVector3d vRayOrigin, M
 	return m3dGetDistanceSquared3d(vPointOnRay, vPointInSpace);
 }
 
+
+/*
+ * Batch (SoA) operations. Each one has a scalar loop, which also does the
+ * elements left over by the vector loops, and SSE/AVX versions of its body
+ * selected by m3dGetSimdLevel.
+ */
+static int m3dSimdCap = M3D_SIMD_AVX;
+
+/*
+ * Best instruction set the batch functions use on this machine (M3D_SIMD_*).
+ */
+int m3dGetSimdLevel(void)
+{
+#ifdef M3D_DISPATCH
+	int level = __builtin_cpu_supports("avx") ? M3D_SIMD_AVX
+			: __builtin_cpu_supports("sse2") ? M3D_SIMD_SSE : M3D_SIMD_NONE;
+	return level < m3dSimdCap ? level : m3dSimdCap;
+#else
+	return M3D_SIMD_NONE;
+#endif
+}
+
+/*
+ * Caps the instruction set of the batch functions (M3D_SIMD_*), e.g. to
+ * compare them. Call it before the batch functions are used.
+ */
+void m3dSetSimdLevel(int level)
+{
+	m3dSimdCap = level;
+}
+
+#ifdef M3D_DISPATCH
+/*
+ * Vector bodies. Each returns how many elements it did (a multiple of its
+ * width); the caller finishes the rest.
+ */
+static M3D_SSE int m3dTransformVectors3fSSE(float *xo, float *yo, float *zo,
+		const float *x, const float *y, const float *z, int n, const float *m)
+{
+	__m128 vx, vy, vz;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		vx = _mm_loadu_ps(x + i);
+		vy = _mm_loadu_ps(y + i);
+		vz = _mm_loadu_ps(z + i);
+		_mm_storeu_ps(xo + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), vx),
+				_mm_mul_ps(_mm_set1_ps(m[4]), vy)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8]), vz),
+				_mm_set1_ps(m[12]))));
+		_mm_storeu_ps(yo + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[1]), vx),
+				_mm_mul_ps(_mm_set1_ps(m[5]), vy)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[9]), vz),
+				_mm_set1_ps(m[13]))));
+		_mm_storeu_ps(zo + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), vx),
+				_mm_mul_ps(_mm_set1_ps(m[6]), vy)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[10]), vz),
+				_mm_set1_ps(m[14]))));
+	}
+	return i;
+}
+
+static M3D_AVX int m3dTransformVectors3fAVX(float *xo, float *yo, float *zo,
+		const float *x, const float *y, const float *z, int n, const float *m)
+{
+	__m256 vx, vy, vz;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		vx = _mm256_loadu_ps(x + i);
+		vy = _mm256_loadu_ps(y + i);
+		vz = _mm256_loadu_ps(z + i);
+		_mm256_storeu_ps(xo + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0]), vx),
+				_mm256_mul_ps(_mm256_set1_ps(m[4]), vy)), _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[8]), vz),
+				_mm256_set1_ps(m[12]))));
+		_mm256_storeu_ps(yo + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[1]), vx),
+				_mm256_mul_ps(_mm256_set1_ps(m[5]), vy)), _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[9]), vz),
+				_mm256_set1_ps(m[13]))));
+		_mm256_storeu_ps(zo + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2]), vx),
+				_mm256_mul_ps(_mm256_set1_ps(m[6]), vy)), _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[10]), vz),
+				_mm256_set1_ps(m[14]))));
+	}
+	return i;
+}
+
+static M3D_SSE int m3dNormalizeVectors3fSSE(float *x, float *y, float *z, int n)
+{
+	__m128 vx, vy, vz, len, nonzero;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		vx = _mm_loadu_ps(x + i);
+		vy = _mm_loadu_ps(y + i);
+		vz = _mm_loadu_ps(z + i);
+		len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		nonzero = _mm_cmpgt_ps(len, _mm_setzero_ps());
+		/* Zero vectors: divide by 1 */
+		len = _mm_or_ps(_mm_and_ps(nonzero, _mm_sqrt_ps(len)), _mm_andnot_ps(nonzero, _mm_set1_ps(1.0f)));
+		_mm_storeu_ps(x + i, _mm_div_ps(vx, len));
+		_mm_storeu_ps(y + i, _mm_div_ps(vy, len));
+		_mm_storeu_ps(z + i, _mm_div_ps(vz, len));
+	}
+	return i;
+}
+
+static M3D_AVX int m3dNormalizeVectors3fAVX(float *x, float *y, float *z, int n)
+{
+	__m256 vx, vy, vz, len, nonzero;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		vx = _mm256_loadu_ps(x + i);
+		vy = _mm256_loadu_ps(y + i);
+		vz = _mm256_loadu_ps(z + i);
+		len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+		nonzero = _mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_GT_OQ);
+		len = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(len), nonzero);
+		_mm256_storeu_ps(x + i, _mm256_div_ps(vx, len));
+		_mm256_storeu_ps(y + i, _mm256_div_ps(vy, len));
+		_mm256_storeu_ps(z + i, _mm256_div_ps(vz, len));
+	}
+	return i;
+}
+
+static M3D_SSE int m3dCrossProducts3fSSE(float *rx, float *ry, float *rz,
+		const float *ux, const float *uy, const float *uz,
+		const float *vx, const float *vy, const float *vz, int n)
+{
+	__m128 a0, a1, a2, b0, b1, b2;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		a0 = _mm_loadu_ps(ux + i);
+		a1 = _mm_loadu_ps(uy + i);
+		a2 = _mm_loadu_ps(uz + i);
+		b0 = _mm_loadu_ps(vx + i);
+		b1 = _mm_loadu_ps(vy + i);
+		b2 = _mm_loadu_ps(vz + i);
+		_mm_storeu_ps(rx + i, _mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1)));
+		_mm_storeu_ps(ry + i, _mm_sub_ps(_mm_mul_ps(a2, b0), _mm_mul_ps(a0, b2)));
+		_mm_storeu_ps(rz + i, _mm_sub_ps(_mm_mul_ps(a0, b1), _mm_mul_ps(a1, b0)));
+	}
+	return i;
+}
+
+static M3D_AVX int m3dCrossProducts3fAVX(float *rx, float *ry, float *rz,
+		const float *ux, const float *uy, const float *uz,
+		const float *vx, const float *vy, const float *vz, int n)
+{
+	__m256 a0, a1, a2, b0, b1, b2;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		a0 = _mm256_loadu_ps(ux + i);
+		a1 = _mm256_loadu_ps(uy + i);
+		a2 = _mm256_loadu_ps(uz + i);
+		b0 = _mm256_loadu_ps(vx + i);
+		b1 = _mm256_loadu_ps(vy + i);
+		b2 = _mm256_loadu_ps(vz + i);
+		_mm256_storeu_ps(rx + i, _mm256_sub_ps(_mm256_mul_ps(a1, b2), _mm256_mul_ps(a2, b1)));
+		_mm256_storeu_ps(ry + i, _mm256_sub_ps(_mm256_mul_ps(a2, b0), _mm256_mul_ps(a0, b2)));
+		_mm256_storeu_ps(rz + i, _mm256_sub_ps(_mm256_mul_ps(a0, b1), _mm256_mul_ps(a1, b0)));
+	}
+	return i;
+}
+
+static M3D_SSE int m3dFindNormals3fSSE(float *rx, float *ry, float *rz,
+		const float *x1, const float *y1, const float *z1,
+		const float *x2, const float *y2, const float *z2,
+		const float *x3, const float *y3, const float *z3, int n)
+{
+	__m128 a0, a1, a2, b0, b1, b2, p0, p1, p2;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		p0 = _mm_loadu_ps(x2 + i);
+		p1 = _mm_loadu_ps(y2 + i);
+		p2 = _mm_loadu_ps(z2 + i);
+		a0 = _mm_sub_ps(_mm_loadu_ps(x1 + i), p0);
+		a1 = _mm_sub_ps(_mm_loadu_ps(y1 + i), p1);
+		a2 = _mm_sub_ps(_mm_loadu_ps(z1 + i), p2);
+		b0 = _mm_sub_ps(p0, _mm_loadu_ps(x3 + i));
+		b1 = _mm_sub_ps(p1, _mm_loadu_ps(y3 + i));
+		b2 = _mm_sub_ps(p2, _mm_loadu_ps(z3 + i));
+		_mm_storeu_ps(rx + i, _mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1)));
+		_mm_storeu_ps(ry + i, _mm_sub_ps(_mm_mul_ps(a2, b0), _mm_mul_ps(a0, b2)));
+		_mm_storeu_ps(rz + i, _mm_sub_ps(_mm_mul_ps(a0, b1), _mm_mul_ps(a1, b0)));
+	}
+	return i;
+}
+
+static M3D_AVX int m3dFindNormals3fAVX(float *rx, float *ry, float *rz,
+		const float *x1, const float *y1, const float *z1,
+		const float *x2, const float *y2, const float *z2,
+		const float *x3, const float *y3, const float *z3, int n)
+{
+	__m256 a0, a1, a2, b0, b1, b2, p0, p1, p2;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		p0 = _mm256_loadu_ps(x2 + i);
+		p1 = _mm256_loadu_ps(y2 + i);
+		p2 = _mm256_loadu_ps(z2 + i);
+		a0 = _mm256_sub_ps(_mm256_loadu_ps(x1 + i), p0);
+		a1 = _mm256_sub_ps(_mm256_loadu_ps(y1 + i), p1);
+		a2 = _mm256_sub_ps(_mm256_loadu_ps(z1 + i), p2);
+		b0 = _mm256_sub_ps(p0, _mm256_loadu_ps(x3 + i));
+		b1 = _mm256_sub_ps(p1, _mm256_loadu_ps(y3 + i));
+		b2 = _mm256_sub_ps(p2, _mm256_loadu_ps(z3 + i));
+		_mm256_storeu_ps(rx + i, _mm256_sub_ps(_mm256_mul_ps(a1, b2), _mm256_mul_ps(a2, b1)));
+		_mm256_storeu_ps(ry + i, _mm256_sub_ps(_mm256_mul_ps(a2, b0), _mm256_mul_ps(a0, b2)));
+		_mm256_storeu_ps(rz + i, _mm256_sub_ps(_mm256_mul_ps(a0, b1), _mm256_mul_ps(a1, b0)));
+	}
+	return i;
+}
+#endif
+
+/*
+ * Transforms n points (w = 1) by a 4x4 matrix, as m3dTransformVector3f.
+ */
+void m3dTransformVectors3f(float *xOut, float *yOut, float *zOut,
+		const float *x, const float *y, const float *z, int n, M3DMatrix44f m)
+{
+	float vx, vy, vz;
+	int i = 0;
+#ifdef M3D_DISPATCH
+	switch (m3dGetSimdLevel()) {
+		case M3D_SIMD_AVX:
+			i = m3dTransformVectors3fAVX(xOut, yOut, zOut, x, y, z, n, m);
+			break;
+		case M3D_SIMD_SSE:
+			i = m3dTransformVectors3fSSE(xOut, yOut, zOut, x, y, z, n, m);
+			break;
+	}
+#endif
+	for (; i < n; i++) {
+		vx = x[i];
+		vy = y[i];
+		vz = z[i];
+		xOut[i] = (m[0] * vx + m[4] * vy) + (m[8] * vz + m[12]);
+		yOut[i] = (m[1] * vx + m[5] * vy) + (m[9] * vz + m[13]);
+		zOut[i] = (m[2] * vx + m[6] * vy) + (m[10] * vz + m[14]);
+	}
+}
+
+/*
+ * Normalizes n vectors in place. Zero vectors are left as they are.
+ */
+void m3dNormalizeVectors3f(float *x, float *y, float *z, int n)
+{
+	float len;
+	int i = 0;
+#ifdef M3D_DISPATCH
+	switch (m3dGetSimdLevel()) {
+		case M3D_SIMD_AVX:
+			i = m3dNormalizeVectors3fAVX(x, y, z, n);
+			break;
+		case M3D_SIMD_SSE:
+			i = m3dNormalizeVectors3fSSE(x, y, z, n);
+			break;
+	}
+#endif
+	for (; i < n; i++) {
+		len = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+		if (len > 0.0f) {
+			len = sqrtf(len);
+			x[i] /= len;
+			y[i] /= len;
+			z[i] /= len;
+		}
+	}
+}
+
+/*
+ * Cross products of n pairs of vectors (u x v), as m3dCrossProduct3f.
+ */
+void m3dCrossProducts3f(float *rx, float *ry, float *rz,
+		const float *ux, const float *uy, const float *uz,
+		const float *vx, const float *vy, const float *vz, int n)
+{
+	float a0, a1, a2;
+	int i = 0;
+#ifdef M3D_DISPATCH
+	switch (m3dGetSimdLevel()) {
+		case M3D_SIMD_AVX:
+			i = m3dCrossProducts3fAVX(rx, ry, rz, ux, uy, uz, vx, vy, vz, n);
+			break;
+		case M3D_SIMD_SSE:
+			i = m3dCrossProducts3fSSE(rx, ry, rz, ux, uy, uz, vx, vy, vz, n);
+			break;
+	}
+#endif
+	for (; i < n; i++) {
+		a0 = ux[i];
+		a1 = uy[i];
+		a2 = uz[i];
+		rx[i] = a1 * vz[i] - a2 * vy[i];
+		ry[i] = a2 * vx[i] - a0 * vz[i];
+		rz[i] = a0 * vy[i] - a1 * vx[i];
+	}
+}
+
+/*
+ * Normals (not normalized) of n triangles, as m3dFindNormal3f: the cross
+ * product of point1 - point2 and point2 - point3.
+ */
+void m3dFindNormals3f(float *rx, float *ry, float *rz,
+		const float *x1, const float *y1, const float *z1,
+		const float *x2, const float *y2, const float *z2,
+		const float *x3, const float *y3, const float *z3, int n)
+{
+	float a0, a1, a2, b0, b1, b2;
+	int i = 0;
+#ifdef M3D_DISPATCH
+	switch (m3dGetSimdLevel()) {
+		case M3D_SIMD_AVX:
+			i = m3dFindNormals3fAVX(rx, ry, rz, x1, y1, z1, x2, y2, z2, x3, y3, z3, n);
+			break;
+		case M3D_SIMD_SSE:
+			i = m3dFindNormals3fSSE(rx, ry, rz, x1, y1, z1, x2, y2, z2, x3, y3, z3, n);
+			break;
+	}
+#endif
+	for (; i < n; i++) {
+		a0 = x1[i] - x2[i];
+		a1 = y1[i] - y2[i];
+		a2 = z1[i] - z2[i];
+		b0 = x2[i] - x3[i];
+		b1 = y2[i] - y3[i];
+		b2 = z2[i] - z3[i];
+		rx[i] = a1 * b2 - a2 * b1;
+		ry[i] = a2 * b0 - a0 * b2;
+		rz[i] = a0 * b1 - a1 * b0;
+	}
+}
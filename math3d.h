@@ -57,6 +57,13 @@ typedef double M3DMatrix44d[16];	/* A 4 x 4 matrix, column major (doubles) - Ope
 #define M3D_PI_DIV_180 (0.017453292519943296)
 #define M3D_INV_PI_DIV_180 (57.2957795130823229)
 
+/*
+ * Instruction sets the batch (SoA) functions can use, see m3dGetSimdLevel
+ */
+#define M3D_SIMD_NONE 0
+#define M3D_SIMD_SSE 1
+#define M3D_SIMD_AVX 2
+
 /*
  * Useful shortcuts and macros
  */
@@ -79,83 +86,16 @@ typedef double M3DMatrix44d[16];	/* A 4 x 4 matrix, column major (doubles) - Ope
 #define m3dSetVectorZ(v, z)	((v)[2] = (z))
 #define m3dSetVectorW(v, w)	((v)[3] = (w))
 
+/*
+ * Vector operations (inline)
+ */
+#include "math3dinline.h"
+
 /*
  * Prototypes
  */
 unsigned int m3dIsPOW2(unsigned int iValue);
 
-void m3dNullVector2f(M3DVector2f v);
-void m3dNullVector3f(M3DVector3f v);
-void m3dNullVector4f(M3DVector4f v);
-void m3dNullVector2d(M3DVector2d v);
-void m3dNullVector3d(M3DVector3d v);
-void m3dNullVector4d(M3DVector4d v);
-
-void m3dLoadVector2f(M3DVector2f v, float x, float y);
-void m3dLoadVector2d(M3DVector2d v, float x, float y);
-void m3dLoadVector3f(M3DVector3f v, float x, float y, float z);
-void m3dLoadVector3d(M3DVector3d v, double x, double y, double z);
-void m3dLoadVector4f(M3DVector4f v, float x, float y, float z, float w);
-void m3dLoadVector4d(M3DVector4d v, double x, double y, double z, double w);
-
-void m3dCopyVector2f(M3DVector2f dst, M3DVector2f src);
-void m3dCopyVector2d(M3DVector2d dst, M3DVector2d src);
-void m3dCopyVector3f(M3DVector3f dst, M3DVector3f src);
-void m3dCopyVector3d(M3DVector3d dst, M3DVector3d src);
-void m3dCopyVector4f(M3DVector4f dst, M3DVector4f src);
-void m3dCopyVector4d(M3DVector4d dst, M3DVector4d src);
-
-void m3dAddVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b);
-void m3dAddVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b);
-void m3dAddVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b);
-void m3dAddVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b);
-void m3dAddVectors4f(M3DVector4f r, M3DVector4f a, M3DVector4f b);
-void m3dAddVectors4d(M3DVector4d r, M3DVector4d a, M3DVector4d b);
-
-void m3dSubtractVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b);
-void m3dSubtractVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b);
-void m3dSubtractVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b);
-void m3dSubtractVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b);
-void m3dSubtractVectors4d(M3DVector4f r, M3DVector4f a, M3DVector4f b);
-void m3dSubtractVectors4f(M3DVector4d r, M3DVector4d a, M3DVector4d b);
-
-void m3dScaleVector2f(M3DVector2f v, float scale);
-void m3dScaleVector2d(M3DVector2d v, double scale);
-void m3dScaleVector3f(M3DVector3f v, float scale);
-void m3dScaleVector3d(M3DVector3d v, double scale);
-void m3dScaleVector4f(M3DVector4f v, float scale);
-void m3dScaleVector4d(M3DVector4d v, double scale);
-
-void m3dCrossProduct3f(M3DVector3f result, M3DVector3f u, M3DVector3f v);
-void m3dCrossProduct3d(M3DVector3d result, M3DVector3d u, M3DVector3d v);
-
-float m3dDotProduct3f(M3DVector3f u, M3DVector3f v);
-double m3dDotProduct3d(M3DVector3d u, M3DVector3d v);
-
-float m3dGetAngleBetweenVectors3f(M3DVector3f u, M3DVector3f v);
-double m3dGetAngleBetweenVectors3d(M3DVector3d u, M3DVector3d v);
-
-float m3dGetVectorLengthSquared3f(M3DVector3f u);
-double m3dGetVectorLengthSquared3d(M3DVector3d u);
-
-float m3dGetVectorLength3f(M3DVector3f u);
-double m3dGetVectorLength3d(M3DVector3d u);
-
-void m3dNormalizeVector3f(M3DVector3f u);
-void m3dNormalizeVector3d(M3DVector3d u);
-
-float m3dGetDistanceSquared3f(M3DVector3f u, M3DVector3f v);
-double m3dGetDistanceSquared3d(M3DVector3d u, M3DVector3d v);
-
-float m3dGetDistance3f(M3DVector3f u, M3DVector3f v);
-double m3dGetDistance3d(M3DVector3d u, M3DVector3d v);
-
-float m3dGetMagnitudeSquared3f(M3DVector3f u);
-double m3dGetMagnitudeSquared3d(M3DVector3d u);
-
-float m3dGetMagnitude3f(M3DVector3f u);
-double m3dGetMagnitude3d(M3DVector3d u);
-
 void m3dCopyMatrix33f(M3DMatrix33f dst, M3DMatrix33f src);
 void m3dCopyMatrix33d(M3DMatrix33d dst, M3DMatrix33d src);
 void m3dCopyMatrix44f(M3DMatrix44f dst, M3DMatrix44f src);
@@ -228,11 +168,6 @@ int m3dInvertMatrix44f(M3DMatrix44f dst, M3DMatrix44f src);
 int m3dInvertMatrix44d(M3DMatrix44d dst, M3DMatrix44d src);
 
 int m3dInvertMatrix44d(M3DMatrix44d dst, M3DMatrix44d src);
-void m3dFindNormal3f(M3DVector3f result, M3DVector3f point1, M3DVector3f point2, M3DVector3f point3);
-void m3dFindNormal3d(M3DVector3d result, M3DVector3d point1, M3DVector3d point2, M3DVector3d point3);
-
-float m3dGetDistanceToPlane3f(M3DVector3f point, M3DVector4f plane);
-double m3dGetDistanceToPlane3d(M3DVector3d point, M3DVector4d plane);
 
 void m3dGetPlaneEquation4f(M3DVector4f planeEq, M3DVector3f p1, M3DVector3f p2, M3DVector3f p3);
 void m3dGetPlaneEquation4d(M3DVector4d planeEq, M3DVector3d p1, M3DVector3d p2, M3DVector3d p3);
@@ -254,4 +189,23 @@ double m3dClosestPointOnRay3d(M3DVector3d vPointOnRay, M3DVector3d vRayOrigin, M
 
 float m3dDeterminant33f(M3DMatrix33f src);
 
+/*
+ * Batch versions over n vectors stored as separate x, y and z arrays (SoA).
+ * Outputs may be the inputs themselves (in place), but may not overlap them
+ * otherwise.
+ */
+int m3dGetSimdLevel(void);
+void m3dSetSimdLevel(int level);
+
+void m3dTransformVectors3f(float *xOut, float *yOut, float *zOut,
+		const float *x, const float *y, const float *z, int n, M3DMatrix44f m);
+void m3dNormalizeVectors3f(float *x, float *y, float *z, int n);
+void m3dCrossProducts3f(float *rx, float *ry, float *rz,
+		const float *ux, const float *uy, const float *uz,
+		const float *vx, const float *vy, const float *vz, int n);
+void m3dFindNormals3f(float *rx, float *ry, float *rz,
+		const float *x1, const float *y1, const float *z1,
+		const float *x2, const float *y2, const float *z2,
+		const float *x3, const float *y3, const float *z3, int n);
+
 #endif
@@ -0,0 +1,420 @@
+/**
+ * Inline part of the Math3d library: the O(1) vector operations. Outside
+ * math3d.c they are static inline, so loops calling them per vertex compile
+ * to straight-line code; math3d.c compiles the same bodies as the exported
+ * functions, so code that links against them keeps working.
+ * Note: Included by math3d.h, not meant to be included on its own.
+ */
+#ifndef _MATH3DINLINE_H_
+#define _MATH3DINLINE_H_
+
+#ifdef _MATH3D_C_
+#define M3D_INLINE
+#else
+#define M3D_INLINE static __inline
+#endif
+
+/*
+ * Initializes the components of the vector as 0s.
+ */
+M3D_INLINE void m3dNullVector2f(M3DVector2f v)
+{
+    v[0] = v[1] = 0.0f;
+}
+
+M3D_INLINE void m3dNullVector3f(M3DVector3f v)
+{
+    v[0] = v[1] = v[2] = 0.0f;
+}
+
+M3D_INLINE void m3dNullVector4f(M3DVector4f v)
+{
+    v[0] = v[1] = v[2] = v[3] = 0.0f;
+}
+
+M3D_INLINE void m3dNullVector2d(M3DVector2d v)
+{
+    v[0] = v[1] = 0.0;
+}
+
+M3D_INLINE void m3dNullVector3d(M3DVector3d v)
+{
+    v[0] = v[1] = v[2] = 0.0;
+}
+
+M3D_INLINE void m3dNullVector4d(M3DVector4d v)
+{
+    v[0] = v[1] = v[2] = v[3] = 0.0;
+}
+
+/* 
+ * Load vector with (x, y, z, w).
+ */
+M3D_INLINE void m3dLoadVector2f(M3DVector2f v, float x, float y)
+{
+	v[0] = x; v[1] = y; 
+}
+
+M3D_INLINE void m3dLoadVector2d(M3DVector2d v, float x, float y)
+{
+	v[0] = x; v[1] = y; 
+}
+
+M3D_INLINE void m3dLoadVector3f(M3DVector3f v, float x, float y, float z)
+{
+	v[0] = x; v[1] = y; v[2] = z;
+}
+
+M3D_INLINE void m3dLoadVector3d(M3DVector3d v, double x, double y, double z)
+{
+	v[0] = x; v[1] = y; v[2] = z;
+}
+
+M3D_INLINE void m3dLoadVector4f(M3DVector4f v, float x, float y, float z, float w)
+{
+	v[0] = x; v[1] = y; v[2] = z; v[3] = w;
+}
+
+M3D_INLINE void m3dLoadVector4d(M3DVector4d v, double x, double y, double z, double w)
+{
+	v[0] = x; v[1] = y; v[2] = z; v[3] = w;
+}
+
+/*
+ * Copy vector src into vector dst.
+ */
+M3D_INLINE void m3dCopyVector2f(M3DVector2f dst, M3DVector2f src)
+{
+	memcpy(dst, src, sizeof(M3DVector2f));
+}
+
+M3D_INLINE void m3dCopyVector2d(M3DVector2d dst, M3DVector2d src)
+{
+	memcpy(dst, src, sizeof(M3DVector2d));
+}
+
+M3D_INLINE void m3dCopyVector3f(M3DVector3f dst, M3DVector3f src)
+{
+	memcpy(dst, src, sizeof(M3DVector3f));
+}
+
+M3D_INLINE void m3dCopyVector3d(M3DVector3d dst, M3DVector3d src)
+{
+	memcpy(dst, src, sizeof(M3DVector3d));
+}
+
+M3D_INLINE void m3dCopyVector4f(M3DVector4f dst, M3DVector4f src)
+{
+	memcpy(dst, src, sizeof(M3DVector4f));
+}
+
+M3D_INLINE void m3dCopyVector4d(M3DVector4d dst, M3DVector4d src)
+{
+	memcpy(dst, src, sizeof(M3DVector4d));
+}
+
+/*
+ * Add vectors (r, a, b) r = a + b.
+ */
+M3D_INLINE void m3dAddVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; 
+}
+
+M3D_INLINE void m3dAddVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; 
+}
+
+M3D_INLINE void m3dAddVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	
+}
+
+M3D_INLINE void m3dAddVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	
+}
+
+M3D_INLINE void m3dAddVectors4f(M3DVector4f r, M3DVector4f a, M3DVector4f b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	r[3] = a[3] + b[3];	
+}
+
+M3D_INLINE void m3dAddVectors4d(M3DVector4d r, M3DVector4d a, M3DVector4d b)
+{
+	r[0] = a[0] + b[0];	r[1] = a[1] + b[1]; r[2] = a[2] + b[2];	r[3] = a[3] + b[3];	
+}
+
+/*
+ * Subtract vectors (r, a, b) r = a - b.
+ */
+M3D_INLINE void m3dSubtractVectors2f(M3DVector2f r, M3DVector2f a, M3DVector2f b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; 
+}
+
+M3D_INLINE void m3dSubtractVectors2d(M3DVector2d r, M3DVector2d a, M3DVector2d b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; 
+}
+
+M3D_INLINE void m3dSubtractVectors3f(M3DVector3f r, M3DVector3f a, M3DVector3f b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	
+}
+
+M3D_INLINE void m3dSubtractVectors3d(M3DVector3d r, M3DVector3d a, M3DVector3d b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	
+}
+
+M3D_INLINE void m3dSubtractVectors4d(M3DVector4f r, M3DVector4f a, M3DVector4f b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	r[3] = a[3] - b[3];	
+}
+
+M3D_INLINE void m3dSubtractVectors4f(M3DVector4d r, M3DVector4d a, M3DVector4d b)
+{
+	r[0] = a[0] - b[0];	r[1] = a[1] - b[1]; r[2] = a[2] - b[2];	r[3] = a[3] - b[3];	
+}
+
+/*
+ * Scale vectors (in place).
+ */
+M3D_INLINE void m3dScaleVector2f(M3DVector2f v, float scale)
+{
+	v[0] *= scale; v[1] *= scale;
+}
+
+M3D_INLINE void m3dScaleVector2d(M3DVector2d v, double scale)
+{
+	v[0] *= scale; v[1] *= scale;
+}
+
+M3D_INLINE void m3dScaleVector3f(M3DVector3f v, float scale)
+{
+	v[0] *= scale; v[1] *= scale; v[2] *= scale;
+}
+
+M3D_INLINE void m3dScaleVector3d(M3DVector3d v, double scale)
+{
+	v[0] *= scale; v[1] *= scale; v[2] *= scale;
+}
+
+M3D_INLINE void m3dScaleVector4f(M3DVector4f v, float scale)
+{
+	v[0] *= scale; v[1] *= scale; v[2] *= scale; v[3] *= scale;
+}
+
+M3D_INLINE void m3dScaleVector4d(M3DVector4d v, double scale)
+{
+	v[0] *= scale; v[1] *= scale; v[2] *= scale; v[3] *= scale;
+}
+
+/*
+ * Cross product
+ * u x v = result
+ * We only need one version for floats, and one version for doubles. A 3 component
+ * vector fits in a 4 component vector. If  M3DVector4d or M3DVector4f are passed
+ * we will be OK because 4th component is not used.
+ */
+M3D_INLINE void m3dCrossProduct3f(M3DVector3f result, M3DVector3f u, M3DVector3f v)
+{
+	result[0] = u[1]*v[2] - v[1]*u[2];
+	result[1] = -u[0]*v[2] + v[0]*u[2];
+	result[2] = u[0]*v[1] - v[0]*u[1];
+}
+
+M3D_INLINE void m3dCrossProduct3d(M3DVector3d result, M3DVector3d u, M3DVector3d v)
+{
+	result[0] = u[1]*v[2] - v[1]*u[2];
+	result[1] = -u[0]*v[2] + v[0]*u[2];
+	result[2] = u[0]*v[1] - v[0]*u[1];
+}
+
+/*
+ * Dot product, only for three component vectors -> return u dot v
+ */
+M3D_INLINE float m3dDotProduct3f(M3DVector3f u, M3DVector3f v)
+{
+	return u[0]*v[0] + u[1]*v[1] + u[2]*v[2]; 
+}
+
+M3D_INLINE double m3dDotProduct3d(M3DVector3d u, M3DVector3d v)
+{
+	return u[0]*v[0] + u[1]*v[1] + u[2]*v[2]; 
+}
+
+/*
+ * Angle between vectors, only for three component vectors. 
+ * Angle is in radians...
+ */
+M3D_INLINE float m3dGetAngleBetweenVectors3f(M3DVector3f u, M3DVector3f v)
+{
+    float dTemp = m3dDotProduct3f(u, v);
+    return (float)(acos((double)dTemp));
+}
+
+M3D_INLINE double m3dGetAngleBetweenVectors3d(M3DVector3d u, M3DVector3d v)
+{
+    double dTemp = m3dDotProduct3d(u, v);
+    return acos(dTemp);
+}
+
+/*
+ * Get Square of a vectors length (only for three component vectors)
+ */
+M3D_INLINE float m3dGetVectorLengthSquared3f(M3DVector3f u)
+{
+	return (u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]);
+}
+
+M3D_INLINE double m3dGetVectorLengthSquared3d(M3DVector3d u)
+{
+	return (u[0] * u[0]) + (u[1] * u[1]) + (u[2] * u[2]);
+}
+
+/*
+ * Get lenght of vector.
+ */
+M3D_INLINE float m3dGetVectorLength3f(M3DVector3f u)
+{
+	return (float)(sqrt(m3dGetVectorLengthSquared3f(u)));
+}
+
+M3D_INLINE double m3dGetVectorLength3d(M3DVector3d u)
+{
+	return sqrt(m3dGetVectorLengthSquared3d(u));
+}
+
+/*
+ * Normalize a vector.
+ */
+M3D_INLINE void m3dNormalizeVector3f(M3DVector3f u)
+{
+	m3dScaleVector3f(u, 1.0f / m3dGetVectorLength3f(u));
+}
+
+M3D_INLINE void m3dNormalizeVector3d(M3DVector3d u)
+{
+	m3dScaleVector3d(u, 1.0 / m3dGetVectorLength3d(u));
+}
+
+/*
+ * Get the distance between two points. The distance between two points is just
+ * the magnitude of the difference between two vectors
+ */
+M3D_INLINE float m3dGetDistanceSquared3f(M3DVector3f u, M3DVector3f v)
+{
+	float x = u[0] - v[0];
+	x = x*x;
+	
+	float y = u[1] - v[1];
+	y = y*y;
+
+	float z = u[2] - v[2];
+	z = z*z;
+
+	return (x + y + z);
+}
+
+M3D_INLINE double m3dGetDistanceSquared3d(M3DVector3d u, M3DVector3d v)
+{
+	double x = u[0] - v[0];
+	x = x*x;
+	
+	double y = u[1] - v[1];
+	y = y*y;
+
+	double z = u[2] - v[2];
+	z = z*z;
+
+	return (x + y + z);
+}
+
+M3D_INLINE float m3dGetDistance3f(M3DVector3f u, M3DVector3f v)
+{
+	return (float)(sqrt(m3dGetDistanceSquared3f(u, v)));
+}
+
+M3D_INLINE double m3dGetDistance3d(M3DVector3d u, M3DVector3d v)
+{
+	return sqrt(m3dGetDistanceSquared3d(u, v));
+}
+
+M3D_INLINE float m3dGetMagnitudeSquared3f(M3DVector3f u)
+{
+	return u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
+}
+
+M3D_INLINE double m3dGetMagnitudeSquared3d(M3DVector3d u)
+{
+	return u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
+}
+
+M3D_INLINE float m3dGetMagnitude3f(M3DVector3f u)
+{
+	return (float)(sqrt(m3dGetMagnitudeSquared3f(u)));
+}
+
+M3D_INLINE double m3dGetMagnitude3d(M3DVector3d u)
+{
+	return sqrt(m3dGetMagnitudeSquared3d(u));
+}
+
+/*
+ * Find a normal from three points
+ */
+M3D_INLINE void m3dFindNormal3f(M3DVector3f result, M3DVector3f point1, M3DVector3f point2, M3DVector3f point3)
+{
+	M3DVector3f v1,v2;		// Temporary vectors
+
+	// Calculate two vectors from the three points. Assumes counter clockwise
+	// winding!
+	v1[0] = point1[0] - point2[0];
+	v1[1] = point1[1] - point2[1];
+	v1[2] = point1[2] - point2[2];
+
+	v2[0] = point2[0] - point3[0];
+	v2[1] = point2[1] - point3[1];
+	v2[2] = point2[2] - point3[2];
+
+	// Take the cross product of the two vectors to get
+	// the normal vector.
+	m3dCrossProduct3f(result, v1, v2);	
+}
+
+M3D_INLINE void m3dFindNormal3d(M3DVector3d result, M3DVector3d point1, M3DVector3d point2, M3DVector3d point3)
+{
+	M3DVector3d v1,v2;		// Temporary vectors
+
+	// Calculate two vectors from the three points. Assumes counter clockwise
+	// winding!
+	v1[0] = point1[0] - point2[0];
+	v1[1] = point1[1] - point2[1];
+	v1[2] = point1[2] - point2[2];
+
+	v2[0] = point2[0] - point3[0];
+	v2[1] = point2[1] - point3[1];
+	v2[2] = point2[2] - point3[2];
+
+	// Take the cross product of the two vectors to get
+	// the normal vector.
+	m3dCrossProduct3d(result, v1, v2);
+}
+
+/*
+ * Calculates the signed distance of a point to a plane
+ */
+M3D_INLINE float m3dGetDistanceToPlane3f(M3DVector3f point, M3DVector4f plane)
+{
+	return point[0]*plane[0] + point[1]*plane[1] + point[2]*plane[2] + plane[3];
+}
+
+M3D_INLINE double m3dGetDistanceToPlane3d(M3DVector3d point, M3DVector4d plane)
+{
+	return point[0]*plane[0] + point[1]*plane[1] + point[2]*plane[2] + plane[3]; 
+}
+
+#endif
@@ -0,0 +1,202 @@
+/**
+ * mmfile.c - This module contains the definition/implementation of functions
+ * to map whole files read-only into memory.
+ * <p>
+ * Readers built on top of this module hand out pointers straight into the
+ * mapping, so image and volume data is paged in on demand by the OS instead
+ * of being copied through stdio buffers. Callers that know which part of a
+ * file they need next can ask for it ahead of time (mmfPrefetch,
+ * mmfPrefetchFile) or fault it in on a thread of their choosing (mmfLoad).
+ * <p>
+ * Functions that start with 'mmf' are considered as mapped-file functions.
+ */
+#define _MMFILE_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "mmfile.h"
+
+/*
+ * Local definitions
+ */
+#define MMF_PAGE_STRIDE     4096    /* smallest page size we care about */
+
+/*
+ * Functions
+ */
+
+/**
+ * Maps the given file read-only into memory.
+ * @pre Valid file structure (non-null).
+ * @param file Reference to the structure that receives the mapping.
+ * @param filename Name of the file to be mapped.
+ * @return 0 on success, -1 if the file could not be opened or mapped.
+ */
+int mmfOpen(MmFile *file, const char *filename)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapping = NULL;
+    file->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "error: couldn't open \"%s\"!\n", filename);
+        return -1;
+    }
+    if (!GetFileSizeEx(file->file, &size)) {
+        CloseHandle(file->file);
+        return -1;
+    }
+    file->size = (size_t) size.QuadPart;
+
+    /* Empty files can't be mapped, but they are still valid files */
+    if (file->size == 0)
+        return 0;
+
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file->mapping != NULL)
+        file->data = (const unsigned char*) MapViewOfFile(file->mapping,
+            FILE_MAP_READ, 0, 0, 0);
+    if (file->data == NULL) {
+        fprintf(stderr, "error: couldn't map \"%s\"!\n", filename);
+        if (file->mapping != NULL)
+            CloseHandle(file->mapping);
+        CloseHandle(file->file);
+        return -1;
+    }
+    return 0;
+#else
+    struct stat st;
+    void *p;
+
+    file->data = NULL;
+    file->size = 0;
+    file->fd = open(filename, O_RDONLY);
+    if (file->fd < 0) {
+        fprintf(stderr, "error: couldn't open \"%s\"!\n", filename);
+        return -1;
+    }
+    if (fstat(file->fd, &st) != 0) {
+        close(file->fd);
+        return -1;
+    }
+    file->size = (size_t) st.st_size;
+
+    /* Empty files can't be mapped, but they are still valid files */
+    if (file->size == 0)
+        return 0;
+
+    p = mmap(NULL, file->size, PROT_READ, MAP_SHARED, file->fd, 0);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "error: couldn't map \"%s\"!\n", filename);
+        close(file->fd);
+        return -1;
+    }
+    file->data = (const unsigned char*) p;
+    return 0;
+#endif
+}
+
+/**
+ * Unmaps the given file and releases its handles.
+ * @pre File previously opened with mmfOpen.
+ * @param file Reference to the mapped file.
+ */
+void mmfClose(MmFile *file)
+{
+#ifdef _WIN32
+    if (file->data != NULL)
+        UnmapViewOfFile((LPCVOID) file->data);
+    if (file->mapping != NULL)
+        CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    if (file->data != NULL)
+        munmap((void*) file->data, file->size);
+    close(file->fd);
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+/**
+ * Asks the OS to start reading part of a mapping in the background. This
+ * is only a hint: it returns at once and does nothing where the platform
+ * has no read-ahead advice for mappings.
+ * @pre File previously opened with mmfOpen.
+ * @param file Reference to the mapped file.
+ * @param offset First byte wanted.
+ * @param length Number of bytes wanted (clipped to the file).
+ */
+void mmfPrefetch(const MmFile *file, size_t offset, size_t length)
+{
+#ifndef _WIN32
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start;
+
+    if (file->data == NULL || offset >= file->size)
+        return;
+    if (length > file->size - offset)
+        length = file->size - offset;
+
+    /* madvise wants a page-aligned address */
+    start = offset - offset % page;
+    posix_madvise((void*) (file->data + start), length + (offset - start), POSIX_MADV_WILLNEED);
+#endif
+}
+
+/**
+ * Faults part of a mapping in by touching every page of it, so that the
+ * calling thread (and not whoever reads the data later) waits for the disk.
+ * @pre File previously opened with mmfOpen.
+ * @param file Reference to the mapped file.
+ * @param offset First byte wanted.
+ * @param length Number of bytes wanted (clipped to the file).
+ * @return A checksum of the bytes touched (keeps the reads from being
+ * optimized away; not meaningful otherwise).
+ */
+unsigned mmfLoad(const MmFile *file, size_t offset, size_t length)
+{
+    const volatile unsigned char *p;
+    unsigned sum = 0;
+    size_t i;
+
+    if (file->data == NULL || offset >= file->size)
+        return 0;
+    if (length > file->size - offset)
+        length = file->size - offset;
+    p = file->data + offset;
+    for (i = 0; i < length; i += MMF_PAGE_STRIDE)
+        sum += p[i];
+    if (length > 0)
+        sum += p[length - 1];
+    return sum;
+}
+
+/**
+ * Asks the OS to start reading a whole file that has not been opened yet
+ * into the page cache. Like mmfPrefetch this is only a hint.
+ * @param filename Name of the file.
+ */
+void mmfPrefetchFile(const char *filename)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#endif
+}
+
+/* End of file -------------------------------------------------------------- */
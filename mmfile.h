@@ -0,0 +1,61 @@
+/**
+ * mmfile.h - This module contains the definition/implementation of functions
+ * to map whole files read-only into memory.
+ * <p>
+ * Readers built on top of this module hand out pointers straight into the
+ * mapping, so image and volume data is paged in on demand by the OS instead
+ * of being copied through stdio buffers. Callers that know which part of a
+ * file they need next can ask for it ahead of time (mmfPrefetch,
+ * mmfPrefetchFile) or fault it in on a thread of their choosing (mmfLoad).
+ * <p>
+ * Functions that start with 'mmf' are considered as mapped-file functions.
+ */
+#ifndef _MMFILE_H_
+#define _MMFILE_H_
+
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/*
+ * Definitions
+ */
+
+/**
+ * Read-only memory-mapped file.
+ */
+typedef struct
+{
+    /**
+     * First byte of the mapping (NULL for an empty file).
+     */
+    const unsigned char *data;
+
+    /**
+     * Size of the file in bytes.
+     */
+    size_t size;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+} MmFile;
+
+/**
+ * Prototypes
+ */
+int mmfOpen(MmFile *file, const char *filename);
+void mmfClose(MmFile *file);
+
+void mmfPrefetch(const MmFile *file, size_t offset, size_t length);
+unsigned mmfLoad(const MmFile *file, size_t offset, size_t length);
+void mmfPrefetchFile(const char *filename);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * modelcache.c - This module contains the definition/implementation of
+ * functions to keep processed model data in a binary cache file.
+ * <p>
+ * Building the model (converting the heights, computing the normals and the
+ * level-of-detail errors) only depends on the raw samples and a handful of
+ * parameters, so its results are written once and mapped on later runs. A
+ * cache file holds a fixed header, a table of sections and the sections
+ * themselves, page-aligned and in host byte order. The header carries a
+ * 64-bit key (an FNV-1a hash the caller builds with mdcHash over everything
+ * the data was made from); a file with a different magic, version, byte
+ * order or key is treated as missing.
+ * <p>
+ * Functions that start with 'mdc' are considered as model cache functions.
+ */
+#define _MODELCACHE_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modelcache.h"
+
+/*
+ * Local definitions
+ */
+#define _mdcAlign(n, a) (((n) + (a) - 1) / (a) * (a))
+#define MDC_FNV_PRIME   0x100000001B3ULL
+
+/*
+ * Functions
+ */
+
+/**
+ * Continues a 64-bit FNV-1a hash over a block of bytes. Start with
+ * MDC_HASH_SEED.
+ * @param hash Hash of the data so far.
+ * @param data The bytes.
+ * @param size Number of bytes.
+ * @return The updated hash.
+ */
+unsigned long long mdcHash(unsigned long long hash, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char*) data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * MDC_FNV_PRIME;
+    return hash;
+}
+
+/**
+ * Maps a cache file if it was written with the given key.
+ * @pre Valid cache structure (non-null).
+ * @param cache Reference to the structure that receives the cache.
+ * @param filename Name of the cache file.
+ * @param key Key the data must have been written with.
+ * @return 0 on a hit, -1 if the file is missing, stale or damaged.
+ */
+int mdcOpen(MdcFile *cache, const char *filename, unsigned long long key)
+{
+    FILE *fp;
+    const MdcHeader *h;
+    int i;
+
+    /* Don't let mmfOpen complain about a cache that isn't there yet */
+    if ((fp = fopen(filename, "rb")) == NULL)
+        return -1;
+    fclose(fp);
+    if (mmfOpen(&cache->file, filename) != 0)
+        return -1;
+
+    h = cache->header = (const MdcHeader*) cache->file.data;
+    if (cache->file.size < sizeof (MdcHeader) || memcmp(h->magic, MDC_MAGIC, 8) != 0
+            || h->version != MDC_VERSION || h->byteOrder != MDC_BYTE_ORDER || h->key != key
+            || h->sectionCount < 0 || h->sectionCount > MDC_MAX_SECTIONS) {
+        mdcClose(cache);
+        return -1;
+    }
+    for (i = 0; i < h->sectionCount; i++) {
+        if (h->offset[i] < 0 || h->size[i] < 0
+                || (unsigned long long) h->offset[i] + h->size[i] > cache->file.size) {
+            mdcClose(cache);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Unmaps a cache file. Sections handed out before become invalid.
+ * @param cache Reference to the cache.
+ */
+void mdcClose(MdcFile *cache)
+{
+    mmfClose(&cache->file);
+    cache->header = NULL;
+}
+
+/**
+ * Gets a section of a cache file.
+ * @pre Cache opened with mdcOpen.
+ * @param cache Reference to the cache.
+ * @param index Section number.
+ * @param size Size the section must have, in bytes.
+ * @return Pointer into the mapping, NULL if there is no such section.
+ */
+const void* mdcSection(const MdcFile *cache, int index, size_t size)
+{
+    if (index < 0 || index >= cache->header->sectionCount
+            || (unsigned long long) cache->header->size[index] != size)
+        return NULL;
+    return cache->file.data + cache->header->offset[index];
+}
+
+/**
+ * Writes a cache file. The data goes to "<filename>.tmp" first, which then
+ * replaces the file, so readers never map a half-written cache.
+ * @param filename Name of the cache file.
+ * @param key Key of the data.
+ * @param count Number of sections (at most MDC_MAX_SECTIONS).
+ * @param sections The sections.
+ * @param sizes Their sizes in bytes.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int mdcWrite(const char *filename, unsigned long long key, int count,
+        const void **sections, const size_t *sizes)
+{
+    static const char pad[MDC_ALIGNMENT];
+    char *temp = (char*) malloc(strlen(filename) + 5);
+    long long offset = MDC_ALIGNMENT;
+    MdcHeader h;
+    FILE *fp;
+    int i, ok;
+
+    memset(&h, 0, sizeof (MdcHeader));
+    memcpy(h.magic, MDC_MAGIC, 8);
+    h.version = MDC_VERSION;
+    h.byteOrder = MDC_BYTE_ORDER;
+    h.key = key;
+    h.sectionCount = count;
+    for (i = 0; i < count; i++) {
+        h.offset[i] = offset;
+        h.size[i] = sizes[i];
+        offset = _mdcAlign(offset + (long long) sizes[i], MDC_ALIGNMENT);
+    }
+
+    sprintf(temp, "%s.tmp", filename);
+    if ((fp = fopen(temp, "wb")) == NULL) {
+        fprintf(stderr, "error: couldn't open \"%s\" for writing!\n", temp);
+        free(temp);
+        return -1;
+    }
+    ok = fwrite(&h, sizeof (MdcHeader), 1, fp) == 1
+            && fwrite(pad, 1, MDC_ALIGNMENT - sizeof (MdcHeader), fp) == MDC_ALIGNMENT - sizeof (MdcHeader);
+    for (i = 0; ok && i < count; i++) {
+        ok = fwrite(sections[i], 1, sizes[i], fp) == sizes[i];
+        offset = _mdcAlign((long long) sizes[i], MDC_ALIGNMENT) - (long long) sizes[i];
+        ok = ok && fwrite(pad, 1, (size_t) offset, fp) == (size_t) offset;
+    }
+    ok = fclose(fp) == 0 && ok;
+
+    /* Replace the old file (rename doesn't overwrite on Windows) */
+    if (ok) {
+        remove(filename);
+        ok = rename(temp, filename) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "error: couldn't write \"%s\"!\n", filename);
+        remove(temp);
+    }
+    free(temp);
+    return ok ? 0 : -1;
+}
+
+/* End of file -------------------------------------------------------------- */
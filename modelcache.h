@@ -0,0 +1,77 @@
+/**
+ * modelcache.h - This module contains the definition/implementation of
+ * functions to keep processed model data in a binary cache file.
+ * <p>
+ * Building the model (converting the heights, computing the normals and the
+ * level-of-detail errors) only depends on the raw samples and a handful of
+ * parameters, so its results are written once and mapped on later runs. A
+ * cache file holds a fixed header, a table of sections and the sections
+ * themselves, page-aligned and in host byte order. The header carries a
+ * 64-bit key (an FNV-1a hash the caller builds with mdcHash over everything
+ * the data was made from); a file with a different magic, version, byte
+ * order or key is treated as missing.
+ * <p>
+ * Functions that start with 'mdc' are considered as model cache functions.
+ */
+#ifndef _MODELCACHE_H_
+#define _MODELCACHE_H_
+
+#include "mmfile.h"
+
+/*
+ * Definitions
+ */
+#define MDC_MAGIC           "SRMODEL"
+#define MDC_VERSION         1
+#define MDC_BYTE_ORDER      0x01020304
+#define MDC_MAX_SECTIONS    8
+#define MDC_ALIGNMENT       4096
+#define MDC_HASH_SEED       0xCBF29CE484222325ULL
+
+/**
+ * On-disk header.
+ */
+typedef struct
+{
+    char magic[8];
+    int version;
+    int byteOrder;
+    unsigned long long key;
+    int sectionCount;
+    int reserved;
+    long long offset[MDC_MAX_SECTIONS];
+    long long size[MDC_MAX_SECTIONS];
+} MdcHeader;
+
+/**
+ * Mapped cache file.
+ */
+typedef struct
+{
+    /**
+     * The mapped file.
+     */
+    MmFile file;
+
+    /**
+     * The header (points into the mapping).
+     */
+    const MdcHeader *header;
+
+} MdcFile;
+
+/**
+ * Prototypes
+ */
+unsigned long long mdcHash(unsigned long long hash, const void *data, size_t size);
+
+int mdcOpen(MdcFile *cache, const char *filename, unsigned long long key);
+void mdcClose(MdcFile *cache);
+const void* mdcSection(const MdcFile *cache, int index, size_t size);
+
+int mdcWrite(const char *filename, unsigned long long key, int count,
+        const void **sections, const size_t *sizes);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
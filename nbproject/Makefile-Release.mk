@@ -42,7 +42,19 @@ OBJECTFILES= \
 	${OBJECTDIR}/fast_edge.o \
 	${OBJECTDIR}/math3d.o \
 	${OBJECTDIR}/main.o \
-	${OBJECTDIR}/camera.o
+	${OBJECTDIR}/camera.o \
+	${OBJECTDIR}/mmfile.o \
+	${OBJECTDIR}/bqueue.o \
+	${OBJECTDIR}/nifti.o \
+	${OBJECTDIR}/brick.o \
+	${OBJECTDIR}/tilemap.o \
+	${OBJECTDIR}/glproc.o \
+	${OBJECTDIR}/lod.o \
+	${OBJECTDIR}/offscreen.o \
+	${OBJECTDIR}/modelcache.o \
+	${OBJECTDIR}/mailbox.o \
+	${OBJECTDIR}/pick.o \
+	${OBJECTDIR}/sysutil.o
 
 
 # C Compiler Flags
@@ -114,6 +126,66 @@ ${OBJECTDIR}/camera.o: camera.c
 	${RM} $@.d
 	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/camera.o camera.c
 
+${OBJECTDIR}/mmfile.o: mmfile.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/mmfile.o mmfile.c
+
+${OBJECTDIR}/bqueue.o: bqueue.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/bqueue.o bqueue.c
+
+${OBJECTDIR}/nifti.o: nifti.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/nifti.o nifti.c
+
+${OBJECTDIR}/brick.o: brick.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/brick.o brick.c
+
+${OBJECTDIR}/tilemap.o: tilemap.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/tilemap.o tilemap.c
+
+${OBJECTDIR}/glproc.o: glproc.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/glproc.o glproc.c
+
+${OBJECTDIR}/lod.o: lod.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/lod.o lod.c
+
+${OBJECTDIR}/offscreen.o: offscreen.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/offscreen.o offscreen.c
+
+${OBJECTDIR}/modelcache.o: modelcache.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/modelcache.o modelcache.c
+
+${OBJECTDIR}/mailbox.o: mailbox.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/mailbox.o mailbox.c
+
+${OBJECTDIR}/pick.o: pick.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/pick.o pick.c
+
+${OBJECTDIR}/sysutil.o: sysutil.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} $@.d
+	$(COMPILE.c) -O2 -MMD -MP -MF $@.d -o ${OBJECTDIR}/sysutil.o sysutil.c
+
 # Subprojects
 .build-subprojects:
 
@@ -0,0 +1,256 @@
+/**
+ * nifti.c - This module contains the definition/implementation of functions
+ * to read NIfTI-1 volumes (single-file, uncompressed *.nii).
+ * <p>
+ * Opening a volume maps the file and decodes the 348-byte header only; voxel
+ * data is paged in by the OS as slices are touched. Axial slices of 8-bit
+ * volumes are handed out as struct image views straight into the mapping,
+ * 16-bit (signed or unsigned) slices are windowed down to 8 bits on the fly.
+ * <p>
+ * Functions that start with 'nii' are considered as NIfTI-related functions.
+ */
+#define _NIFTI_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nifti.h"
+
+/*
+ * Local definitions (byte offsets of the header fields we use)
+ */
+#define NII_OFS_SIZEOF_HDR  0
+#define NII_OFS_DIM         40
+#define NII_OFS_DATATYPE    70
+#define NII_OFS_BITPIX      72
+#define NII_OFS_PIXDIM      76
+#define NII_OFS_VOX_OFFSET  108
+#define NII_OFS_SCL_SLOPE   112
+#define NII_OFS_SCL_INTER   116
+#define NII_OFS_CAL_MAX     124
+#define NII_OFS_CAL_MIN     128
+#define NII_OFS_MAGIC       344
+
+/*
+ * Helpers to read (possibly byte-swapped) header fields.
+ */
+static unsigned short _niiU16(const unsigned char *p, int swapped)
+{
+    unsigned short v;
+
+    memcpy(&v, p, 2);
+    return swapped ? (unsigned short)((v >> 8) | (v << 8)) : v;
+}
+
+static unsigned int _niiU32(const unsigned char *p, int swapped)
+{
+    unsigned int v;
+
+    memcpy(&v, p, 4);
+    if (swapped)
+        v = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+    return v;
+}
+
+static float _niiF32(const unsigned char *p, int swapped)
+{
+    unsigned int u = _niiU32(p, swapped);
+    float f;
+
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+/*
+ * Functions
+ */
+
+/**
+ * Opens a NIfTI-1 volume. Only the header is decoded; voxel data stays in
+ * the mapping until slices are requested.
+ * @pre Valid volume structure (non-null).
+ * @param vol Reference to the structure that receives the volume.
+ * @param filename Name of the .nii file.
+ * @return 0 on success, -1 on error (reported on stderr).
+ */
+int niiOpen(NiiVolume *vol, const char *filename)
+{
+    const unsigned char *hdr;
+    float voxOffset;
+    size_t need;
+    int i, dims[8], bitpix;
+
+    if (mmfOpen(&vol->file, filename) != 0)
+        return -1;
+    hdr = vol->file.data;
+
+    /* sizeof_hdr doubles as the byte order mark */
+    if (vol->file.size < NII_HEADER_SIZE + 4) {
+        fprintf(stderr, "error: \"%s\" is too short for a NIfTI-1 file!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+    vol->swapped = _niiU32(hdr + NII_OFS_SIZEOF_HDR, 0) != NII_HEADER_SIZE;
+    if (_niiU32(hdr + NII_OFS_SIZEOF_HDR, vol->swapped) != NII_HEADER_SIZE
+            || memcmp(hdr + NII_OFS_MAGIC, "n+1", 4) != 0) {
+        fprintf(stderr, "error: \"%s\" is not a single-file NIfTI-1 volume!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+
+    /* Dimensions */
+    for (i = 0; i < 8; i++)
+        dims[i] = (short) _niiU16(hdr + NII_OFS_DIM + 2 * i, vol->swapped);
+    vol->nx = dims[0] >= 1 ? dims[1] : 0;
+    vol->ny = dims[0] >= 2 ? dims[2] : 1;
+    vol->nz = dims[0] >= 3 ? dims[3] : 1;
+    vol->nt = dims[0] >= 4 ? dims[4] : 1;
+    for (i = 0; i < 3; i++)
+        vol->pixdim[i] = _niiF32(hdr + NII_OFS_PIXDIM + 4 * (i + 1), vol->swapped);
+
+    /* Voxel type */
+    vol->datatype = _niiU16(hdr + NII_OFS_DATATYPE, vol->swapped);
+    bitpix = _niiU16(hdr + NII_OFS_BITPIX, vol->swapped);
+    switch (vol->datatype) {
+        case NII_UINT8:
+            vol->voxelSize = 1;
+            break;
+        case NII_INT16:
+        case NII_UINT16:
+            vol->voxelSize = 2;
+            break;
+        default:
+            fprintf(stderr, "error: unsupported NIfTI datatype %d in \"%s\"!\n",
+                    vol->datatype, filename);
+            mmfClose(&vol->file);
+            return -1;
+    }
+
+    /* Scaling and display window */
+    vol->sclSlope = _niiF32(hdr + NII_OFS_SCL_SLOPE, vol->swapped);
+    vol->sclInter = _niiF32(hdr + NII_OFS_SCL_INTER, vol->swapped);
+    if (vol->sclSlope == 0.0f) {
+        vol->sclSlope = 1.0f;
+        vol->sclInter = 0.0f;
+    }
+    vol->calMax = _niiF32(hdr + NII_OFS_CAL_MAX, vol->swapped);
+    vol->calMin = _niiF32(hdr + NII_OFS_CAL_MIN, vol->swapped);
+
+    /* Voxel data has to fit in the file */
+    voxOffset = _niiF32(hdr + NII_OFS_VOX_OFFSET, vol->swapped);
+    need = (size_t) vol->nx * vol->ny * vol->nz * vol->nt * vol->voxelSize;
+    if (bitpix != 8 * vol->voxelSize || vol->nx <= 0 || vol->ny <= 0 || vol->nz <= 0
+            || vol->nt <= 0 || voxOffset < NII_HEADER_SIZE
+            || (size_t) voxOffset + need > vol->file.size) {
+        fprintf(stderr, "error: corrupt NIfTI header in \"%s\"!\n", filename);
+        mmfClose(&vol->file);
+        return -1;
+    }
+    vol->voxels = vol->file.data + (size_t) voxOffset;
+
+    return 0;
+}
+
+/**
+ * Closes a volume. Slice views handed out before become invalid.
+ * @pre Volume opened with niiOpen.
+ * @param vol Reference to the volume.
+ */
+void niiClose(NiiVolume *vol)
+{
+    mmfClose(&vol->file);
+    vol->voxels = NULL;
+}
+
+/**
+ * Gets the raw voxels of an axial slice (zero-copy, file byte order).
+ * @pre Volume opened with niiOpen.
+ * @param vol Reference to the volume.
+ * @param z Slice index (0..nz-1).
+ * @param t Time point (0..nt-1).
+ * @return Pointer into the mapping, NULL if out of range.
+ */
+const void* niiSliceData(NiiVolume *vol, int z, int t)
+{
+    size_t sliceSize = (size_t) vol->nx * vol->ny * vol->voxelSize;
+
+    if (z < 0 || z >= vol->nz || t < 0 || t >= vol->nt)
+        return NULL;
+    return vol->voxels + ((size_t) t * vol->nz + z) * sliceSize;
+}
+
+/**
+ * Gets an axial slice as an 8-bit image. For 8-bit volumes the image is a
+ * read-only view into the mapping; 16-bit slices are windowed to 0..255
+ * into the caller's buffer, using the header's cal_min/cal_max when set and
+ * the slice's own range otherwise.
+ * @pre Volume opened with niiOpen.
+ * @param vol Reference to the volume.
+ * @param z Slice index (0..nz-1).
+ * @param t Time point (0..nt-1).
+ * @param img Receives the slice.
+ * @param buffer Conversion buffer of at least nx*ny bytes.
+ * @return 1 if img is a view into the mapping, 0 if it was converted into
+ * buffer, -1 if the slice is out of range.
+ */
+int niiGetSlice(NiiVolume *vol, int z, int t, struct image *img, unsigned char *buffer)
+{
+    const unsigned char *src = (const unsigned char*) niiSliceData(vol, z, t);
+    size_t i, n = (size_t) vol->nx * vol->ny;
+    float lo, hi, scale;
+    int v, vmin, vmax;
+
+    if (src == NULL)
+        return -1;
+    img->width = vol->nx;
+    img->height = vol->ny;
+
+    /* 8 bits: nothing to convert */
+    if (vol->datatype == NII_UINT8) {
+        img->pixel_data = (unsigned char*) src;
+        return 1;
+    }
+
+    /* Window, in raw units */
+    if (vol->calMax > vol->calMin) {
+        lo = (vol->calMin - vol->sclInter) / vol->sclSlope;
+        hi = (vol->calMax - vol->sclInter) / vol->sclSlope;
+        if (lo > hi) {
+            scale = lo;
+            lo = hi;
+            hi = scale;
+        }
+    } else {
+        vmin = 65535;
+        vmax = -32768;
+        for (i = 0; i < n; i++) {
+            v = _niiU16(src + 2 * i, vol->swapped);
+            if (vol->datatype == NII_INT16)
+                v = (short) v;
+            if (v < vmin)
+                vmin = v;
+            if (v > vmax)
+                vmax = v;
+        }
+        lo = (float) vmin;
+        hi = (float) vmax;
+    }
+    scale = hi > lo ? 255.0f / (hi - lo) : 0.0f;
+
+    /* Convert */
+    for (i = 0; i < n; i++) {
+        v = _niiU16(src + 2 * i, vol->swapped);
+        if (vol->datatype == NII_INT16)
+            v = (short) v;
+        if (v <= lo)
+            buffer[i] = 0;
+        else if (v >= hi)
+            buffer[i] = 255;
+        else
+            buffer[i] = (unsigned char) ((v - lo) * scale + 0.5f);
+    }
+    img->pixel_data = buffer;
+    return 0;
+}
+
+/* End of file -------------------------------------------------------------- */
@@ -0,0 +1,91 @@
+/**
+ * nifti.h - This module contains the definition/implementation of functions
+ * to read NIfTI-1 volumes (single-file, uncompressed *.nii).
+ * <p>
+ * Opening a volume maps the file and decodes the 348-byte header only; voxel
+ * data is paged in by the OS as slices are touched. Axial slices of 8-bit
+ * volumes are handed out as struct image views straight into the mapping,
+ * 16-bit (signed or unsigned) slices are windowed down to 8 bits on the fly.
+ * <p>
+ * Functions that start with 'nii' are considered as NIfTI-related functions.
+ */
+#ifndef _NIFTI_H_
+#define _NIFTI_H_
+
+#include "mmfile.h"
+#include "imageio.h"
+
+/*
+ * Definitions
+ */
+#define NII_HEADER_SIZE     348
+
+/* Supported NIfTI-1 datatype codes */
+#define NII_UINT8           2
+#define NII_INT16           4
+#define NII_UINT16          512
+
+/**
+ * Mapped NIfTI-1 volume.
+ */
+typedef struct
+{
+    /**
+     * The mapped file.
+     */
+    MmFile file;
+
+    /**
+     * Dimensions (x is the fastest varying one); nt is 1 for 3D volumes.
+     */
+    int nx, ny, nz, nt;
+
+    /**
+     * Voxel size in mm (x, y, z).
+     */
+    float pixdim[3];
+
+    /**
+     * NIfTI datatype code (NII_UINT8, NII_INT16 or NII_UINT16).
+     */
+    int datatype;
+
+    /**
+     * Bytes per voxel.
+     */
+    int voxelSize;
+
+    /**
+     * Voxel value scaling: value = raw * sclSlope + sclInter.
+     */
+    float sclSlope, sclInter;
+
+    /**
+     * Display window (in scaled units); calMin == calMax means none.
+     */
+    float calMin, calMax;
+
+    /**
+     * 1 if the file byte order differs from the host's.
+     */
+    int swapped;
+
+    /**
+     * First voxel in the mapping.
+     */
+    const unsigned char *voxels;
+
+} NiiVolume;
+
+/**
+ * Prototypes
+ */
+int niiOpen(NiiVolume *vol, const char *filename);
+void niiClose(NiiVolume *vol);
+
+const void* niiSliceData(NiiVolume *vol, int z, int t);
+int niiGetSlice(NiiVolume *vol, int z, int t, struct image *img, unsigned char *buffer);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -0,0 +1,229 @@
+/**
+ * offscreen.c - This module contains the definition/implementation of
+ * functions to render without a window.
+ * <p>
+ * An OpenGL context is created through EGL on Mesa's surfaceless platform
+ * (llvmpipe when there is no GPU), and drawing goes to a framebuffer object
+ * of the requested size, since that platform offers no pbuffers. libEGL is
+ * loaded at run time, so the viewer neither links against it nor needs its
+ * headers; where it is missing (or on Windows) ofsCreate just fails.
+ * <p>
+ * Functions that start with 'ofs' are considered as offscreen functions.
+ */
+#define _OFFSCREEN_C_
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+#include "offscreen.h"
+
+#ifndef _WIN32
+
+/*
+ * Local definitions (the subset of EGL and OpenGL 3.0 used here)
+ */
+typedef void *EGLDisplay, *EGLConfig, *EGLContext, *EGLSurface;
+typedef int EGLint;
+typedef unsigned int EGLBoolean, EGLenum, GLenum, GLuint;
+typedef int GLsizei;
+
+#define EGL_NONE                        0x3038
+#define EGL_SURFACE_TYPE                0x3033
+#define EGL_RENDERABLE_TYPE             0x3040
+#define EGL_OPENGL_BIT                  0x0008
+#define EGL_OPENGL_API                  0x30A2
+#define EGL_PLATFORM_SURFACELESS_MESA   0x31DD
+
+#define GL_FRAMEBUFFER                  0x8D40
+#define GL_RENDERBUFFER                 0x8D41
+#define GL_COLOR_ATTACHMENT0            0x8CE0
+#define GL_DEPTH_ATTACHMENT             0x8D00
+#define GL_FRAMEBUFFER_COMPLETE         0x8CD5
+#define GL_RGBA8                        0x8058
+#define GL_DEPTH_COMPONENT24            0x81A6
+
+/*
+ * Local variables
+ */
+static void *_ofsLibrary;
+static EGLDisplay _ofsDisplay;
+static EGLContext _ofsContext;
+static GLuint _ofsFramebuffer, _ofsRenderbuffers[2];
+
+static void* (*_ofsGetProcAddress)(const char *name);
+static EGLBoolean (*_ofsTerminate)(EGLDisplay display);
+static EGLBoolean (*_ofsMakeCurrent)(EGLDisplay display, EGLSurface draw, EGLSurface read,
+        EGLContext context);
+static EGLBoolean (*_ofsDestroyContext)(EGLDisplay display, EGLContext context);
+static void (*_ofsDeleteFramebuffers)(GLsizei n, const GLuint *framebuffers);
+static void (*_ofsDeleteRenderbuffers)(GLsizei n, const GLuint *renderbuffers);
+
+/*
+ * Looks up an EGL function (core ones are exported by the library).
+ */
+static void* _ofsProc(const char *name)
+{
+    void *p = dlsym(_ofsLibrary, name);
+
+    return p != NULL ? p : _ofsGetProcAddress(name);
+}
+
+/*
+ * Creates the surfaceless context and makes it current.
+ * @return 0 on success, -1 on error.
+ */
+static int _ofsCreateContext()
+{
+    EGLDisplay (*getPlatformDisplay)(EGLenum platform, void *nativeDisplay,
+            const EGLint *attributes);
+    EGLBoolean (*initialize)(EGLDisplay display, EGLint *major, EGLint *minor);
+    EGLBoolean (*chooseConfig)(EGLDisplay display, const EGLint *attributes,
+            EGLConfig *configs, EGLint size, EGLint *count);
+    EGLBoolean (*bindAPI)(EGLenum api);
+    EGLContext (*createContext)(EGLDisplay display, EGLConfig config, EGLContext share,
+            const EGLint *attributes);
+    EGLint attributes[] = {EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint major, minor, count = 0;
+
+    if ((_ofsLibrary = dlopen("libEGL.so.1", RTLD_NOW | RTLD_GLOBAL)) == NULL) {
+        printf("Offscreen rendering needs libEGL (%s).\n", dlerror());
+        return -1;
+    }
+    *(void**) &_ofsGetProcAddress = dlsym(_ofsLibrary, "eglGetProcAddress");
+    if (_ofsGetProcAddress == NULL)
+        return -1;
+    *(void**) &getPlatformDisplay = _ofsProc("eglGetPlatformDisplayEXT");
+    *(void**) &initialize = _ofsProc("eglInitialize");
+    *(void**) &chooseConfig = _ofsProc("eglChooseConfig");
+    *(void**) &bindAPI = _ofsProc("eglBindAPI");
+    *(void**) &createContext = _ofsProc("eglCreateContext");
+    *(void**) &_ofsMakeCurrent = _ofsProc("eglMakeCurrent");
+    *(void**) &_ofsDestroyContext = _ofsProc("eglDestroyContext");
+    *(void**) &_ofsTerminate = _ofsProc("eglTerminate");
+    if (getPlatformDisplay == NULL || initialize == NULL || chooseConfig == NULL
+            || bindAPI == NULL || createContext == NULL || _ofsMakeCurrent == NULL
+            || _ofsDestroyContext == NULL || _ofsTerminate == NULL) {
+        printf("Offscreen rendering needs EGL_MESA_platform_surfaceless.\n");
+        return -1;
+    }
+
+    _ofsDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL);
+    if (_ofsDisplay == NULL || !initialize(_ofsDisplay, &major, &minor)) {
+        printf("No surfaceless EGL display.\n");
+        return -1;
+    }
+    if (!chooseConfig(_ofsDisplay, attributes, &config, 1, &count) || count < 1
+            || !bindAPI(EGL_OPENGL_API)
+            || (_ofsContext = createContext(_ofsDisplay, config, NULL, NULL)) == NULL
+            || !_ofsMakeCurrent(_ofsDisplay, NULL, NULL, _ofsContext)) {
+        printf("No offscreen OpenGL context.\n");
+        _ofsTerminate(_ofsDisplay);
+        _ofsContext = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Creates the color/depth framebuffer object and binds it.
+ * @return 0 on success, -1 on error.
+ */
+static int _ofsCreateFramebuffer(int width, int height)
+{
+    void (*genFramebuffers)(GLsizei n, GLuint *framebuffers);
+    void (*bindFramebuffer)(GLenum target, GLuint framebuffer);
+    void (*genRenderbuffers)(GLsizei n, GLuint *renderbuffers);
+    void (*bindRenderbuffer)(GLenum target, GLuint renderbuffer);
+    void (*renderbufferStorage)(GLenum target, GLenum format, GLsizei width, GLsizei height);
+    void (*framebufferRenderbuffer)(GLenum target, GLenum attachment, GLenum renderbufferTarget,
+            GLuint renderbuffer);
+    GLenum (*checkFramebufferStatus)(GLenum target);
+
+    *(void**) &genFramebuffers = _ofsGetProcAddress("glGenFramebuffers");
+    *(void**) &bindFramebuffer = _ofsGetProcAddress("glBindFramebuffer");
+    *(void**) &genRenderbuffers = _ofsGetProcAddress("glGenRenderbuffers");
+    *(void**) &bindRenderbuffer = _ofsGetProcAddress("glBindRenderbuffer");
+    *(void**) &renderbufferStorage = _ofsGetProcAddress("glRenderbufferStorage");
+    *(void**) &framebufferRenderbuffer = _ofsGetProcAddress("glFramebufferRenderbuffer");
+    *(void**) &checkFramebufferStatus = _ofsGetProcAddress("glCheckFramebufferStatus");
+    *(void**) &_ofsDeleteFramebuffers = _ofsGetProcAddress("glDeleteFramebuffers");
+    *(void**) &_ofsDeleteRenderbuffers = _ofsGetProcAddress("glDeleteRenderbuffers");
+    if (genFramebuffers == NULL || bindFramebuffer == NULL || genRenderbuffers == NULL
+            || bindRenderbuffer == NULL || renderbufferStorage == NULL
+            || framebufferRenderbuffer == NULL || checkFramebufferStatus == NULL
+            || _ofsDeleteFramebuffers == NULL || _ofsDeleteRenderbuffers == NULL) {
+        printf("Offscreen rendering needs framebuffer objects.\n");
+        return -1;
+    }
+
+    genFramebuffers(1, &_ofsFramebuffer);
+    bindFramebuffer(GL_FRAMEBUFFER, _ofsFramebuffer);
+    genRenderbuffers(2, _ofsRenderbuffers);
+    bindRenderbuffer(GL_RENDERBUFFER, _ofsRenderbuffers[0]);
+    renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+            _ofsRenderbuffers[0]);
+    bindRenderbuffer(GL_RENDERBUFFER, _ofsRenderbuffers[1]);
+    renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+            _ofsRenderbuffers[1]);
+    if (checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Incomplete %d x %d framebuffer.\n", width, height);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
+
+/*
+ * Functions
+ */
+
+/**
+ * Creates an offscreen OpenGL context with a width x height color and
+ * depth framebuffer, and makes it current. Reads (glReadPixels) come from
+ * that framebuffer.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return 0 on success, -1 on error (reported on stdout).
+ */
+int ofsCreate(int width, int height)
+{
+#ifdef _WIN32
+    printf("Offscreen rendering is not available on Windows.\n");
+    return -1;
+#else
+    if (_ofsCreateContext() != 0)
+        return -1;
+    if (_ofsCreateFramebuffer(width, height) != 0) {
+        ofsDestroy();
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+/**
+ * Destroys the offscreen context and its framebuffer.
+ */
+void ofsDestroy()
+{
+#ifndef _WIN32
+    if (_ofsContext == NULL)
+        return;
+    if (_ofsFramebuffer != 0) {
+        _ofsDeleteFramebuffers(1, &_ofsFramebuffer);
+        _ofsDeleteRenderbuffers(2, _ofsRenderbuffers);
+        _ofsFramebuffer = 0;
+    }
+    _ofsMakeCurrent(_ofsDisplay, NULL, NULL, NULL);
+    _ofsDestroyContext(_ofsDisplay, _ofsContext);
+    _ofsTerminate(_ofsDisplay);
+    _ofsContext = NULL;
+#endif
+}
+
+/* End of file -------------------------------------------------------------- */
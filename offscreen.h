@@ -0,0 +1,24 @@
+/**
+ * offscreen.h - This module contains the definition/implementation of
+ * functions to render without a window.
+ * <p>
+ * An OpenGL context is created through EGL on Mesa's surfaceless platform
+ * (llvmpipe when there is no GPU), and drawing goes to a framebuffer object
+ * of the requested size, since that platform offers no pbuffers. libEGL is
+ * loaded at run time, so the viewer neither links against it nor needs its
+ * headers; where it is missing (or on Windows) ofsCreate just fails.
+ * <p>
+ * Functions that start with 'ofs' are considered as offscreen functions.
+ */
+#ifndef _OFFSCREEN_H_
+#define _OFFSCREEN_H_
+
+/**
+ * Prototypes
+ */
+int ofsCreate(int width, int height);
+void ofsDestroy();
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
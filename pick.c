@@ -0,0 +1,392 @@
+/**
+ * pick.c - This module contains the definition/implementation of functions
+ * to intersect rays with a height field grid (picking).
+ * <p>
+ * Over the grid sits a min/max pyramid: level 0 holds the lowest and the
+ * highest height of each block of PCK_LEAF_SIZE x PCK_LEAF_SIZE quads, and
+ * every level above holds the range of 2 x 2 cells of the level below, up
+ * to a single cell. A ray is marched down the pyramid from the top, nearest
+ * cell first, and only enters the cells whose box (grid extent by height
+ * range) it crosses; the triangles are tested in the level 0 cells it
+ * reaches, and the first hit found is the nearest one. A pick touches a few
+ * dozen cells whatever the size of the grid.
+ * <p>
+ * Functions that start with 'pck' are considered as picking functions.
+ */
+#define _PICK_C_
+
+#include <stdlib.h>
+#include <float.h>
+#include "pick.h"
+
+/*
+ * Local definitions
+ */
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define PCK_EPSILON 1e-12f
+
+/*
+ * A ray in grid space: x and z in columns and rows, y unchanged. The grid
+ * mapping is affine, so t is the same as in model coordinates.
+ */
+typedef struct
+{
+    float o[3], d[3], inv[3];
+} PckRay;
+
+/*
+ * A cell waiting to be visited, with the t at which the ray enters it.
+ */
+typedef struct
+{
+    int level, cx, cy;
+    float t;
+} PckCell;
+
+/*
+ * Clips [t0, t1] to the slab a <= o + t * d <= b.
+ * @return 0 if nothing is left.
+ */
+static int _pckSlab(float o, float d, float inv, float a, float b, float *t0, float *t1)
+{
+    float ta, tb;
+
+    if (d == 0.0f)
+        return o >= a && o <= b;
+    ta = (a - o) * inv;
+    tb = (b - o) * inv;
+    if (ta > tb) {
+        inv = ta;
+        ta = tb;
+        tb = inv;
+    }
+    *t0 = max(*t0, ta);
+    *t1 = min(*t1, tb);
+    return *t0 <= *t1;
+}
+
+/*
+ * Enters a cell: clips the ray to its box.
+ * @return 0 if the ray misses the box, 1 and its entry in *t otherwise.
+ */
+static int _pckEnter(const PckPyramid *pyramid, const PckRay *ray, int level, int cx, int cy,
+        float tMax, float *t)
+{
+    int size = PCK_LEAF_SIZE << level;
+    float t0 = 0.0f, t1 = tMax;
+    int k = cy * pyramid->cellsX[level] + cx;
+
+    if (!_pckSlab(ray->o[0], ray->d[0], ray->inv[0], (float) (cx * size),
+            (float) min((cx + 1) * size, pyramid->width - 1), &t0, &t1))
+        return 0;
+    if (!_pckSlab(ray->o[2], ray->d[2], ray->inv[2], (float) (cy * size),
+            (float) min((cy + 1) * size, pyramid->height - 1), &t0, &t1))
+        return 0;
+    if (!_pckSlab(ray->o[1], ray->d[1], ray->inv[1], pyramid->lo[level][k],
+            pyramid->hi[level][k], &t0, &t1))
+        return 0;
+    *t = t0;
+    return 1;
+}
+
+/*
+ * Intersects the ray with a triangle (either side), as long as the hit is
+ * nearer than *t.
+ * @return 1 if *t was updated.
+ */
+static int _pckTriangle(const PckRay *ray, const float p0[3], const float p1[3],
+        const float p2[3], float *t)
+{
+    float e1[3], e2[3], p[3], q[3], s[3], det, inv, u, v, h;
+
+    e1[0] = p1[0] - p0[0];
+    e1[1] = p1[1] - p0[1];
+    e1[2] = p1[2] - p0[2];
+    e2[0] = p2[0] - p0[0];
+    e2[1] = p2[1] - p0[1];
+    e2[2] = p2[2] - p0[2];
+    p[0] = ray->d[1] * e2[2] - ray->d[2] * e2[1];
+    p[1] = ray->d[2] * e2[0] - ray->d[0] * e2[2];
+    p[2] = ray->d[0] * e2[1] - ray->d[1] * e2[0];
+    det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (det > -PCK_EPSILON && det < PCK_EPSILON)
+        return 0;
+    inv = 1.0f / det;
+    s[0] = ray->o[0] - p0[0];
+    s[1] = ray->o[1] - p0[1];
+    s[2] = ray->o[2] - p0[2];
+    u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0.0f || u > 1.0f)
+        return 0;
+    q[0] = s[1] * e1[2] - s[2] * e1[1];
+    q[1] = s[2] * e1[0] - s[0] * e1[2];
+    q[2] = s[0] * e1[1] - s[1] * e1[0];
+    v = (ray->d[0] * q[0] + ray->d[1] * q[1] + ray->d[2] * q[2]) * inv;
+    if (v < 0.0f || u + v > 1.0f)
+        return 0;
+    h = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+    if (h < 0.0f || h >= *t)
+        return 0;
+    *t = h;
+    return 1;
+}
+
+/*
+ * Tests the triangles of the quads of a level 0 cell.
+ * @return 1 if a hit nearer than *t was found (then in *t).
+ */
+static int _pckLeaf(const PckPyramid *pyramid, const PckRay *ray, int cx, int cy, float *t)
+{
+    int r, c, r1 = min((cy + 1) * PCK_LEAF_SIZE, pyramid->height - 1);
+    int c1 = min((cx + 1) * PCK_LEAF_SIZE, pyramid->width - 1);
+    int row = pyramid->width * pyramid->stride, found = 0;
+    const float *a, *b;
+    float tl[3], tr[3], bl[3], br[3];
+
+    for (r = cy * PCK_LEAF_SIZE; r < r1; r++) {
+        a = pyramid->heights + (size_t) r * row;
+        b = a + row;
+        for (c = cx * PCK_LEAF_SIZE; c < c1; c++) {
+            tl[0] = bl[0] = (float) c;
+            tr[0] = br[0] = (float) (c + 1);
+            tl[2] = tr[2] = (float) r;
+            bl[2] = br[2] = (float) (r + 1);
+            tl[1] = a[c * pyramid->stride];
+            tr[1] = a[(c + 1) * pyramid->stride];
+            bl[1] = b[c * pyramid->stride];
+            br[1] = b[(c + 1) * pyramid->stride];
+            found |= _pckTriangle(ray, tl, bl, tr, t);
+            found |= _pckTriangle(ray, tr, bl, br, t);
+        }
+    }
+    return found;
+}
+
+/*
+ * Functions
+ */
+
+/**
+ * Creates the pyramid of a grid (the heights come with pckUpdate).
+ * @pre Valid pyramid structure (non-null).
+ * @param pyramid Reference to the pyramid.
+ * @param width Number of columns (vertices).
+ * @param height Number of rows (vertices).
+ */
+void pckCreate(PckPyramid *pyramid, int width, int height)
+{
+    size_t total = 0;
+    float *block;
+    int l, w, h;
+
+    pyramid->width = width;
+    pyramid->height = height;
+    pyramid->heights = NULL;
+    pyramid->stride = 1;
+    pyramid->x0 = pyramid->z0 = 0.0f;
+    pyramid->dx = pyramid->dz = 1.0f;
+
+    /* Level 0 cells cover PCK_LEAF_SIZE quads a side, each level above
+     * halves them, up to a single cell */
+    w = max(1, (width - 1 + PCK_LEAF_SIZE - 1) / PCK_LEAF_SIZE);
+    h = max(1, (height - 1 + PCK_LEAF_SIZE - 1) / PCK_LEAF_SIZE);
+    for (l = 0; l < PCK_MAX_LEVELS; l++) {
+        pyramid->cellsX[l] = w;
+        pyramid->cellsY[l] = h;
+        total += (size_t) w * h;
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    pyramid->levels = min(l + 1, PCK_MAX_LEVELS);
+
+    /* All the ranges in one block */
+    block = (float*) malloc(2 * total * sizeof (float));
+    for (l = 0; l < pyramid->levels; l++) {
+        pyramid->lo[l] = block;
+        block += (size_t) pyramid->cellsX[l] * pyramid->cellsY[l];
+        pyramid->hi[l] = block;
+        block += (size_t) pyramid->cellsX[l] * pyramid->cellsY[l];
+    }
+}
+
+/**
+ * Destroys a pyramid.
+ * @param pyramid Reference to the pyramid.
+ */
+void pckDestroy(PckPyramid *pyramid)
+{
+    free(pyramid->lo[0]);
+    pyramid->levels = 0;
+    pyramid->heights = NULL;
+}
+
+/**
+ * Rebuilds the height ranges after the heights (or where they are) changed.
+ * @pre Pyramid created for the size of the grid.
+ * @param pyramid Reference to the pyramid.
+ * @param heights Height of vertex (0, 0); the others follow row by row.
+ * @param stride Floats from one height to the next (1 for a plain array).
+ * @param x0 x of column 0.
+ * @param z0 z of row 0.
+ * @param dx Spacing of the columns (positive).
+ * @param dz Spacing of the rows (positive).
+ */
+void pckUpdate(PckPyramid *pyramid, const float *heights, int stride,
+        float x0, float z0, float dx, float dz)
+{
+    int l, cx, cy, r, c, r1, c1, k, x, y;
+    const float *row;
+    float lo, hi;
+
+    pyramid->heights = heights;
+    pyramid->stride = stride;
+    pyramid->x0 = x0;
+    pyramid->z0 = z0;
+    pyramid->dx = dx;
+    pyramid->dz = dz;
+    if (pyramid->width < 2 || pyramid->height < 2)
+        return;
+
+    /* Level 0: the vertices of each block (shared borders included) */
+    for (cy = 0; cy < pyramid->cellsY[0]; cy++) {
+        r1 = min((cy + 1) * PCK_LEAF_SIZE, pyramid->height - 1);
+        for (cx = 0; cx < pyramid->cellsX[0]; cx++) {
+            c1 = min((cx + 1) * PCK_LEAF_SIZE, pyramid->width - 1);
+            lo = hi = heights[((size_t) cy * PCK_LEAF_SIZE * pyramid->width
+                    + cx * PCK_LEAF_SIZE) * stride];
+            for (r = cy * PCK_LEAF_SIZE; r <= r1; r++) {
+                row = heights + (size_t) r * pyramid->width * stride;
+                for (c = cx * PCK_LEAF_SIZE; c <= c1; c++) {
+                    lo = min(lo, row[c * stride]);
+                    hi = max(hi, row[c * stride]);
+                }
+            }
+            pyramid->lo[0][cy * pyramid->cellsX[0] + cx] = lo;
+            pyramid->hi[0][cy * pyramid->cellsX[0] + cx] = hi;
+        }
+    }
+
+    /* Levels above: the 2 x 2 cells below (fewer at odd edges) */
+    for (l = 1; l < pyramid->levels; l++) {
+        for (cy = 0; cy < pyramid->cellsY[l]; cy++) {
+            for (cx = 0; cx < pyramid->cellsX[l]; cx++) {
+                k = 2 * cy * pyramid->cellsX[l - 1] + 2 * cx;
+                lo = pyramid->lo[l - 1][k];
+                hi = pyramid->hi[l - 1][k];
+                for (y = 2 * cy; y < min(2 * cy + 2, pyramid->cellsY[l - 1]); y++) {
+                    for (x = 2 * cx; x < min(2 * cx + 2, pyramid->cellsX[l - 1]); x++) {
+                        k = y * pyramid->cellsX[l - 1] + x;
+                        lo = min(lo, pyramid->lo[l - 1][k]);
+                        hi = max(hi, pyramid->hi[l - 1][k]);
+                    }
+                }
+                pyramid->lo[l][cy * pyramid->cellsX[l] + cx] = lo;
+                pyramid->hi[l][cy * pyramid->cellsX[l] + cx] = hi;
+            }
+        }
+    }
+}
+
+/**
+ * Finds where a ray first hits the grid.
+ * @pre Pyramid updated with the current heights.
+ * @param pyramid Reference to the pyramid.
+ * @param origin Start of the ray (model coordinates).
+ * @param direction Direction of the ray (any length; t is in its units).
+ * @param hit Receives the hit (t is -1 for a miss).
+ * @return 1 if the ray hits the grid, 0 otherwise.
+ */
+int pckRay(const PckPyramid *pyramid, const float origin[3], const float direction[3],
+        PckHit *hit)
+{
+    PckCell stack[4 * PCK_MAX_LEVELS], child[4], cell;
+    PckRay ray;
+    float t = FLT_MAX, te;
+    int i, j, n, top = 0, x, y, l = pyramid->levels - 1;
+
+    hit->t = -1.0f;
+    if (pyramid->width < 2 || pyramid->height < 2 || pyramid->heights == NULL)
+        return 0;
+
+    /* To grid space */
+    ray.o[0] = (origin[0] - pyramid->x0) / pyramid->dx;
+    ray.o[1] = origin[1];
+    ray.o[2] = (origin[2] - pyramid->z0) / pyramid->dz;
+    ray.d[0] = direction[0] / pyramid->dx;
+    ray.d[1] = direction[1];
+    ray.d[2] = direction[2] / pyramid->dz;
+    for (i = 0; i < 3; i++)
+        ray.inv[i] = ray.d[i] != 0.0f ? 1.0f / ray.d[i] : 0.0f;
+
+    /* Depth first from the top cell, nearest child first: children don't
+     * overlap, so the first leaf with a hit holds the nearest one */
+    if (!_pckEnter(pyramid, &ray, l, 0, 0, FLT_MAX, &te))
+        return 0;
+    stack[top].level = l;
+    stack[top].cx = stack[top].cy = 0;
+    stack[top++].t = te;
+    while (top > 0) {
+        cell = stack[--top];
+        if (cell.level == 0) {
+            if (_pckLeaf(pyramid, &ray, cell.cx, cell.cy, &t))
+                break;
+            continue;
+        }
+
+        /* Children the ray crosses, pushed farthest first */
+        l = cell.level - 1;
+        n = 0;
+        for (y = 2 * cell.cy; y < min(2 * cell.cy + 2, pyramid->cellsY[l]); y++) {
+            for (x = 2 * cell.cx; x < min(2 * cell.cx + 2, pyramid->cellsX[l]); x++) {
+                if (!_pckEnter(pyramid, &ray, l, x, y, FLT_MAX, &te))
+                    continue;
+                for (j = n++; j > 0 && child[j - 1].t < te; j--)
+                    child[j] = child[j - 1];
+                child[j].level = l;
+                child[j].cx = x;
+                child[j].cy = y;
+                child[j].t = te;
+            }
+        }
+        for (j = 0; j < n; j++)
+            stack[top++] = child[j];
+    }
+    if (t == FLT_MAX)
+        return 0;
+
+    /* Hit point, and the vertex nearest to it */
+    hit->t = t;
+    for (i = 0; i < 3; i++)
+        hit->point[i] = origin[i] + t * direction[i];
+    hit->col = max(0, min((int) (ray.o[0] + t * ray.d[0] + 0.5f), pyramid->width - 1));
+    hit->row = max(0, min((int) (ray.o[2] + t * ray.d[2] + 0.5f), pyramid->height - 1));
+    return 1;
+}
+
+/**
+ * Picks with many rays at once (see pckRay).
+ * @param pyramid Reference to the pyramid.
+ * @param count Number of rays.
+ * @param origins Start of each ray (3 floats a ray).
+ * @param directions Direction of each ray (3 floats a ray).
+ * @param hits Receives count hits (t is -1 for the misses).
+ * @return Number of rays that hit the grid.
+ */
+int pckRays(const PckPyramid *pyramid, int count, const float *origins,
+        const float *directions, PckHit *hits)
+{
+    int i, n = 0;
+
+    for (i = 0; i < count; i++)
+        n += pckRay(pyramid, origins + 3 * i, directions + 3 * i, &hits[i]);
+    return n;
+}
+
+/* End of file -------------------------------------------------------------- */
@@ -0,0 +1,89 @@
+/**
+ * pick.h - This module contains the definition/implementation of functions
+ * to intersect rays with a height field grid (picking).
+ * <p>
+ * Over the grid sits a min/max pyramid: level 0 holds the lowest and the
+ * highest height of each block of PCK_LEAF_SIZE x PCK_LEAF_SIZE quads, and
+ * every level above holds the range of 2 x 2 cells of the level below, up
+ * to a single cell. A ray is marched down the pyramid from the top, nearest
+ * cell first, and only enters the cells whose box (grid extent by height
+ * range) it crosses; the triangles are tested in the level 0 cells it
+ * reaches, and the first hit found is the nearest one. A pick touches a few
+ * dozen cells whatever the size of the grid.
+ * <p>
+ * The triangles are the ones the model draws: quad (row, col) is split
+ * into (row, col), (row + 1, col), (row, col + 1) and (row, col + 1),
+ * (row + 1, col), (row + 1, col + 1).
+ * <p>
+ * Functions that start with 'pck' are considered as picking functions.
+ */
+#ifndef _PICK_H_
+#define _PICK_H_
+
+/*
+ * Definitions
+ */
+#define PCK_MAX_LEVELS      24
+#define PCK_LEAF_SIZE       2   /* quads per side of a level 0 cell */
+
+/**
+ * Min/max pyramid over a height field grid.
+ */
+typedef struct
+{
+    /**
+     * Grid size in vertices.
+     */
+    int width, height;
+
+    /**
+     * Heights of the grid (row major, stride floats apart), and the x/z
+     * position of vertex (0, 0) and the spacing of the columns and rows.
+     * The heights are read again by the picks, so they must stay valid.
+     */
+    const float *heights;
+    int stride;
+    float x0, z0, dx, dz;
+
+    /**
+     * Number of levels, cells of each level (across and down) and their
+     * height ranges (row major).
+     */
+    int levels;
+    int cellsX[PCK_MAX_LEVELS], cellsY[PCK_MAX_LEVELS];
+    float *lo[PCK_MAX_LEVELS], *hi[PCK_MAX_LEVELS];
+
+} PckPyramid;
+
+/**
+ * Result of a pick.
+ */
+typedef struct
+{
+    /**
+     * Ray parameter of the hit (origin + t * direction, -1 for a miss),
+     * point hit, and the grid vertex (row, column) nearest to it.
+     */
+    float t;
+    float point[3];
+    int row, col;
+
+} PckHit;
+
+/**
+ * Prototypes
+ */
+void pckCreate(PckPyramid *pyramid, int width, int height);
+void pckDestroy(PckPyramid *pyramid);
+
+void pckUpdate(PckPyramid *pyramid, const float *heights, int stride,
+        float x0, float z0, float dx, float dz);
+
+int pckRay(const PckPyramid *pyramid, const float origin[3], const float direction[3],
+        PckHit *hit);
+int pckRays(const PckPyramid *pyramid, int count, const float *origins,
+        const float *directions, PckHit *hits);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * sysutil.c - This module contains the definition/implementation of small
+ * system helpers shared by the viewer and the headless tools: a monotonic
+ * clock, the number of processors and a qsort callback for the latency
+ * reports.
+ * <p>
+ * Functions that start with 'sys' are considered as system functions.
+ */
+#define _SYSUTIL_C_
+
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "sysutil.h"
+
+/*
+ * Functions
+ */
+
+/**
+ * Monotonic wall clock.
+ * @return Time in seconds.
+ */
+double sysNow()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Number of online processors.
+ * @return Number of processors (at least 1).
+ */
+int sysProcessorCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (int) n : 1;
+#endif
+}
+
+/**
+ * Compares two doubles (qsort callback, ascending).
+ * @param a Reference to the first double.
+ * @param b Reference to the second double.
+ * @return -1, 0 or 1.
+ */
+int sysCompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* End of file -------------------------------------------------------------- */
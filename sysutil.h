@@ -0,0 +1,21 @@
+/**
+ * sysutil.h - This module contains the definition/implementation of small
+ * system helpers shared by the viewer and the headless tools: a monotonic
+ * clock, the number of processors and a qsort callback for the latency
+ * reports.
+ * <p>
+ * Functions that start with 'sys' are considered as system functions.
+ */
+#ifndef _SYSUTIL_H_
+#define _SYSUTIL_H_
+
+/**
+ * Prototypes
+ */
+double sysNow();
+int sysProcessorCount();
+int sysCompareDoubles(const void *a, const void *b);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
@@ -1,7 +1,10 @@
 #include <GL/glut.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "tgaMagic.h"
+#include "mailbox.h"
 #include "imageio.h"
 #include "fast_edge.h"
 
@@ -314,6 +317,7 @@ gl_texture_t * ReadTGAFile(const char *filename) {
 
     texinfo = (gl_texture_t *) malloc(sizeof (gl_texture_t));
     GetTextureInfo(&header, texinfo);
+    texinfo->levels = 1;
     fseek(fp, header.id_length, SEEK_CUR);
 
     /* memory allocation */
@@ -420,11 +424,68 @@ gl_texture_t * ReadTGAFile(const char *filename) {
     return texinfo;
 }
 
-GLuint loadTGATexture(const char *filename) {
-    gl_texture_t *tga_tex = NULL;
-    GLuint tex_id = 0;
+/*
+ * Appends the mipmap chain (2x2 box filter, down to 1x1) to the texels of
+ * a power of two sized texture. Needs no GL context, so it can run on a
+ * loader thread; other sizes are left to gluBuild2DMipmaps at upload time.
+ */
+void BuildTGAMipmaps(gl_texture_t *texinfo) {
+    GLsizei w = texinfo->width, h = texinfo->height, w2, h2;
+    int n = texinfo->internalFormat;
+    int levels = 1, level, x, y, c, x0, x1, y0, y1;
+    size_t size = (size_t) w * h * n;
+    GLubyte *texels, *src, *dst;
+
+    if (w <= 0 || h <= 0 || (w & (w - 1)) != 0 || (h & (h - 1)) != 0)
+        return;
+
+    /* Size of the whole chain */
+    for (w2 = w, h2 = h; w2 > 1 || h2 > 1; levels++) {
+        w2 = w2 > 1 ? w2 / 2 : 1;
+        h2 = h2 > 1 ? h2 / 2 : 1;
+        size += (size_t) w2 * h2 * n;
+    }
+    texels = (GLubyte *) realloc(texinfo->texels, size);
+    if (!texels)
+        return;
+    texinfo->texels = texels;
+
+    /* Each level averages 2x2 texels of the one before */
+    src = texels;
+    for (level = 1; level < levels; level++) {
+        w2 = w > 1 ? w / 2 : 1;
+        h2 = h > 1 ? h / 2 : 1;
+        dst = src + (size_t) w * h * n;
+        for (y = 0; y < h2; ++y) {
+            y0 = (2 * y) * w;
+            y1 = h > 1 ? y0 + w : y0;
+            for (x = 0; x < w2; ++x) {
+                x0 = 2 * x;
+                x1 = w > 1 ? x0 + 1 : x0;
+                for (c = 0; c < n; ++c) {
+                    dst[(y * w2 + x) * n + c] = (GLubyte) ((src[(y0 + x0) * n + c]
+                            + src[(y0 + x1) * n + c] + src[(y1 + x0) * n + c]
+                            + src[(y1 + x1) * n + c] + 2) / 4);
+                }
+            }
+        }
+        src = dst;
+        w = w2;
+        h = h2;
+    }
+    texinfo->levels = levels;
+}
 
-    tga_tex = ReadTGAFile(filename);
+/*
+ * Creates a GL texture from a decoded TGA file (and its mipmaps, if
+ * BuildTGAMipmaps made them) and frees the decoded data.
+ * @return The texture id, 0 if there is no texture.
+ */
+GLuint UploadTGATexture(gl_texture_t *tga_tex) {
+    GLuint tex_id = 0;
+    GLsizei w, h;
+    GLubyte *level;
+    int i;
 
     if (tga_tex && tga_tex->texels) {
         /* generate texture */
@@ -446,16 +507,31 @@ GLuint loadTGATexture(const char *filename) {
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
+        if (tga_tex->levels > 1) {
+            /* mipmaps built beforehand: rows of the small levels are
+             * tightly packed */
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            level = tga_tex->texels;
+            w = tga_tex->width;
+            h = tga_tex->height;
+            for (i = 0; i < tga_tex->levels; ++i) {
+                glTexImage2D(GL_TEXTURE_2D, i, tga_tex->internalFormat, w, h, 0,
+                        tga_tex->format, GL_UNSIGNED_BYTE, level);
+                level += (size_t) w * h * tga_tex->internalFormat;
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, tga_tex->internalFormat,
+                    tga_tex->width, tga_tex->height, 0, tga_tex->format,
+                    GL_UNSIGNED_BYTE, tga_tex->texels);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, tga_tex->internalFormat,
-                tga_tex->width, tga_tex->height, 0, tga_tex->format,
-                GL_UNSIGNED_BYTE, tga_tex->texels);
-
-
-        gluBuild2DMipmaps(GL_TEXTURE_2D, tga_tex->internalFormat,
-                tga_tex->width, tga_tex->height,
-                tga_tex->format, GL_UNSIGNED_BYTE, tga_tex->texels);
 
+            gluBuild2DMipmaps(GL_TEXTURE_2D, tga_tex->internalFormat,
+                    tga_tex->width, tga_tex->height,
+                    tga_tex->format, GL_UNSIGNED_BYTE, tga_tex->texels);
+        }
 
         tex_id = tga_tex->id;
 
@@ -467,52 +543,198 @@ GLuint loadTGATexture(const char *filename) {
     return tex_id;
 }
 
-void edgeDetect() {
+GLuint loadTGATexture(const char *filename) {
+    gl_texture_t *tga_tex = ReadTGAFile(filename);
 
-    int i;
-    int j = 0;
-    GLint texWidth = 0;
-    GLint texHeight = 0;
+    if (tga_tex)
+        BuildTGAMipmaps(tga_tex);
+    return UploadTGATexture(tga_tex);
+}
+
+/*
+ * Edge map of a grayscale image: gaussian noise reduction, then canny. Needs
+ * no GL context.
+ * @param gray width x height luminance values.
+ * @return width x height edge values (malloc'd), NULL if out of memory.
+ */
+unsigned char * detectEdges(unsigned char *gray, int width, int height) {
     struct image img_in, img_gauss, img_out;
+    size_t size = (size_t) width * height;
+
+    img_in.width = img_gauss.width = img_out.width = width;
+    img_in.height = img_gauss.height = img_out.height = height;
+    img_in.pixel_data = gray;
+    img_gauss.pixel_data = malloc(size);
+    img_out.pixel_data = malloc(size);
+    if (!img_gauss.pixel_data || !img_out.pixel_data) {
+        free(img_gauss.pixel_data);
+        free(img_out.pixel_data);
+        return NULL;
+    }
 
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texWidth);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texHeight);
+    gaussian_noise_reduce(&img_in, &img_gauss);
+    canny_edge_detect(&img_gauss, &img_out);
 
-    GLubyte *img = (GLubyte *) malloc((texWidth * texHeight * 4) * sizeof (GLubyte));
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, img);
+    free(img_gauss.pixel_data);
+    return img_out.pixel_data;
+}
 
-    img_in.width = texWidth;
-    img_in.height = texHeight;
-    unsigned char *img_data = malloc(texWidth * texHeight * sizeof (char));
+/*
+ * Luminance of a decoded TGA file (0.3 R + 0.59 G + 0.11 B for color), the
+ * image edges are detected in. Needs no GL context.
+ * @return width x height values (malloc'd), NULL if out of memory.
+ */
+unsigned char * GetTextureLuminance(gl_texture_t *texinfo) {
+    size_t i, n = (size_t) texinfo->width * texinfo->height;
+    int bpp = texinfo->internalFormat;
+    unsigned char *gray = malloc(n);
+    const GLubyte *p = texinfo->texels;
+
+    if (!gray)
+        return NULL;
+    for (i = 0; i < n; ++i, p += bpp) {
+        if (bpp >= 3)
+            gray[i] = p[0] * 0.3 + p[1] * 0.59 + p[2] * 0.11;
+        else
+            gray[i] = p[0];
+    }
+    return gray;
+}
 
-    for (i = 0; i < texWidth * texHeight * 4 - 4; i = i + 4) {
-        img_data[j] = img[i]*0.3 + img[i + 1]*0.59 + img[i + 2]*0.11;
-        j++;
+/*
+ * Edge detection in the background: detection runs on a worker, and its
+ * results (first an edge map detected at half resolution, then the real
+ * thing) come back through a mailbox that pollEdgeDetect empties on the GL
+ * thread into a single-channel (GL_LUMINANCE) texture. Nothing is read
+ * back from the GL.
+ */
+typedef struct {
+    int width, height;
+    unsigned char *edges;       /* width x height edge values */
+} edge_result_t;
+
+static Mailbox edgeMailbox;
+static pthread_t edgeWorker;
+static int edgeRunning = 0;
+static int edgeFinished;        /* set by the worker after its last post */
+static const unsigned char *edgeSource;
+static int edgeWidth, edgeHeight;
+
+/*
+ * Hands an edge map to the GL thread, dropping the one it replaces.
+ */
+static void edgePost(unsigned char *edges, int width, int height) {
+    edge_result_t *result, *old;
+
+    if (!edges)
+        return;
+    result = (edge_result_t *) malloc(sizeof (edge_result_t));
+    if (!result) {
+        free(edges);
+        return;
+    }
+    result->width = width;
+    result->height = height;
+    result->edges = edges;
+    old = (edge_result_t *) mbxPost(&edgeMailbox, result);
+    if (old) {
+        free(old->edges);
+        free(old);
     }
+}
 
-    img_in.pixel_data = img_data;
-    img_out.width = img_gauss.width = texWidth;
-    img_out.height = img_gauss.height = texHeight;
-    unsigned char *img_gauss_data = malloc(texWidth * texHeight * sizeof (char));
-    img_gauss.pixel_data = img_gauss_data;
-    unsigned char *img_out_data = malloc(texWidth * texHeight * sizeof (char));
-    img_out.pixel_data = img_out_data;
-    printf("*** image struct initialized ***\n");
-    printf("*** performing gaussian noise reduction ***\n");
-    gaussian_noise_reduce(&img_in, &img_gauss);
-    canny_edge_detect(&img_gauss, &img_out);
-    write_pgm_image(&img_out);
+/*
+ * Worker: detects the edges of the source at half and at full resolution.
+ */
+static void * edgeWorkerMain(void *arg) {
+    int x, y, w = edgeWidth, h = edgeHeight, hw = w / 2, hh = h / 2;
+    unsigned char *half = NULL, *edges;
+    struct image img_out;
+    const unsigned char *p;
+
+    /* Preview: 2x2 averaged copy */
+    if (hw >= 3 && hh >= 3)
+        half = malloc((size_t) hw * hh);
+    if (half) {
+        for (y = 0; y < hh; ++y) {
+            for (x = 0; x < hw; ++x) {
+                p = edgeSource + 2 * y * w + 2 * x;
+                half[y * hw + x] = (p[0] + p[1] + p[w] + p[w + 1] + 2) / 4;
+            }
+        }
+        edgePost(detectEdges(half, hw, hh), hw, hh);
+        free(half);
+    }
 
-    j = 0;
-    for (i = 0; i < texWidth * texHeight * 4 - 4; i = i + 4) {
-        img[i] = img[i + 1] = img[i + 2] = img_out.pixel_data[j];
-        j++;
+    /* Full resolution (the pipeline doesn't write to its input) */
+    edges = detectEdges((unsigned char *) edgeSource, w, h);
+    if (edges) {
+        img_out.width = w;
+        img_out.height = h;
+        img_out.pixel_data = edges;
+        write_pgm_image(&img_out);
     }
+    edgePost(edges, w, h);
+    __atomic_store_n(&edgeFinished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
 
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, GL_RGBA, GL_UNSIGNED_BYTE, img);
+/*
+ * Starts detecting the edges of an image in the background. Call
+ * pollEdgeDetect (from the GL thread) until it reports it is done.
+ * @param gray width x height luminance values, left untouched until then.
+ * @return 0 if started, -1 if a detection is still running or on error.
+ */
+int startEdgeDetect(const unsigned char *gray, int width, int height) {
+    if (edgeRunning || width <= 0 || height <= 0)
+        return -1;
+    edgeSource = gray;
+    edgeWidth = width;
+    edgeHeight = height;
+    edgeFinished = 0;
+    mbxInit(&edgeMailbox);
+    if (pthread_create(&edgeWorker, NULL, edgeWorkerMain, NULL) != 0)
+        return -1;
+    edgeRunning = 1;
+    return 0;
+}
 
-    free(img);
-    free(img_data);
-    free(img_gauss_data);
-    free(img_out_data);
+/*
+ * Uploads the latest result of the background detection, if there is one,
+ * to a single-channel texture. Doesn't block.
+ * @param texture The edge texture (resized to the result).
+ * @param done Set to 1 once the full resolution result is in (or nothing
+ * is running), 0 otherwise.
+ * @return 1 if the texture changed, 0 otherwise.
+ */
+int pollEdgeDetect(GLuint texture, int *done) {
+    edge_result_t *result;
+    GLint bound = 0;
+    int finished;
+
+    *done = !edgeRunning;
+    if (!edgeRunning)
+        return 0;
+
+    /* Checked first: once the worker is finished, its last result is in */
+    finished = __atomic_load_n(&edgeFinished, __ATOMIC_ACQUIRE);
+    result = (edge_result_t *) mbxTake(&edgeMailbox);
+    if (finished) {
+        pthread_join(edgeWorker, NULL);
+        edgeRunning = 0;
+        *done = 1;
+    }
+    if (!result)
+        return 0;
+
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, result->width, result->height, 0,
+            GL_LUMINANCE, GL_UNSIGNED_BYTE, result->edges);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, bound);
+    free(result->edges);
+    free(result);
+    return 1;
 }
@@ -46,6 +46,9 @@ typedef struct
 
   GLubyte *texels;
 
+  /* number of mipmap levels in texels (1 if only the image itself) */
+  GLint levels;
+
 } gl_texture_t;
 
 #pragma pack(push, 1)
@@ -92,8 +95,13 @@ void ReadTGA32bitsRLE (FILE *fp, gl_texture_t *texinfo);
 void ReadTGAgray8bitsRLE (FILE *fp, gl_texture_t *texinfo);
 void ReadTGAgray16bitsRLE (FILE *fp, gl_texture_t *texinfo);
 gl_texture_t * ReadTGAFile (const char *filename);
+void BuildTGAMipmaps (gl_texture_t *texinfo);
+GLuint UploadTGATexture (gl_texture_t *texinfo);
 GLuint loadTGATexture (const char *filename);
-void edgeDetect();
+unsigned char * detectEdges (unsigned char *gray, int width, int height);
+unsigned char * GetTextureLuminance (gl_texture_t *texinfo);
+int startEdgeDetect (const unsigned char *gray, int width, int height);
+int pollEdgeDetect (GLuint texture, int *done);
 
 
 /* End of file -------------------------------------------------------------- */
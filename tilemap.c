@@ -0,0 +1,202 @@
+/**
+ * tilemap.c - This module contains the definition/implementation of functions
+ * to read large raw height maps a tile at a time.
+ * <p>
+ * The raw file is memory mapped and split into square tiles of tileSize
+ * samples. A tile is converted to host-order ints (see mapConvert) the first
+ * time one of its samples is asked for and then kept in a small cache; when
+ * the cache is full the least recently used tile is dropped. Only the tiles
+ * around the area being looked at are resident, so maps far larger than the
+ * memory budget (8k x 8k and up) can be browsed.
+ * <p>
+ * Functions that start with 'tlm' are considered as tile map functions.
+ */
+#define _TILEMAP_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+#include "tilemap.h"
+
+/*
+ * Converts one tile out of the mapping into a cache slot.
+ */
+static void _tlmLoad(TileMap *map, int tile, TlmSlot *slot)
+{
+    int sampleSize = mapSampleSize(map->format);
+    int x0 = (tile % map->tilesX) * map->tileSize;
+    int y0 = (tile / map->tilesX) * map->tileSize;
+    int w = map->width - x0 < map->tileSize ? map->width - x0 : map->tileSize;
+    int h = map->height - y0 < map->tileSize ? map->height - y0 : map->tileSize;
+    int y;
+
+    for (y = 0; y < h; y++)
+        mapConvert(map->file.data + ((size_t) (y0 + y) * map->width + x0) * sampleSize,
+                slot->samples + (size_t) y * map->tileSize, w, map->format);
+    slot->tile = tile;
+    map->loads++;
+}
+
+/*
+ * Functions
+ */
+
+/**
+ * Opens a raw height map for tiled access. Nothing is converted yet.
+ * @pre Valid map structure (non-null).
+ * @param map Reference to the structure that receives the map.
+ * @param filename Raw file name.
+ * @param width Number of columns.
+ * @param height Number of rows.
+ * @param format Sample type and byte order of the file (MAP_* flags).
+ * @param tileSize Tile side in samples.
+ * @param capacity Maximum number of resident tiles.
+ * @return 0 on success, -1 on error (reported on stdout).
+ */
+int tlmOpen(TileMap *map, const char *filename, int width, int height, int format,
+        int tileSize, int capacity)
+{
+    int i;
+
+    if (mmfOpen(&map->file, filename) != 0)
+        return -1;
+    if (map->file.size < (size_t) width * height * mapSampleSize(format)) {
+        printf("File \"%s\" is too short for a %d x %d map.\n", filename, width, height);
+        mmfClose(&map->file);
+        return -1;
+    }
+
+    map->width = width;
+    map->height = height;
+    map->format = format;
+    map->tileSize = tileSize;
+    map->tilesX = (width + tileSize - 1) / tileSize;
+    map->tilesY = (height + tileSize - 1) / tileSize;
+    map->capacity = capacity;
+    map->useCount = 0;
+    map->loads = map->evictions = 0;
+
+    map->slotOf = (int*) malloc(sizeof (int) * map->tilesX * map->tilesY);
+    for (i = 0; i < map->tilesX * map->tilesY; i++)
+        map->slotOf[i] = -1;
+    map->slots = (TlmSlot*) calloc(capacity, sizeof (TlmSlot));
+    for (i = 0; i < capacity; i++)
+        map->slots[i].tile = -1;
+
+    return 0;
+}
+
+/**
+ * Closes a tiled map and frees its cache. Tiles handed out become invalid.
+ * @pre Map opened with tlmOpen.
+ * @param map Reference to the map.
+ */
+void tlmClose(TileMap *map)
+{
+    int i;
+
+    for (i = 0; i < map->capacity; i++)
+        free(map->slots[i].samples);
+    free(map->slots);
+    free(map->slotOf);
+    map->slots = NULL;
+    map->slotOf = NULL;
+    mmfClose(&map->file);
+}
+
+/**
+ * Gets a tile, loading it (and evicting the least recently used one) if it
+ * is not resident.
+ * @pre Map opened with tlmOpen, 0 <= tx < tilesX, 0 <= ty < tilesY.
+ * @param map Reference to the map.
+ * @param tx Tile column.
+ * @param ty Tile row.
+ * @return tileSize x tileSize samples, valid until the tile is evicted.
+ */
+const int* tlmGetTile(TileMap *map, int tx, int ty)
+{
+    int tile = ty * map->tilesX + tx;
+    int i, victim = map->slotOf[tile];
+    TlmSlot *slot;
+
+    if (victim < 0) {
+        /* A free slot, otherwise the least recently used one */
+        victim = 0;
+        for (i = 0; i < map->capacity; i++) {
+            if (map->slots[i].tile < 0) {
+                victim = i;
+                break;
+            }
+            if (map->slots[i].lastUse < map->slots[victim].lastUse)
+                victim = i;
+        }
+        slot = &map->slots[victim];
+        if (slot->tile >= 0) {
+            map->slotOf[slot->tile] = -1;
+            map->evictions++;
+        }
+        if (slot->samples == NULL)
+            slot->samples = (int*) malloc(sizeof (int) * map->tileSize * map->tileSize);
+        _tlmLoad(map, tile, slot);
+        map->slotOf[tile] = victim;
+    }
+
+    slot = &map->slots[victim];
+    slot->lastUse = ++map->useCount;
+    return slot->samples;
+}
+
+/**
+ * Gets one sample. Coordinates outside the map are clamped to its edges.
+ * @pre Map opened with tlmOpen.
+ * @param map Reference to the map.
+ * @param x Column.
+ * @param y Row.
+ * @return The height sample.
+ */
+int tlmGetSample(TileMap *map, int x, int y)
+{
+    const int *samples;
+
+    x = x < 0 ? 0 : x >= map->width ? map->width - 1 : x;
+    y = y < 0 ? 0 : y >= map->height ? map->height - 1 : y;
+    samples = tlmGetTile(map, x / map->tileSize, y / map->tileSize);
+    return samples[(y % map->tileSize) * map->tileSize + x % map->tileSize];
+}
+
+/**
+ * Copies a run of samples of one row, a tile span at a time. Columns outside
+ * the map are clamped to its edges.
+ * @pre Map opened with tlmOpen, 0 <= y < height.
+ * @param map Reference to the map.
+ * @param x First column.
+ * @param y Row.
+ * @param count Number of samples.
+ * @param dst Receives the samples.
+ */
+void tlmGetRow(TileMap *map, int x, int y, int count, int *dst)
+{
+    const int *samples;
+    int n;
+
+    while (count > 0 && x < 0) {
+        *dst++ = tlmGetSample(map, x++, y);
+        count--;
+    }
+    while (count > 0 && x < map->width) {
+        samples = tlmGetTile(map, x / map->tileSize, y / map->tileSize)
+                + (y % map->tileSize) * map->tileSize + x % map->tileSize;
+        n = map->tileSize - x % map->tileSize;
+        n = n < count ? n : count;
+        n = n < map->width - x ? n : map->width - x;
+        memcpy(dst, samples, sizeof (int) * n);
+        dst += n;
+        x += n;
+        count -= n;
+    }
+    while (count-- > 0)
+        *dst++ = tlmGetSample(map, x++, y);
+}
+
+/* End of file -------------------------------------------------------------- */
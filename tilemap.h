@@ -0,0 +1,108 @@
+/**
+ * tilemap.h - This module contains the definition/implementation of functions
+ * to read large raw height maps a tile at a time.
+ * <p>
+ * The raw file is memory mapped and split into square tiles of tileSize
+ * samples. A tile is converted to host-order ints (see mapConvert) the first
+ * time one of its samples is asked for and then kept in a small cache; when
+ * the cache is full the least recently used tile is dropped. Only the tiles
+ * around the area being looked at are resident, so maps far larger than the
+ * memory budget (8k x 8k and up) can be browsed.
+ * <p>
+ * Functions that start with 'tlm' are considered as tile map functions.
+ */
+#ifndef _TILEMAP_H_
+#define _TILEMAP_H_
+
+#include "mmfile.h"
+
+/*
+ * Definitions
+ */
+#define TLM_DEFAULT_TILE_SIZE   256
+#define TLM_DEFAULT_CAPACITY    16
+
+/**
+ * Cache slot holding one converted tile.
+ */
+typedef struct
+{
+    /**
+     * Tile number (ty * tilesX + tx), -1 if the slot is free.
+     */
+    int tile;
+
+    /**
+     * Value of the use counter when the tile was last used.
+     */
+    unsigned long lastUse;
+
+    /**
+     * tileSize x tileSize samples (row major, edge tiles partly unused).
+     */
+    int *samples;
+
+} TlmSlot;
+
+/**
+ * Tiled height map.
+ */
+typedef struct
+{
+    /**
+     * The mapped raw file.
+     */
+    MmFile file;
+
+    /**
+     * Map dimensions in samples.
+     */
+    int width, height;
+
+    /**
+     * Sample type and byte order of the file (MAP_* flags).
+     */
+    int format;
+
+    /**
+     * Tile side in samples, and number of tiles across and down.
+     */
+    int tileSize, tilesX, tilesY;
+
+    /**
+     * Cache slots (capacity of them).
+     */
+    TlmSlot *slots;
+    int capacity;
+
+    /**
+     * Slot of each tile, -1 if not resident.
+     */
+    int *slotOf;
+
+    /**
+     * Use counter for the LRU policy.
+     */
+    unsigned long useCount;
+
+    /**
+     * Statistics: tiles loaded (misses) and evicted.
+     */
+    int loads, evictions;
+
+} TileMap;
+
+/**
+ * Prototypes
+ */
+int tlmOpen(TileMap *map, const char *filename, int width, int height, int format,
+        int tileSize, int capacity);
+void tlmClose(TileMap *map);
+
+const int* tlmGetTile(TileMap *map, int tx, int ty);
+int tlmGetSample(TileMap *map, int x, int y);
+void tlmGetRow(TileMap *map, int x, int y, int count, int *dst);
+
+/* End of file -------------------------------------------------------------- */
+
+#endif
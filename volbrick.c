@@ -0,0 +1,107 @@
+/**
+ * Bricked volume tool.
+ *
+ * Converts a NIfTI-1 volume into the bricked layout of brick.c, or cuts a
+ * slice of any orientation out of a bricked file:
+ *
+ *   volbrick [-b size] input.nii output.brk
+ *   volbrick -x axial|coronal|sagittal index input.brk output.pgm
+ *
+ * The bricked files can also be fed straight to edgebatch (see -a there).
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "brick.h"
+
+/*
+ * Protoypes
+ */
+int parseAxis(const char *name);
+int convert(const char *input, const char *output, int brickSize);
+int extract(const char *input, int axis, int index, const char *output);
+
+/*
+ * Function definitions
+ */
+
+/*
+ * Parses an orientation name.
+ * @param name "axial", "coronal" or "sagittal".
+ * @return BRK_AXIAL, BRK_CORONAL, BRK_SAGITTAL or -1.
+ */
+int parseAxis(const char *name) {
+    if (!strcmp(name, "axial"))
+        return BRK_AXIAL;
+    if (!strcmp(name, "coronal"))
+        return BRK_CORONAL;
+    if (!strcmp(name, "sagittal"))
+        return BRK_SAGITTAL;
+    return -1;
+}
+
+/*
+ * Converts a NIfTI volume into a bricked file.
+ * @return Status code.
+ */
+int convert(const char *input, const char *output, int brickSize) {
+    NiiVolume vol;
+    int status;
+
+    if (niiOpen(&vol, input) != 0)
+        return EXIT_FAILURE;
+    status = brkWrite(&vol, output, brickSize);
+    if (status == 0)
+        printf("%s: %d x %d x %d voxels in %d x %d x %d bricks of %d^3\n", output,
+                vol.nx, vol.ny, vol.nz, (vol.nx + brickSize - 1) / brickSize,
+                (vol.ny + brickSize - 1) / brickSize, (vol.nz + brickSize - 1) / brickSize,
+                brickSize);
+    niiClose(&vol);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Writes one slice of a bricked file as PGM.
+ * @return Status code.
+ */
+int extract(const char *input, int axis, int index, const char *output) {
+    BrkVolume vol;
+    struct image img;
+    unsigned char *buffer;
+    int w, h, status;
+
+    if (brkOpen(&vol, input) != 0)
+        return EXIT_FAILURE;
+    brkSliceSize(&vol, axis, &w, &h);
+    buffer = (unsigned char*) malloc((size_t) w * h);
+    status = brkGetSlice(&vol, axis, index, &img, buffer);
+    if (status != 0)
+        fprintf(stderr, "error: slice %d is out of range!\n", index);
+    else
+        status = write_pgm_file(&img, output);
+    free(buffer);
+    brkClose(&vol);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Main function.
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ * @return Status code.
+ */
+int main(int argc, char **argv) {
+    int brickSize = BRK_DEFAULT_SIZE;
+
+    if (argc == 6 && !strcmp(argv[1], "-x") && parseAxis(argv[2]) >= 0)
+        return extract(argv[4], parseAxis(argv[2]), atoi(argv[3]), argv[5]);
+    if (argc == 5 && !strcmp(argv[1], "-b"))
+        brickSize = atoi(argv[2]);
+    if ((argc == 3 || argc == 5) && brickSize > 0)
+        return convert(argv[argc - 2], argv[argc - 1], brickSize);
+
+    fprintf(stderr, "usage: %s [-b size] input.nii output.brk\n", argv[0]);
+    fprintf(stderr, "       %s -x axial|coronal|sagittal index input.brk output.pgm\n", argv[0]);
+    return EXIT_FAILURE;
+}
+/* End of file -------------------------------------------------------------- */